@@ -42,7 +42,7 @@ int DhcpClass::request_DHCP_lease(){
     _dhcpInitialTransactionId = _dhcpTransactionId;
 
     _dhcpUdpSocket.stop();
-    if (_dhcpUdpSocket.begin(DHCP_CLIENT_PORT) == 0)
+    if (_dhcpUdpSocket.beginBroadcast(DHCP_CLIENT_PORT) == 0)
     {
       // Couldn't get a socket
       return 0;
@@ -34,6 +34,11 @@ extern "C"
 
 #define UIP_TCP_PHYH_LEN UIP_LLH_LEN+UIP_IPTCPH_LEN
 
+// the stack must always be able to send a full segment (see uipethernet-conf.h)
+#if UIP_POOL_RESERVE > 0 && UIP_POOL_RESERVE < UIP_TCP_MSS+UIP_SOCKET_HEADROOM+UIP_SENDBUFFER_PADDING
+#error "UIP_POOL_RESERVE is too small for a full sized tcp segment"
+#endif
+
 uip_userdata_t UIPClient::all_data[UIP_CONNS];
 
 UIPClient::UIPClient() :
@@ -181,7 +186,10 @@ UIPClient::_write(uip_userdata_t* u, const uint8_t *buf, size_t size)
       if (u->packets_out[p] == NOBLOCK)
         {
 newpacket:
-          u->packets_out[p] = Enc28J60Network::allocBlock(UIP_SOCKET_DATALEN);
+          // while unacknowledged data fills the socket's quota (or the
+          // pool), wait for acks instead of failing allocations
+          if (UIPNetwork::withinQuota(UIP_SOCKET_BLOCKLEN, MEMPOOL_OWNER_TCP(u - all_data), UIP_SOCKET_OVERHEAD))
+            u->packets_out[p] = UIPNetwork::allocBlock(UIP_SOCKET_BLOCKLEN, MEMPOOL_OWNER_TCP(u - all_data), UIP_SOCKET_OVERHEAD);
           if (u->packets_out[p] == NOBLOCK)
             {
 #if UIP_ATTEMPTS_ON_WRITE > 0
@@ -192,7 +200,7 @@ newpacket:
 #endif
               goto ready;
             }
-          u->out_pos = 0;
+          u->out_pos = UIP_SOCKET_HEADROOM;
         }
 #ifdef UIPETHERNET_DEBUG_CLIENT
       Serial.print(F("UIPClient.write: writePacket("));
@@ -207,7 +215,10 @@ newpacket:
       Serial.write((uint8_t*)buf+size-remain,remain);
       Serial.println(F("'"));
 #endif
-      written = Enc28J60Network::writePacket(u->packets_out[p],u->out_pos,(uint8_t*)buf+size-remain,remain);
+      written = UIPNetwork::blockSize(u->packets_out[p]) - UIP_SENDBUFFER_PADDING - u->out_pos;
+      if (written > remain)
+        written = remain;
+      written = UIPNetwork::writePacket(u->packets_out[p],u->out_pos,(uint8_t*)buf+size-remain,written);
       remain -= written;
       u->out_pos+=written;
       if (remain > 0)
@@ -234,6 +245,47 @@ ready:
   return -1;
 }
 
+// queues block (holding the size bytes of buf) as a segment of its own
+// without copying it. Falls back to _write() if all packets_out are taken
+size_t
+UIPClient::_writeShared(uip_userdata_t* u, memhandle block, const uint8_t *buf, size_t size)
+{
+  if (u && !(u->state & (UIP_CLIENT_CLOSE | UIP_CLIENT_REMOTECLOSED)))
+    {
+      uint8_t p = _currentBlock(&u->packets_out[0]);
+      if (u->packets_out[p] != NOBLOCK)
+        {
+          // segments are sent whole, so cut the current block down to
+          // what was written. Nothing may follow it anymore
+          if (u->out_pos == UIP_SOCKET_HEADROOM)
+            {
+              UIPNetwork::freeBlock(u->packets_out[p]);
+              u->packets_out[p] = NOBLOCK;
+            }
+          else
+            {
+              if (u->out_pos + UIP_SENDBUFFER_PADDING < UIPNetwork::blockSize(u->packets_out[p]))
+                UIPNetwork::resizeBlock(u->packets_out[p],0,u->out_pos + UIP_SENDBUFFER_PADDING);
+              p++;
+            }
+        }
+      if (p < UIP_SOCKET_NUMPACKETS)
+        {
+          u->packets_out[p] = UIPNetwork::shareBlock(block);
+          if (u->packets_out[p] != NOBLOCK)
+            {
+              // full, the next write starts a new block
+              u->out_pos = UIP_SOCKET_HEADROOM + size;
+#if UIP_CLIENT_TIMER >= 0
+              u->timer = millis()+UIP_CLIENT_TIMER;
+#endif
+              return size;
+            }
+        }
+    }
+  return _write(u,buf,size);
+}
+
 int
 UIPClient::available()
 {
@@ -248,7 +300,7 @@ UIPClient::_available(uip_userdata_t *u)
   int len = 0;
   for (uint8_t i = 0; i < UIP_SOCKET_NUMPACKETS; i++)
     {
-      len += Enc28J60Network::blockSize(u->packets_in[i]);
+      len += UIPNetwork::blockSize(u->packets_in[i]);
     }
   return len;
 }
@@ -264,8 +316,8 @@ UIPClient::read(uint8_t *buf, size_t size)
       uint16_t read;
       do
         {
-          read = Enc28J60Network::readPacket(data->packets_in[0],0,buf+size-remain,remain);
-          if (read == Enc28J60Network::blockSize(data->packets_in[0]))
+          read = UIPNetwork::readPacket(data->packets_in[0],0,buf+size-remain,remain);
+          if (read == UIPNetwork::blockSize(data->packets_in[0]))
             {
               remain -= read;
               _eatBlock(&data->packets_in[0]);
@@ -283,7 +335,7 @@ UIPClient::read(uint8_t *buf, size_t size)
             }
           else
             {
-              Enc28J60Network::resizeBlock(data->packets_in[0],read);
+              UIPNetwork::resizeBlock(data->packets_in[0],read);
               break;
             }
         }
@@ -310,7 +362,7 @@ UIPClient::peek()
       if (data->packets_in[0] != NOBLOCK)
         {
           uint8_t c;
-          Enc28J60Network::readPacket(data->packets_in[0],0,&c,1);
+          UIPNetwork::readPacket(data->packets_in[0],0,&c,1);
           return c;
         }
     }
@@ -365,18 +417,33 @@ uipclient_appcall(void)
                 {
                   if (u->packets_in[i] == NOBLOCK)
                     {
-                      u->packets_in[i] = Enc28J60Network::allocBlock(uip_len);
+                      u->packets_in[i] = UIPNetwork::allocBlock(uip_len, MEMPOOL_OWNER_TCP(u - UIPClient::all_data));
                       if (u->packets_in[i] != NOBLOCK)
                         {
-                          Enc28J60Network::copyPacket(u->packets_in[i],0,UIPEthernetClass::in_packet,((uint8_t*)uip_appdata)-uip_buf,uip_len);
-                          if (i == UIP_SOCKET_NUMPACKETS-1)
+                          UIPNetwork::copyPacket(u->packets_in[i],0,UIPEthernetClass::in_packet,((uint8_t*)uip_appdata)-uip_buf,uip_len);
+                          // close the window before the peer sends more than
+                          // there is room for: with several segments in flight
+                          // it may well use all of it
+                          if (i == UIP_SOCKET_NUMPACKETS-1
+#if UIP_SOCKET_QUOTA > 0
+                              || UIPNetwork::ownerBytes(MEMPOOL_OWNER_TCP(u - UIPClient::all_data)) + UIP_RECEIVE_WINDOW > UIP_SOCKET_QUOTA
+#endif
+                              )
                             uip_stop();
                           goto finish_newdata;
                         }
+                      break;
                     }
                 }
-              UIPEthernetClass::packetstate &= ~UIPETHERNET_FREEPACKET;
-              uip_stop();
+              // out of memory (or over the sockets quota): the peer has to
+              // retransmit. Close the window until read() made room, if
+              // there is nothing to read wait for the retransmission
+              uip_reject();
+              if (u->packets_in[0] != NOBLOCK)
+                uip_stop();
+              // a FIN that came with the data is sent again as well
+              if (uip_closed())
+                goto finish;
             }
         }
 finish_newdata:
@@ -394,6 +461,7 @@ finish_newdata:
 #endif
           // drop outgoing packets not sent yet:
           UIPClient::_flushBlocks(&u->packets_out[0]);
+          u->out_acked = 0;
           if (u->packets_in[0] != NOBLOCK)
             {
               ((uip_userdata_closed_t *)u)->lport = uip_conn->lport;
@@ -414,34 +482,77 @@ finish_newdata:
 #ifdef UIPETHERNET_DEBUG_CLIENT
           Serial.println(F("UIPClient uip_acked"));
 #endif
-          UIPClient::_eatBlock(&u->packets_out[0]);
+          UIPClient::_ackBlocks(u,uip_acklen);
         }
-      if (uip_poll() || uip_rexmit())
+      // each block of packets_out goes out as a segment of its own. Those
+      // in flight stay queued until acknowledged, the next one is sent as
+      // long as the window has room for it
+      if (uip_poll() || uip_rexmit() || uip_acked())
         {
 #ifdef UIPETHERNET_DEBUG_CLIENT
           //Serial.println(F("UIPClient uip_poll"));
 #endif
           if (u->packets_out[0] != NOBLOCK)
             {
-              if (u->packets_out[1] == NOBLOCK)
+              uint8_t p = 0;
+              uint16_t inflight = uip_outstanding(uip_conn);
+              if (uip_rexmit())
                 {
-                  send_len = u->out_pos;
-                  if (send_len > 0)
+                  // resend the oldest segment
+                  send_len = UIPClient::_segmentLen(u,0);
+                  if (send_len > inflight)
+                    send_len = inflight;
+                  if (send_len > uip_mss())
+                    send_len = uip_mss();
+                }
+              else
+                {
+                  while (p < UIP_SOCKET_NUMPACKETS && u->packets_out[p] != NOBLOCK && inflight > 0)
                     {
-                      Enc28J60Network::resizeBlock(u->packets_out[0],0,send_len);
+                      memaddress size = UIPClient::_segmentLen(u,p);
+                      if (inflight < size)
+                        // the rest of a segment the peer's window cut short
+                        // follows once the first part was acknowledged
+                        goto finish;
+                      inflight -= size;
+                      p++;
+                    }
+                  if (p == UIP_SOCKET_NUMPACKETS || u->packets_out[p] == NOBLOCK)
+                    goto finish;
+                  if (p == UIP_SOCKET_NUMPACKETS-1 || u->packets_out[p+1] == NOBLOCK)
+                    {
+                      send_len = u->out_pos - UIP_SOCKET_HEADROOM - (p ? 0 : u->out_acked);
+                      if (send_len > 0 && u->out_pos + UIP_SENDBUFFER_PADDING < UIPNetwork::blockSize(u->packets_out[p]))
+                        {
+                          UIPNetwork::resizeBlock(u->packets_out[p],0,u->out_pos + UIP_SENDBUFFER_PADDING);
+                        }
                     }
+                  else
+                    send_len = UIPClient::_segmentLen(u,p);
+                  if (send_len > uip_mss())
+                    send_len = uip_mss();
+                  // uIP refuses new data beyond the window unless nothing
+                  // is in flight
+                  if (uip_outstanding(uip_conn) > 0 && uip_outstanding(uip_conn) + send_len > uip_window(uip_conn))
+                    send_len = 0;
                 }
-              else
-                send_len = Enc28J60Network::blockSize(u->packets_out[0]);
               if (send_len > 0)
                 {
                   UIPEthernetClass::uip_hdrlen = ((uint8_t*)uip_appdata)-uip_buf;
-                  UIPEthernetClass::uip_packet = Enc28J60Network::allocBlock(UIPEthernetClass::uip_hdrlen + send_len + UIP_SENDBUFFER_OFFSET + UIP_SENDBUFFER_PADDING);
-                  if (UIPEthernetClass::uip_packet != NOBLOCK)
+                  // a whole block goes out as it is, the driver holds a
+                  // reference until it is sent. Blocks other clients share
+                  // or still queued for sending (and parts of blocks) are
+                  // copied into a frame of their own
+                  if (send_len == UIPClient::_segmentLen(u,p) && (p || !u->out_acked) && !UIPNetwork::blockShared(u->packets_out[p]))
+                    UIPEthernetClass::uip_packet = UIPNetwork::shareBlock(u->packets_out[p]);
+                  else
                     {
-                      Enc28J60Network::copyPacket(UIPEthernetClass::uip_packet,UIPEthernetClass::uip_hdrlen + UIP_SENDBUFFER_OFFSET,u->packets_out[0],0,send_len);
-                      UIPEthernetClass::packetstate |= UIPETHERNET_SENDPACKET;
+                      UIPEthernetClass::uip_packet = UIPNetwork::allocBlock(UIPEthernetClass::uip_hdrlen + send_len + UIP_SENDBUFFER_OFFSET + UIP_SENDBUFFER_PADDING);
+                      if (UIPEthernetClass::uip_packet != NOBLOCK)
+                        UIPNetwork::copyPacket(UIPEthernetClass::uip_packet,UIPEthernetClass::uip_hdrlen + UIP_SENDBUFFER_OFFSET,u->packets_out[p],UIP_SOCKET_HEADROOM + (p ? 0 : u->out_acked),send_len);
                     }
+                  if (UIPEthernetClass::uip_packet != NOBLOCK)
+                    UIPEthernetClass::packetstate |= UIPETHERNET_SENDPACKET;
                 }
               goto finish;
             }
@@ -519,7 +630,7 @@ UIPClient::_eatBlock(memhandle* block)
     }
   Serial.print(F("-> "));
 #endif
-  Enc28J60Network::freeBlock(block[0]);
+  UIPNetwork::freeBlock(block[0]);
   for (uint8_t i = 0; i < UIP_SOCKET_NUMPACKETS-1; i++)
     {
       block[i] = block[i+1];
@@ -535,12 +646,52 @@ UIPClient::_eatBlock(memhandle* block)
 #endif
 }
 
+// number of data bytes in packets_out[p] the peer hasn't acknowledged
+memaddress
+UIPClient::_segmentLen(uip_userdata_t* u, uint8_t p)
+{
+  return UIPNetwork::blockSize(u->packets_out[p]) - UIP_SOCKET_HEADROOM - UIP_SENDBUFFER_PADDING - (p ? 0 : u->out_acked);
+}
+
+// releases the len bytes at the front of packets_out the peer acknowledged:
+// whole blocks, and the front of a block it received only part of (cutting
+// off its front keeps the headroom in front of the rest). A block other
+// clients share can't be cut, the bytes acknowledged are counted in
+// out_acked until the rest of it is acknowledged or it isn't shared anymore
+void
+UIPClient::_ackBlocks(uip_userdata_t* u, uint16_t len)
+{
+  memhandle* block = &u->packets_out[0];
+  while (len > 0 && block[0] != NOBLOCK)
+    {
+      memaddress size = _segmentLen(u,0);
+      if (len >= size)
+        {
+          _eatBlock(block);
+          u->out_acked = 0;
+          len -= size;
+          continue;
+        }
+      if (UIPNetwork::blockShared(block[0]))
+        u->out_acked += len;
+      else
+        {
+          len += u->out_acked;
+          u->out_acked = 0;
+          UIPNetwork::resizeBlock(block[0],len);
+          if (block[1] == NOBLOCK)
+            u->out_pos -= len;
+        }
+      break;
+    }
+}
+
 void
 UIPClient::_flushBlocks(memhandle* block)
 {
   for (uint8_t i = 0; i < UIP_SOCKET_NUMPACKETS; i++)
     {
-      Enc28J60Network::freeBlock(block[i]);
+      UIPNetwork::freeBlock(block[i]);
       block[i] = NOBLOCK;
     }
 }
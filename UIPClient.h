@@ -30,6 +30,13 @@ extern "C" {
 }
 
 #define UIP_SOCKET_DATALEN UIP_TCP_MSS
+// a block of packets_out is the frame its segment goes out in: the data
+// follows room for the headers (written by UIPEthernetClass::network_send)
+// and is followed by the padding the driver needs
+#define UIP_SOCKET_HEADROOM (UIP_SENDBUFFER_OFFSET+UIP_LLH_LEN+UIP_IPTCPH_LEN)
+#define UIP_SOCKET_BLOCKLEN (UIP_SOCKET_HEADROOM+UIP_SOCKET_DATALEN+UIP_SENDBUFFER_PADDING)
+// the part of the block that doesn't count against the sockets quota
+#define UIP_SOCKET_OVERHEAD (UIP_SOCKET_HEADROOM+UIP_SENDBUFFER_PADDING)
 //#define UIP_SOCKET_NUMPACKETS UIP_RECEIVE_WINDOW/UIP_TCP_MSS+1
 #ifndef UIP_SOCKET_NUMPACKETS
 #define UIP_SOCKET_NUMPACKETS 5
@@ -55,6 +62,7 @@ typedef struct {
   memhandle packets_in[UIP_SOCKET_NUMPACKETS];
   memhandle packets_out[UIP_SOCKET_NUMPACKETS];
   memaddress out_pos;
+  memaddress out_acked;   // of packets_out[0] while it is shared, see _ackBlocks()
 #if UIP_CLIENT_TIMER >= 0
   unsigned long timer;
 #endif
@@ -92,10 +100,13 @@ private:
   static uip_userdata_t* _allocateData();
 
   static size_t _write(uip_userdata_t *,const uint8_t *buf, size_t size);
+  static size_t _writeShared(uip_userdata_t *,memhandle block,const uint8_t *buf, size_t size);
   static int _available(uip_userdata_t *);
 
   static uint8_t _currentBlock(memhandle* blocks);
+  static memaddress _segmentLen(uip_userdata_t *,uint8_t p);
   static void _eatBlock(memhandle* blocks);
+  static void _ackBlocks(uip_userdata_t *,uint16_t len);
   static void _flushBlocks(memhandle* blocks);
 
 #ifdef UIPETHERNET_DEBUG_CLIENT
@@ -19,7 +19,7 @@
 
 #include <Arduino.h>
 #include "UIPEthernet.h"
-#include "utility/Enc28J60Network.h"
+#include "utility/UIPNetwork.h"
 
 #if(defined UIPETHERNET_DEBUG || defined UIPETHERNET_DEBUG_CHKSUM)
 #include "HardwareSerial.h"
@@ -56,13 +56,13 @@ UIPEthernetClass::UIPEthernetClass()
 
 #if UIP_UDP
 int
-UIPEthernetClass::begin(const uint8_t* mac)
+UIPEthernetClass::begin(const uint8_t* mac, uint16_t rxsize)
 {
   static DhcpClass s_dhcp;
   _dhcp = &s_dhcp;
 
   // Initialise the basic info
-  init(mac);
+  init(mac, rxsize);
 
   // Now try to get our config info from a DHCP server
   int ret = _dhcp->beginWithDHCP((uint8_t*)mac);
@@ -77,32 +77,32 @@ UIPEthernetClass::begin(const uint8_t* mac)
 #endif
 
 void
-UIPEthernetClass::begin(const uint8_t* mac, IPAddress ip)
+UIPEthernetClass::begin(const uint8_t* mac, IPAddress ip, uint16_t rxsize)
 {
   IPAddress dns = ip;
   dns[3] = 1;
-  begin(mac, ip, dns);
+  begin(mac, ip, dns, rxsize);
 }
 
 void
-UIPEthernetClass::begin(const uint8_t* mac, IPAddress ip, IPAddress dns)
+UIPEthernetClass::begin(const uint8_t* mac, IPAddress ip, IPAddress dns, uint16_t rxsize)
 {
   IPAddress gateway = ip;
   gateway[3] = 1;
-  begin(mac, ip, dns, gateway);
+  begin(mac, ip, dns, gateway, rxsize);
 }
 
 void
-UIPEthernetClass::begin(const uint8_t* mac, IPAddress ip, IPAddress dns, IPAddress gateway)
+UIPEthernetClass::begin(const uint8_t* mac, IPAddress ip, IPAddress dns, IPAddress gateway, uint16_t rxsize)
 {
   IPAddress subnet(255, 255, 255, 0);
-  begin(mac, ip, dns, gateway, subnet);
+  begin(mac, ip, dns, gateway, subnet, rxsize);
 }
 
 void
-UIPEthernetClass::begin(const uint8_t* mac, IPAddress ip, IPAddress dns, IPAddress gateway, IPAddress subnet)
+UIPEthernetClass::begin(const uint8_t* mac, IPAddress ip, IPAddress dns, IPAddress gateway, IPAddress subnet, uint16_t rxsize)
 {
-  init(mac);
+  init(mac, rxsize);
   configure(ip,dns,gateway,subnet);
 }
 
@@ -163,9 +163,15 @@ IPAddress UIPEthernetClass::dnsServerIP()
 void
 UIPEthernetClass::tick()
 {
+  UIPNetwork::pollDma();
+  UIPNetwork::pollTransmit();
   if (in_packet == NOBLOCK)
     {
-      in_packet = Enc28J60Network::receivePacket();
+      in_packet = UIPNetwork::receivePacket();
+#if UIP_PCAP
+      if (in_packet != NOBLOCK)
+        UIPPcap::capture(in_packet, 0, UIPNetwork::blockSize(in_packet));
+#endif
 #ifdef UIPETHERNET_DEBUG
       if (in_packet != NOBLOCK)
         {
@@ -177,10 +183,10 @@ UIPEthernetClass::tick()
   if (in_packet != NOBLOCK)
     {
       packetstate = UIPETHERNET_FREEPACKET;
-      uip_len = Enc28J60Network::blockSize(in_packet);
+      uip_len = UIPNetwork::blockSize(in_packet);
       if (uip_len > 0)
         {
-          Enc28J60Network::readPacket(in_packet,0,(uint8_t*)uip_buf,UIP_BUFSIZE);
+          UIPNetwork::readPacket(in_packet,0,(uint8_t*)uip_buf,UIP_BUFSIZE);
           if (ETH_HDR ->type == HTONS(UIP_ETHTYPE_IP))
             {
               uip_packet = in_packet; //required for upper_layer_checksum of in_packet!
@@ -189,6 +195,17 @@ UIPEthernetClass::tick()
               Serial.println(uip_len);
 #endif
               uip_arp_ipin();
+#if UIP_MULTICAST
+              if (BUF->proto == UIP_PROTO_IGMP)
+                {
+                  igmp_input();
+                  uip_len = 0;
+                }
+              // the hash filter lets other groups through as well
+              else if (uip_ipaddr_ismulticast(BUF->destipaddr) && !multicast_member(BUF->destipaddr))
+                uip_len = 0;
+              else
+#endif
               uip_input();
               if (uip_len > 0)
                 {
@@ -215,10 +232,13 @@ UIPEthernetClass::tick()
           Serial.print(F("freeing packet: "));
           Serial.println(in_packet);
 #endif
-          Enc28J60Network::freePacket();
+          UIPNetwork::freePacket();
           in_packet = NOBLOCK;
         }
     }
+  // nothing received, time to defragment the pool as long as the DMA is idle
+  else if (UIPNetwork::pollDma())
+    UIPNetwork::compactStep();
 
   unsigned long now = millis();
 
@@ -244,7 +264,9 @@ UIPEthernetClass::tick()
         }
       else
         {
-          if ((long)( now - ((uip_userdata_t*)uip_conn->appstate)->timer) >= 0)
+          // unused connections have no userdata
+          uip_userdata_t* data = (uip_userdata_t*)uip_conn->appstate;
+          if (data && (long)( now - data->timer) >= 0)
             uip_process(UIP_POLL_REQUEST);
           else
             continue;
@@ -277,6 +299,9 @@ UIPEthernetClass::tick()
             }
         }
 #endif /* UIP_UDP */
+#if UIP_MULTICAST
+      igmp_periodic(now);
+#endif
     }
 }
 
@@ -290,17 +315,19 @@ boolean UIPEthernetClass::network_send()
       Serial.print(F(", hdrlen: "));
       Serial.println(uip_hdrlen);
 #endif
-      Enc28J60Network::writePacket(uip_packet,UIP_SENDBUFFER_OFFSET,uip_buf,uip_hdrlen);
+      UIPNetwork::writePacket(uip_packet,UIP_SENDBUFFER_OFFSET,uip_buf,uip_hdrlen);
       packetstate &= ~ UIPETHERNET_SENDPACKET;
-      if (Enc28J60Network::sendPacket(uip_packet))
+      // on success the driver owns uip_packet and frees it after transmission
+      if (network_transmit(uip_packet))
         {
-          Enc28J60Network::freeBlock(uip_packet);
           uip_packet = NOBLOCK;
           return true;
         }
+      UIPNetwork::freeBlock(uip_packet);
+      uip_packet = NOBLOCK;
       return false;
     }
-  uip_packet = Enc28J60Network::allocBlock(uip_len + UIP_SENDBUFFER_OFFSET + UIP_SENDBUFFER_PADDING);
+  uip_packet = UIPNetwork::allocBlock(uip_len + UIP_SENDBUFFER_OFFSET + UIP_SENDBUFFER_PADDING);
   if (uip_packet != NOBLOCK)
     {
 #ifdef UIPETHERNET_DEBUG
@@ -309,19 +336,209 @@ boolean UIPEthernetClass::network_send()
       Serial.print(F(", packet: "));
       Serial.println(uip_packet);
 #endif
-      Enc28J60Network::writePacket(uip_packet,UIP_SENDBUFFER_OFFSET,uip_buf,uip_len);
-      bool register success = Enc28J60Network::sendPacket(uip_packet);
-      Enc28J60Network::freeBlock(uip_packet);
+      UIPNetwork::writePacket(uip_packet,UIP_SENDBUFFER_OFFSET,uip_buf,uip_len);
+      if (network_transmit(uip_packet))
+        {
+          uip_packet = NOBLOCK;
+          return true;
+        }
+      UIPNetwork::freeBlock(uip_packet);
       uip_packet = NOBLOCK;
-      return success;
     }
   return false;
 }
 
-void UIPEthernetClass::init(const uint8_t* mac) {
+boolean
+UIPEthernetClass::network_transmit(memhandle packet)
+{
+#if UIP_PCAP
+  UIPPcap::capture(packet, UIP_SENDBUFFER_OFFSET, UIPNetwork::blockSize(packet) - UIP_SENDBUFFER_OFFSET - UIP_SENDBUFFER_PADDING);
+#endif
+  return UIPNetwork::sendPacket(packet);
+}
+
+#if UIP_MULTICAST
+boolean
+UIPEthernetClass::multicast_member(const uip_ipaddr_t group)
+{
+  for (int i = 0; i < UIP_UDP_CONNS; i++)
+    {
+      uip_udp_userdata_t* data = (uip_udp_userdata_t *)uip_udp_conns[i].appstate;
+      if (uip_udp_conns[i].lport != 0 && data && uip_ipaddr_cmp(data->group, group))
+        return true;
+    }
+  return false;
+}
+
+void
+UIPEthernetClass::multicast_join(const uip_ipaddr_t group)
+{
+  multicast_filter();
+  igmp_send(UIP_IGMP_V2_REPORT, group, group);
+}
+
+void
+UIPEthernetClass::multicast_leave(const uip_ipaddr_t group)
+{
+  if (multicast_member(group))
+    return;
+  uip_ipaddr_t allrouters;
+  uip_ipaddr(allrouters, 224,0,0,2);
+  igmp_send(UIP_IGMP_LEAVE, group, allrouters);
+  multicast_filter();
+}
+
+void
+UIPEthernetClass::multicast_filter()
+{
+  // group 224.0.0.1 (all hosts) is always included so queries get through
+  uint8_t table[8] = { 0 };
+  uint8_t mac[6] = { 0x01, 0x00, 0x5e, 0x00, 0x00, 0x01 };
+  uint8_t bit = UIPNetwork::hashFilterBit(mac);
+  table[bit >> 3] |= 1 << (bit & 7);
+  boolean joined = false;
+  for (int i = 0; i < UIP_UDP_CONNS; i++)
+    {
+      uip_udp_userdata_t* data = (uip_udp_userdata_t *)uip_udp_conns[i].appstate;
+      if (uip_udp_conns[i].lport != 0 && data && (data->group[0] || data->group[1]))
+        {
+          mac[3] = ((uint8_t*)data->group)[1] & 0x7f;
+          mac[4] = ((uint8_t*)data->group)[2];
+          mac[5] = ((uint8_t*)data->group)[3];
+          bit = UIPNetwork::hashFilterBit(mac);
+          table[bit >> 3] |= 1 << (bit & 7);
+          joined = true;
+        }
+    }
+  UIPNetwork::setHashFilter(table);
+  uint8_t filter = UIPNetwork::receiveFilter();
+  UIPNetwork::setReceiveFilter(joined ? filter | ERXFCON_HTEN : filter & ~ERXFCON_HTEN);
+}
+
+void
+UIPEthernetClass::igmp_input()
+{
+  uint8_t* igmp = &uip_buf[UIP_LLH_LEN + ((BUF->vhl & 0x0f) << 2)];
+  uip_ipaddr_t group;
+  memcpy(group, &igmp[4], 4);
+  // another member reported the group: ours would be redundant
+  if (igmp[0] == UIP_IGMP_V2_REPORT || igmp[0] == UIP_IGMP_V1_REPORT)
+    {
+      for (int i = 0; i < UIP_UDP_CONNS; i++)
+        {
+          uip_udp_userdata_t* data = (uip_udp_userdata_t *)uip_udp_conns[i].appstate;
+          if (uip_udp_conns[i].lport != 0 && data && uip_ipaddr_cmp(data->group, group))
+            data->reports = 0;
+        }
+      return;
+    }
+  if (igmp[0] != UIP_IGMP_QUERY)
+    return;
+  // answer after a random time up to the maximum response time (in 1/10s,
+  // 0 from an IGMPv1 router means 10s), igmp_periodic() sends the report.
+  // A report pending already is sent earlier if needed. A general query
+  // (group 0.0.0.0) is answered for every group joined, each group once.
+  unsigned long now = millis();
+  unsigned long due = now + random((igmp[1] ? igmp[1] : 100) * 100L);
+  for (int i = 0; i < UIP_UDP_CONNS; i++)
+    {
+      uip_udp_userdata_t* data = (uip_udp_userdata_t *)uip_udp_conns[i].appstate;
+      if (uip_udp_conns[i].lport == 0 || !data || !(data->group[0] || data->group[1]))
+        continue;
+      if ((group[0] || group[1]) && !uip_ipaddr_cmp(data->group, group))
+        continue;
+      int j;
+      for (j = 0; j < i; j++)
+        {
+          uip_udp_userdata_t* prev = (uip_udp_userdata_t *)uip_udp_conns[j].appstate;
+          if (uip_udp_conns[j].lport != 0 && prev && uip_ipaddr_cmp(prev->group, data->group))
+            break;
+        }
+      if (j < i)
+        continue;
+      if (!data->reports)
+        {
+          data->reports = 1;
+          data->report_timer = due;
+        }
+      else if ((long)( data->report_timer - due ) > 0)
+        data->report_timer = due;
+    }
+}
+
+void
+UIPEthernetClass::igmp_periodic(unsigned long now)
+{
+  // repeat the unsolicited report of a join in case the first got lost,
+  // answer queries (see igmp_input())
+  for (int i = 0; i < UIP_UDP_CONNS; i++)
+    {
+      uip_udp_userdata_t* data = (uip_udp_userdata_t *)uip_udp_conns[i].appstate;
+      if (uip_udp_conns[i].lport != 0 && data && data->reports && (long)( now - data->report_timer ) >= 0)
+        {
+          data->reports--;
+          data->report_timer = now + UIP_IGMP_REPORT_INTERVAL;
+          igmp_send(UIP_IGMP_V2_REPORT, data->group, data->group);
+        }
+    }
+}
+
+void
+UIPEthernetClass::igmp_send(uint8_t type, const uip_ipaddr_t group, const uip_ipaddr_t dest)
+{
+  // ethernet header, ip header with router alert option (24 bytes), igmp message (8 bytes)
+  uint8_t packet[UIP_LLH_LEN + 24 + 8];
+  uint8_t* ip = &packet[UIP_LLH_LEN];
+  uint8_t* igmp = &ip[24];
+  uint16_t sum;
+
+  packet[0] = 0x01;
+  packet[1] = 0x00;
+  packet[2] = 0x5e;
+  packet[3] = ((const uint8_t*)dest)[1] & 0x7f;
+  packet[4] = ((const uint8_t*)dest)[2];
+  packet[5] = ((const uint8_t*)dest)[3];
+  memcpy(&packet[6], uip_ethaddr.addr, 6);
+  packet[12] = UIP_ETHTYPE_IP >> 8;
+  packet[13] = UIP_ETHTYPE_IP & 0xff;
+
+  memset(ip, 0, 24);
+  ip[0] = 0x46;   // version 4, header length 6 words
+  ip[1] = 0xc0;   // precedence internetwork control
+  ip[3] = 24 + 8;
+  ip[8] = 1;      // ttl
+  ip[9] = UIP_PROTO_IGMP;
+  memcpy(&ip[12], uip_hostaddr, 4);
+  memcpy(&ip[16], dest, 4);
+  ip[20] = 0x94;  // router alert
+  ip[21] = 0x04;
+  sum = ~chksum(0, ip, 24);
+  ip[10] = sum >> 8;
+  ip[11] = sum & 0xff;
+
+  igmp[0] = type;
+  igmp[1] = 0;
+  igmp[2] = 0;
+  igmp[3] = 0;
+  memcpy(&igmp[4], group, 4);
+  sum = ~chksum(0, igmp, 8);
+  igmp[2] = sum >> 8;
+  igmp[3] = sum & 0xff;
+
+  memhandle packethandle = UIPNetwork::allocBlock(sizeof(packet) + UIP_SENDBUFFER_OFFSET + UIP_SENDBUFFER_PADDING);
+  if (packethandle != NOBLOCK)
+    {
+      UIPNetwork::writePacket(packethandle, UIP_SENDBUFFER_OFFSET, packet, sizeof(packet));
+      if (!network_transmit(packethandle))
+        UIPNetwork::freeBlock(packethandle);
+    }
+}
+#endif
+
+void UIPEthernetClass::init(const uint8_t* mac, uint16_t rxsize) {
   periodic_timer = millis() + UIP_PERIODIC_TIMER;
 
-  Enc28J60Network::init((uint8_t*)mac);
+  UIPNetwork::init((uint8_t*)mac, rxsize);
   uip_seteth_addr(mac);
 
   uip_init();
@@ -446,7 +663,7 @@ uip_tcpchksum(void)
 #endif
   if (upper_layer_memlen < upper_layer_len)
     {
-      sum = Enc28J60Network::chksum(
+      sum = UIPNetwork::chksum(
           sum,
           UIPEthernetClass::uip_packet,
           (UIPEthernetClass::packetstate & UIPETHERNET_SENDPACKET ? UIP_IPH_LEN + UIP_LLH_LEN + UIP_SENDBUFFER_OFFSET : UIP_IPH_LEN + UIP_LLH_LEN) + upper_layer_memlen,
@@ -29,10 +29,13 @@
 #include <Arduino.h>
 #include "Dhcp.h"
 #include "IPAddress.h"
-#include "utility/Enc28J60Network.h"
+#include "utility/UIPNetwork.h"
 #include "UIPClient.h"
 #include "UIPServer.h"
 #include "UIPUdp.h"
+#if UIP_PCAP
+#include "utility/uip_pcap.h"
+#endif
 
 extern "C"
 {
@@ -43,6 +46,16 @@ extern "C"
 #define UIPETHERNET_FREEPACKET 1
 #define UIPETHERNET_SENDPACKET 2
 
+#define UIP_IGMP_QUERY     0x11
+#define UIP_IGMP_V1_REPORT 0x12
+#define UIP_IGMP_V2_REPORT 0x16
+#define UIP_IGMP_LEAVE     0x17
+
+// reports sent on joining a group, UIP_IGMP_REPORT_INTERVAL ms apart
+// (robustness variable and unsolicited report interval of RFC 2236)
+#define UIP_IGMP_REPORTS         2
+#define UIP_IGMP_REPORT_INTERVAL 10000
+
 #define uip_ip_addr(addr, ip) do { \
                      ((u16_t *)(addr))[0] = HTONS(((ip[0]) << 8) | (ip[1])); \
                      ((u16_t *)(addr))[1] = HTONS(((ip[2]) << 8) | (ip[3])); \
@@ -64,11 +77,14 @@ class UIPEthernetClass
 public:
   UIPEthernetClass();
 
-  int begin(const uint8_t* mac);
-  void begin(const uint8_t* mac, IPAddress ip);
-  void begin(const uint8_t* mac, IPAddress ip, IPAddress dns);
-  void begin(const uint8_t* mac, IPAddress ip, IPAddress dns, IPAddress gateway);
-  void begin(const uint8_t* mac, IPAddress ip, IPAddress dns, IPAddress gateway, IPAddress subnet);
+  // rxsize splits the 8K ram of the ENC28J60 between receive buffer and
+  // memory for packets to be sent: RXSIZE_TXHEAVY (default), RXSIZE_BALANCED,
+  // RXSIZE_RXHEAVY or any size between RXSIZE_MIN and RXSIZE_MAX
+  int begin(const uint8_t* mac, uint16_t rxsize = RXSIZE_TXHEAVY);
+  void begin(const uint8_t* mac, IPAddress ip, uint16_t rxsize = RXSIZE_TXHEAVY);
+  void begin(const uint8_t* mac, IPAddress ip, IPAddress dns, uint16_t rxsize = RXSIZE_TXHEAVY);
+  void begin(const uint8_t* mac, IPAddress ip, IPAddress dns, IPAddress gateway, uint16_t rxsize = RXSIZE_TXHEAVY);
+  void begin(const uint8_t* mac, IPAddress ip, IPAddress dns, IPAddress gateway, IPAddress subnet, uint16_t rxsize = RXSIZE_TXHEAVY);
 
   // maintain() must be called at regular intervals to process the incoming serial
   // data and issue IP events to the sketch.  It does not return until all IP
@@ -91,12 +107,23 @@ private:
 
   static unsigned long periodic_timer;
 
-  static void init(const uint8_t* mac);
+  static void init(const uint8_t* mac, uint16_t rxsize);
   static void configure(IPAddress ip, IPAddress dns, IPAddress gateway, IPAddress subnet);
 
   static void tick();
 
   static boolean network_send();
+  static boolean network_transmit(memhandle packet);
+
+#if UIP_MULTICAST
+  static boolean multicast_member(const uip_ipaddr_t group);
+  static void multicast_join(const uip_ipaddr_t group);
+  static void multicast_leave(const uip_ipaddr_t group);
+  static void multicast_filter();
+  static void igmp_input();
+  static void igmp_periodic(unsigned long now);
+  static void igmp_send(uint8_t type, const uip_ipaddr_t group, const uip_ipaddr_t dest);
+#endif
 
   friend class UIPServer;
 
@@ -53,6 +53,41 @@ size_t UIPServer::write(uint8_t c)
 size_t UIPServer::write(const uint8_t *buf, size_t size)
 {
   size_t ret = 0;
+#if UIP_SERVER_SHARE_MIN > 0
+  uip_userdata_t* first = NULL;
+  uint8_t clients = 0;
+  for ( uip_userdata_t* data = &UIPClient::all_data[0]; data < &UIPClient::all_data[UIP_CONNS]; data++ )
+    {
+      if ((data->state & UIP_CLIENT_CONNECTED) && uip_conns[data->state & UIP_CLIENT_SOCKETS].lport ==_port)
+        {
+          if (!first)
+            first = data;
+          clients++;
+        }
+    }
+  // written to the chip once and queued on all clients. The block is
+  // accounted to the first of them and freed with the last ack
+  if (clients > 1 && size >= UIP_SERVER_SHARE_MIN)
+    {
+      UIPEthernetClass::tick();
+      while (size)
+        {
+          size_t len = size < UIP_SOCKET_DATALEN ? size : UIP_SOCKET_DATALEN;
+          memhandle block = UIPNetwork::allocBlock(UIP_SOCKET_HEADROOM + len + UIP_SENDBUFFER_PADDING, MEMPOOL_OWNER_TCP(first - UIPClient::all_data), UIP_SOCKET_OVERHEAD);
+          if (block != NOBLOCK)
+            UIPNetwork::writePacket(block,UIP_SOCKET_HEADROOM,(uint8_t*)buf,len);
+          for ( uip_userdata_t* data = &UIPClient::all_data[0]; data < &UIPClient::all_data[UIP_CONNS]; data++ )
+            {
+              if ((data->state & UIP_CLIENT_CONNECTED) && uip_conns[data->state & UIP_CLIENT_SOCKETS].lport ==_port)
+                ret += block != NOBLOCK ? UIPClient::_writeShared(data,block,buf,len) : UIPClient::_write(data,buf,len);
+            }
+          UIPNetwork::freeBlock(block);
+          buf += len;
+          size -= len;
+        }
+      return ret;
+    }
+#endif
   for ( uip_userdata_t* data = &UIPClient::all_data[0]; data < &UIPClient::all_data[UIP_CONNS]; data++ )
     {
       if ((data->state & UIP_CLIENT_CONNECTED) && uip_conns[data->state & UIP_CLIENT_SOCKETS].lport ==_port)
@@ -37,14 +37,14 @@ extern "C" {
 
 // Constructor
 UIPUDP::UIPUDP() :
-    _uip_udp_conn(NULL)
+    _uip_udp_conn(NULL),
+    _broadcast(false)
 {
   memset(&appdata,0,sizeof(appdata));
 }
 
-// initialize, start listening on specified port. Returns 1 if successful, 0 if there are no sockets available to use
 uint8_t
-UIPUDP::begin(uint16_t port)
+UIPUDP::_bind(uint16_t port)
 {
   if (!_uip_udp_conn)
     {
@@ -54,11 +54,80 @@ UIPUDP::begin(uint16_t port)
     {
       uip_udp_bind(_uip_udp_conn,htons(port));
       _uip_udp_conn->appstate = &appdata;
+#if UIP_MULTICAST
+      // a socket bound anew is no longer member of a group joined before
+      _leave();
+#endif
       return 1;
     }
   return 0;
 }
 
+// initialize, start listening on specified port. Returns 1 if successful, 0 if there are no sockets available to use
+uint8_t
+UIPUDP::begin(uint16_t port)
+{
+  if (!_bind(port))
+    return 0;
+  if (_broadcast)
+    {
+      _broadcast = false;
+      UIPNetwork::disableBroadcast();
+    }
+  return 1;
+}
+
+// like begin(), but also accept broadcasts (e.g. DHCP) until stop() or the
+// next begin(). Returns 1 if successful, 0 if there are no sockets available
+uint8_t
+UIPUDP::beginBroadcast(uint16_t port)
+{
+  if (!_bind(port))
+    return 0;
+  if (!_broadcast)
+    {
+      _broadcast = true;
+      UIPNetwork::enableBroadcast();
+    }
+  return 1;
+}
+
+#if UIP_MULTICAST
+// join multicast group and start listening on specified port. Broadcasts
+// are not enabled for this socket.
+uint8_t
+UIPUDP::beginMulticast(IPAddress ip, uint16_t port)
+{
+  uip_ipaddr_t group;
+  uip_ip_addr(group, ip);
+  if (!uip_ipaddr_ismulticast(group) || !_bind(port))
+    return 0;
+  if (_broadcast)
+    {
+      _broadcast = false;
+      UIPNetwork::disableBroadcast();
+    }
+  uip_ipaddr_copy(appdata.group, group);
+  appdata.reports = UIP_IGMP_REPORTS - 1;
+  appdata.report_timer = millis() + UIP_IGMP_REPORT_INTERVAL;
+  UIPEthernetClass::multicast_join(group);
+  return 1;
+}
+
+void
+UIPUDP::_leave()
+{
+  if (appdata.group[0] || appdata.group[1])
+    {
+      uip_ipaddr_t group;
+      uip_ipaddr_copy(group, appdata.group);
+      appdata.group[0] = appdata.group[1] = 0;
+      appdata.reports = 0;
+      UIPEthernetClass::multicast_leave(group);
+    }
+}
+#endif
+
 // Finish with the UDP socket
 void
 UIPUDP::stop()
@@ -68,9 +137,17 @@ UIPUDP::stop()
       uip_udp_remove(_uip_udp_conn);
       _uip_udp_conn->appstate = NULL;
       _uip_udp_conn=NULL;
-      Enc28J60Network::freeBlock(appdata.packet_in);
-      Enc28J60Network::freeBlock(appdata.packet_next);
-      Enc28J60Network::freeBlock(appdata.packet_out);
+      if (_broadcast)
+        {
+          _broadcast = false;
+          UIPNetwork::disableBroadcast();
+        }
+#if UIP_MULTICAST
+      _leave();
+#endif
+      UIPNetwork::freeBlock(appdata.packet_in);
+      UIPNetwork::freeBlock(appdata.packet_next);
+      UIPNetwork::freeBlock(appdata.packet_out);
       memset(&appdata,0,sizeof(appdata));
     }
 }
@@ -81,6 +158,14 @@ UIPUDP::stop()
 // Returns 1 if successful, 0 if there was a problem with the supplied IP address or port
 int
 UIPUDP::beginPacket(IPAddress ip, uint16_t port)
+{
+  return beginPacket(ip, port, 0);
+}
+
+// As above, but allocating for size bytes of payload to begin with
+// (UIP_UDP_PACKETSIZE if 0). write() grows the packet as needed
+int
+UIPUDP::beginPacket(IPAddress ip, uint16_t port, uint16_t size)
 {
   UIPEthernetClass::tick();
   if (ip && port)
@@ -124,7 +209,13 @@ UIPUDP::beginPacket(IPAddress ip, uint16_t port)
     {
       if (appdata.packet_out == NOBLOCK)
         {
-          appdata.packet_out = Enc28J60Network::allocBlock(UIP_UDP_MAXPACKETSIZE + UIP_SENDBUFFER_OFFSET + UIP_SENDBUFFER_PADDING);
+          if (!size)
+            size = UIP_UDP_PACKETSIZE;
+          else if (size > UIP_UDP_MAXDATALEN)
+            size = UIP_UDP_MAXDATALEN;
+          // may be split up where the pool is fragmented, the driver
+          // makes it one piece when it is sent
+          appdata.packet_out = UIPNetwork::allocChain(size + UIP_UDP_OVERHEAD, MEMPOOL_OWNER_UDP(_uip_udp_conn - uip_udp_conns), UIP_UDP_OVERHEAD);
           appdata.out_pos = UIP_UDP_PHYH_LEN + UIP_SENDBUFFER_OFFSET;
           if (appdata.packet_out != NOBLOCK)
             return 1;
@@ -168,13 +259,10 @@ UIPUDP::endPacket()
   if (_uip_udp_conn && appdata.packet_out != NOBLOCK)
     {
       appdata.send = true;
-      Enc28J60Network::resizeBlock(appdata.packet_out,0,appdata.out_pos + UIP_SENDBUFFER_PADDING);
+      UIPNetwork::resizeBlock(appdata.packet_out,0,appdata.out_pos + UIP_SENDBUFFER_PADDING);
       uip_udp_periodic_conn(_uip_udp_conn);
       if (uip_len > 0)
-        {
-          _send(&appdata);
-          return 1;
-        }
+        return _send(&appdata) ? 1 : 0;
     }
   return 0;
 }
@@ -192,7 +280,29 @@ UIPUDP::write(const uint8_t *buffer, size_t size)
 {
   if (appdata.packet_out != NOBLOCK)
     {
-      size_t ret = Enc28J60Network::writePacket(appdata.packet_out,appdata.out_pos,(uint8_t*)buffer,size);
+      memaddress room = UIPNetwork::blockSize(appdata.packet_out) - UIP_SENDBUFFER_PADDING - appdata.out_pos;
+      if (size > room)
+        {
+          memaddress max = UIP_UDP_MAXPACKETSIZE + UIP_SENDBUFFER_OFFSET + UIP_SENDBUFFER_PADDING;
+          memaddress need = max;
+          if (size < (size_t)(max - UIP_SENDBUFFER_PADDING - appdata.out_pos))
+            need = appdata.out_pos + UIP_SENDBUFFER_PADDING + size;
+          // at least double the packet, so print() doesn't grow it byte by byte
+          memaddress grow = UIPNetwork::blockSize(appdata.packet_out) * 2;
+          if (grow > max)
+            grow = max;
+          if (grow < need)
+            grow = need;
+          memhandle grown = UIPNetwork::growBlock(appdata.packet_out, grow);
+          if (grown == NOBLOCK && grow > need)
+            grown = UIPNetwork::growBlock(appdata.packet_out, need);
+          if (grown != NOBLOCK)
+            appdata.packet_out = grown;
+          room = UIPNetwork::blockSize(appdata.packet_out) - UIP_SENDBUFFER_PADDING - appdata.out_pos;
+          if (size > room)
+            size = room;
+        }
+      size_t ret = UIPNetwork::writePacket(appdata.packet_out,appdata.out_pos,(uint8_t*)buffer,size);
       appdata.out_pos += ret;
       return ret;
     }
@@ -212,7 +322,7 @@ UIPUDP::parsePacket()
       Serial.println(appdata.packet_in);
     }
 #endif
-  Enc28J60Network::freeBlock(appdata.packet_in);
+  UIPNetwork::freeBlock(appdata.packet_in);
 
   appdata.packet_in = appdata.packet_next;
   appdata.packet_next = NOBLOCK;
@@ -224,7 +334,7 @@ UIPUDP::parsePacket()
       Serial.print(appdata.packet_in);
     }
 #endif
-  int size = Enc28J60Network::blockSize(appdata.packet_in);
+  int size = UIPNetwork::blockSize(appdata.packet_in);
 #ifdef UIPETHERNET_DEBUG_UDP
   if (appdata.packet_in != NOBLOCK)
     {
@@ -240,7 +350,7 @@ int
 UIPUDP::available()
 {
   UIPEthernetClass::tick();
-  return Enc28J60Network::blockSize(appdata.packet_in);
+  return UIPNetwork::blockSize(appdata.packet_in);
 }
 
 // Read a single byte from the current packet
@@ -263,14 +373,14 @@ UIPUDP::read(unsigned char* buffer, size_t len)
   UIPEthernetClass::tick();
   if (appdata.packet_in != NOBLOCK)
     {
-      memaddress read = Enc28J60Network::readPacket(appdata.packet_in,0,buffer,len);
-      if (read == Enc28J60Network::blockSize(appdata.packet_in))
+      memaddress read = UIPNetwork::readPacket(appdata.packet_in,0,buffer,len);
+      if (read == UIPNetwork::blockSize(appdata.packet_in))
         {
-          Enc28J60Network::freeBlock(appdata.packet_in);
+          UIPNetwork::freeBlock(appdata.packet_in);
           appdata.packet_in = NOBLOCK;
         }
       else
-        Enc28J60Network::resizeBlock(appdata.packet_in,read);
+        UIPNetwork::resizeBlock(appdata.packet_in,read);
       return read;
     }
   return 0;
@@ -284,7 +394,7 @@ UIPUDP::peek()
   if (appdata.packet_in != NOBLOCK)
     {
       unsigned char c;
-      if (Enc28J60Network::readPacket(appdata.packet_in,0,&c,1) == 1)
+      if (UIPNetwork::readPacket(appdata.packet_in,0,&c,1) == 1)
         return c;
     }
   return -1;
@@ -295,7 +405,7 @@ void
 UIPUDP::flush()
 {
   UIPEthernetClass::tick();
-  Enc28J60Network::freeBlock(appdata.packet_in);
+  UIPNetwork::freeBlock(appdata.packet_in);
   appdata.packet_in = NOBLOCK;
 }
 
@@ -313,6 +423,18 @@ UIPUDP::remotePort()
   return _uip_udp_conn ? ntohs(_uip_udp_conn->rport) : 0;
 }
 
+#if UIP_MULTICAST
+// uIP demultiplexing: datagrams to a group only go to sockets that joined it
+int
+uipudp_accept(struct uip_udp_conn *conn)
+{
+  if (!uip_ipaddr_ismulticast(UDPBUF->destipaddr))
+    return 1;
+  uip_udp_userdata_t *data = (uip_udp_userdata_t *)conn->appstate;
+  return data && uip_ipaddr_cmp(data->group, UDPBUF->destipaddr);
+}
+#endif
+
 // uIP callback function
 
 void
@@ -325,17 +447,17 @@ uipudp_appcall(void) {
             {
               uip_udp_conn->rport = UDPBUF->srcport;
               uip_ipaddr_copy(uip_udp_conn->ripaddr,UDPBUF->srcipaddr);
-              data->packet_next = Enc28J60Network::allocBlock(ntohs(UDPBUF->udplen)-UIP_UDPH_LEN);
+              data->packet_next = UIPNetwork::allocBlock(ntohs(UDPBUF->udplen)-UIP_UDPH_LEN, MEMPOOL_OWNER_UDP(uip_udp_conn - uip_udp_conns));
                   //if we are unable to allocate memory the packet is dropped. udp doesn't guarantee packet delivery
               if (data->packet_next != NOBLOCK)
                 {
                   //discard Linklevel and IP and udp-header and any trailing bytes:
-                  Enc28J60Network::copyPacket(data->packet_next,0,UIPEthernetClass::in_packet,UIP_UDP_PHYH_LEN,Enc28J60Network::blockSize(data->packet_next));
+                  UIPNetwork::copyPacket(data->packet_next,0,UIPEthernetClass::in_packet,UIP_UDP_PHYH_LEN,UIPNetwork::blockSize(data->packet_next));
     #ifdef UIPETHERNET_DEBUG_UDP
                   Serial.print(F("udp, uip_newdata received packet: "));
                   Serial.print(data->packet_next);
                   Serial.print(F(", size: "));
-                  Serial.println(Enc28J60Network::blockSize(data->packet_next));
+                  Serial.println(UIPNetwork::blockSize(data->packet_next));
     #endif
                 }
             }
@@ -347,7 +469,7 @@ uipudp_appcall(void) {
           Serial.print(F("udp, uip_poll preparing packet to send: "));
           Serial.print(data->packet_out);
           Serial.print(F(", size: "));
-          Serial.println(Enc28J60Network::blockSize(data->packet_out));
+          Serial.println(UIPNetwork::blockSize(data->packet_out));
 #endif
           UIPEthernetClass::uip_packet = data->packet_out;
           UIPEthernetClass::packetstate |= UIPETHERNET_SENDPACKET;
@@ -357,7 +479,9 @@ uipudp_appcall(void) {
     }
 }
 
-void
+// false if the datagram was dropped. A datagram waiting for arp is kept
+// and sent from the periodic timer.
+boolean
 UIPUDP::_send(uip_udp_userdata_t *data) {
   uip_arp_out(); //add arp
   if (uip_len == UIP_ARPHDRSIZE)
@@ -368,6 +492,7 @@ UIPUDP::_send(uip_udp_userdata_t *data) {
       Serial.println(F("udp, uip_poll results in ARP-packet"));
 #endif
       UIPEthernetClass::network_send();
+      return true;
     }
   else
   //arp found ethaddr for ip (otherwise packet is replaced by arp-request)
@@ -376,11 +501,13 @@ UIPUDP::_send(uip_udp_userdata_t *data) {
       Serial.print(F("udp, uip_packet to send: "));
       Serial.println(UIPEthernetClass::uip_packet);
 #endif
-      if (UIPEthernetClass::network_send())
-        {
-          data->send = false;
-          data->packet_out = NOBLOCK;
-        }
+      // network_send() hands the packet to the driver or frees it if the
+      // driver can't take it (e.g. no room to linearize), either way it's
+      // not the sockets anymore
+      boolean sent = UIPEthernetClass::network_send();
+      data->send = false;
+      data->packet_out = NOBLOCK;
+      return sent;
     }
 }
 #endif
@@ -31,6 +31,8 @@ extern "C" {
 #define UIP_UDP_MAXDATALEN 1500
 #define UIP_UDP_PHYH_LEN UIP_LLH_LEN+UIP_IPUDPH_LEN
 #define UIP_UDP_MAXPACKETSIZE UIP_UDP_MAXDATALEN+UIP_UDP_PHYH_LEN
+// the part of an outgoing packet that doesn't count against the UDP quota
+#define UIP_UDP_OVERHEAD (UIP_UDP_PHYH_LEN+UIP_SENDBUFFER_OFFSET+UIP_SENDBUFFER_PADDING)
 
 typedef struct {
   memaddress out_pos;
@@ -38,6 +40,11 @@ typedef struct {
   memhandle packet_in;
   memhandle packet_out;
   boolean send;
+#if UIP_MULTICAST
+  uip_ipaddr_t group;
+  uint8_t reports;              // reports still to send, unsolicited ones or a query's answer
+  unsigned long report_timer;
+#endif
 } uip_udp_userdata_t;
 
 class UIPUDP : public UDP
@@ -45,13 +52,25 @@ class UIPUDP : public UDP
 
 private:
   struct uip_udp_conn *_uip_udp_conn;
+  boolean _broadcast;
 
   uip_udp_userdata_t appdata;
 
+  uint8_t _bind(uint16_t);
+#if UIP_MULTICAST
+  void _leave();
+#endif
+
 public:
   UIPUDP();  // Constructor
   uint8_t
-  begin(uint16_t);// initialize, start listening on specified port. Returns 1 if successful, 0 if there are no sockets available to use
+  begin(uint16_t);// initialize, start listening on specified port (broadcasts are not received, see beginBroadcast). Returns 1 if successful, 0 if there are no sockets available to use
+  uint8_t
+  beginBroadcast(uint16_t);// as begin(), but also receive broadcasts until stop(). Returns 1 if successful, 0 if there are no sockets available to use
+#if UIP_MULTICAST
+  uint8_t
+  beginMulticast(IPAddress, uint16_t);// join multicast group and start listening on specified port. Returns 1 if successful, 0 if there are no sockets available to use
+#endif
   void
   stop();  // Finish with the UDP socket
 
@@ -61,6 +80,10 @@ public:
   // Returns 1 if successful, 0 if there was a problem with the supplied IP address or port
   int
   beginPacket(IPAddress ip, uint16_t port);
+  // As above, but size is the expected number of bytes of payload. The
+  // packet grows if more is written, 0 allocates UIP_UDP_PACKETSIZE bytes
+  int
+  beginPacket(IPAddress ip, uint16_t port, uint16_t size);
   // Start building up a packet to send to the remote host specific in host and port
   // Returns 1 if successful, 0 if there was a problem resolving the hostname or port
   int
@@ -119,7 +142,7 @@ private:
   friend void uipudp_appcall(void);
 
   friend class UIPEthernetClass;
-  static void _send(uip_udp_userdata_t *data);
+  static boolean _send(uip_udp_userdata_t *data);
 
 };
 
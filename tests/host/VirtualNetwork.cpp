@@ -0,0 +1,333 @@
+/*
+ VirtualNetwork.cpp - UIPEthernet network driver without hardware.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "VirtualNetwork.h"
+
+extern "C" {
+#include "enc28j60.h"
+}
+
+uint8_t VirtualNetwork::mem[VIRTUALNETWORK_MEMSIZE];
+uint8_t VirtualNetwork::macaddr[6];
+uint16_t VirtualNetwork::rxSize = RXSIZE_TXHEAVY;
+uint16_t VirtualNetwork::rxQueued;
+std::deque<std::vector<uint8_t> > VirtualNetwork::rxQueue;
+struct memblock VirtualNetwork::receivePkt;
+uint8_t VirtualNetwork::rxFilter = UIP_RECEIVEFILTER_DEFAULT;
+uint8_t VirtualNetwork::broadcastRefs;
+uint8_t VirtualNetwork::hashTable[8];
+uint16_t VirtualNetwork::patternOffset;
+uint8_t VirtualNetwork::pattern[64];
+uint8_t VirtualNetwork::patternMask[8];
+std::function<void(const uint8_t* frame, uint16_t len)> VirtualNetwork::onTransmit;
+struct virtual_network_stats VirtualNetwork::stats;
+
+void
+VirtualNetwork::init(uint8_t* mac, uint16_t rxsize)
+{
+  if (rxsize < RXSIZE_MIN)
+    rxsize = RXSIZE_MIN;
+  if (rxsize > RXSIZE_MAX)
+    rxsize = RXSIZE_MAX;
+  rxSize = rxsize;
+  // the received frame is copied to the start of the memory, the pool
+  // follows as on the ENC28J60
+  MemoryPool::init(rxSize + 1, TXSTOP_INIT - rxSize);
+  memcpy(macaddr, mac, 6);
+  rxQueue.clear();
+  rxQueued = 0;
+  receivePkt.size = 0;
+  broadcastRefs = 0;
+  rxFilter = UIP_RECEIVEFILTER_DEFAULT;
+  memset(hashTable, 0, sizeof(hashTable));
+  // ARP broadcasts, see Enc28J60Network::init()
+  static const uint8_t arp[64] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0, 0, 0, 0, 0, 0, 0x08, 0x06 };
+  static const uint8_t arpmask[8] = { 0x3f, 0x30 };
+  setPatternFilter(0, arp, arpmask);
+}
+
+bool
+VirtualNetwork::deliver(const uint8_t* frame, uint16_t len)
+{
+  if (!accept(frame, len))
+    {
+      stats.rxFiltered++;
+      return false;
+    }
+  // frames are stored with the 6 byte header and the FCS the chip adds
+  uint16_t needed = len + 10;
+  if (len > rxSize || rxQueued + needed > rxSize)
+    {
+      stats.rxOverflows++;
+      return false;
+    }
+  rxQueue.push_back(std::vector<uint8_t>(frame, frame + len));
+  rxQueued += needed;
+  return true;
+}
+
+bool
+VirtualNetwork::accept(const uint8_t* frame, uint16_t len)
+{
+  uint8_t filter = rxFilter | (broadcastRefs ? ERXFCON_BCEN : 0);
+  // all filters disabled: promiscuous
+  if (!(filter & (ERXFCON_UCEN|ERXFCON_PMEN|ERXFCON_HTEN|ERXFCON_MCEN|ERXFCON_BCEN)))
+    return true;
+  static const uint8_t broadcast[6] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+  bool isbroadcast = memcmp(frame, broadcast, 6) == 0;
+  if (filter & ERXFCON_UCEN && memcmp(frame, macaddr, 6) == 0)
+    return true;
+  if (filter & ERXFCON_BCEN && isbroadcast)
+    return true;
+  if (filter & ERXFCON_MCEN && (frame[0] & 1) && !isbroadcast)
+    return true;
+  if (filter & ERXFCON_HTEN)
+    {
+      uint8_t bit = hashFilterBit(frame);
+      if (hashTable[bit >> 3] & (1 << (bit & 7)))
+        return true;
+    }
+  // the pattern window may cover the 4 byte FCS (which is never matched)
+  if (filter & ERXFCON_PMEN && patternOffset + 64 <= len + 4)
+    {
+      for (uint8_t i = 0; i < 64; i++)
+        if (patternMask[i >> 3] & (1 << (i & 7))
+            && (patternOffset + i >= len || frame[patternOffset + i] != pattern[i]))
+          return false;
+      return true;
+    }
+  return false;
+}
+
+memhandle
+VirtualNetwork::receivePacket()
+{
+  if (rxQueue.empty())
+    return NOBLOCK;
+  std::vector<uint8_t>& frame = rxQueue.front();
+  memcpy(mem, frame.data(), frame.size());
+  receivePkt.begin = 0;
+  receivePkt.size = frame.size();
+  stats.rxFrames++;
+  stats.rxBytes += frame.size();
+  return UIP_RECEIVEBUFFERHANDLE;
+}
+
+void
+VirtualNetwork::freePacket()
+{
+  if (rxQueue.empty())
+    return;
+  rxQueued -= rxQueue.front().size() + 10;
+  rxQueue.pop_front();
+  receivePkt.size = 0;
+}
+
+memblock*
+VirtualNetwork::block(memhandle handle)
+{
+  return handle == UIP_RECEIVEBUFFERHANDLE ? &receivePkt : &blocks[handle];
+}
+
+uint8_t*
+VirtualNetwork::blockAddress(memhandle handle, memaddress position)
+{
+  return &mem[block(handle)->begin + position];
+}
+
+memaddress
+VirtualNetwork::blockSize(memhandle handle)
+{
+  return handle == NOBLOCK ? 0 : handle == UIP_RECEIVEBUFFERHANDLE ? receivePkt.size : MemoryPool::blockSize(handle);
+}
+
+bool
+VirtualNetwork::sendPacket(memhandle handle)
+{
+  if (handle == NOBLOCK)
+    return false;
+  handle = linearize(handle);
+  if (handle == NOBLOCK)
+    return false;
+  uint16_t len = blocks[handle].size - (UIP_SENDBUFFER_OFFSET + UIP_SENDBUFFER_PADDING);
+  stats.txFrames++;
+  stats.txBytes += len;
+  if (onTransmit)
+    {
+      // padded to the minimum size as the ENC28J60 does (MACON3.PADCFG)
+      uint8_t frame[60] = { 0 };
+      if (len < sizeof(frame))
+        {
+          memcpy(frame, blockAddress(handle, UIP_SENDBUFFER_OFFSET), len);
+          onTransmit(frame, sizeof(frame));
+        }
+      else
+        onTransmit(blockAddress(handle, UIP_SENDBUFFER_OFFSET), len);
+    }
+  freeBlock(handle);
+  return true;
+}
+
+uint16_t
+VirtualNetwork::readPacket(memhandle handle, memaddress position, uint8_t* buffer, uint16_t len)
+{
+  uint16_t read = 0;
+  for (handle = extent(handle, position); handle != NOBLOCK && read < len; handle = nextExtent(handle), position = 0)
+    {
+      uint16_t n = len - read;
+      if (n > block(handle)->size - position)
+        n = block(handle)->size - position;
+      memcpy(buffer + read, blockAddress(handle, position), n);
+      read += n;
+    }
+  return read;
+}
+
+uint16_t
+VirtualNetwork::writePacket(memhandle handle, memaddress position, uint8_t* buffer, uint16_t len)
+{
+  uint16_t written = 0;
+  for (handle = extent(handle, position); handle != NOBLOCK && written < len; handle = nextExtent(handle), position = 0)
+    {
+      uint16_t n = len - written;
+      if (n > blocks[handle].size - position)
+        n = blocks[handle].size - position;
+      memcpy(blockAddress(handle, position), buffer + written, n);
+      written += n;
+    }
+  return written;
+}
+
+void
+VirtualNetwork::copyPacket(memhandle dest, memaddress dest_pos, memhandle src, memaddress src_pos, uint16_t len)
+{
+  while (len)
+    {
+      dest = extent(dest, dest_pos);
+      src = extent(src, src_pos);
+      uint16_t n = len;
+      if (n > block(dest)->size - dest_pos)
+        n = block(dest)->size - dest_pos;
+      if (n > block(src)->size - src_pos)
+        n = block(src)->size - src_pos;
+      if (!n)
+        break;
+      memmove(blockAddress(dest, dest_pos), blockAddress(src, src_pos), n);
+      dest_pos += n;
+      src_pos += n;
+      len -= n;
+    }
+}
+
+uint16_t
+VirtualNetwork::chksum(uint16_t sum, memhandle handle, memaddress pos, uint16_t len)
+{
+  // a chained block is summed extent by extent, continuing an odd
+  // number of bytes into the next one
+  bool odd = false;
+  uint16_t t;
+  for (handle = extent(handle, pos); handle != NOBLOCK && len; handle = nextExtent(handle), pos = 0)
+    {
+      uint16_t n = len;
+      if (n > block(handle)->size - pos)
+        n = block(handle)->size - pos;
+      const uint8_t* data = blockAddress(handle, pos);
+      for (uint16_t i = 0; i < n; i++, odd = !odd)
+        {
+          t = odd ? data[i] : data[i] << 8;
+          sum += t;
+          if (sum < t)
+            sum++;
+        }
+      len -= n;
+    }
+  return sum;
+}
+
+void
+VirtualNetwork::setReceiveFilter(uint8_t erxfcon)
+{
+  rxFilter = erxfcon;
+}
+
+uint8_t
+VirtualNetwork::receiveFilter()
+{
+  return rxFilter;
+}
+
+void
+VirtualNetwork::enableBroadcast()
+{
+  broadcastRefs++;
+}
+
+void
+VirtualNetwork::disableBroadcast()
+{
+  if (broadcastRefs)
+    broadcastRefs--;
+}
+
+void
+VirtualNetwork::setPatternFilter(uint16_t offset, const uint8_t* p, const uint8_t* mask)
+{
+  patternOffset = offset;
+  memcpy(pattern, p, sizeof(pattern));
+  memcpy(patternMask, mask, sizeof(patternMask));
+}
+
+void
+VirtualNetwork::setHashFilter(const uint8_t* table)
+{
+  memcpy(hashTable, table, sizeof(hashTable));
+}
+
+void
+VirtualNetwork::addHashFilter(const uint8_t* mac)
+{
+  uint8_t bit = hashFilterBit(mac);
+  hashTable[bit >> 3] |= 1 << (bit & 7);
+}
+
+uint8_t
+VirtualNetwork::hashFilterBit(const uint8_t* mac)
+{
+  // as Enc28J60Network::hashFilterBit()
+  uint32_t crc = 0xFFFFFFFF;
+  for (uint8_t i = 0; i < 6; i++)
+    {
+      uint8_t b = mac[i];
+      for (uint8_t j = 0; j < 8; j++)
+        {
+          bool next = ((crc >> 31) ^ b) & 1;
+          crc <<= 1;
+          if (next)
+            crc ^= 0x04C11DB7;
+          b >>= 1;
+        }
+    }
+  return (crc >> 23) & 0x3F;
+}
+
+void
+mempool_block_move_callback(memaddress dest, memaddress src, memaddress len)
+{
+  memmove(&VirtualNetwork::mem[dest], &VirtualNetwork::mem[src], len);
+}
@@ -0,0 +1,110 @@
+/*
+ VirtualNetwork.h - UIPEthernet network driver without hardware.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VIRTUALNETWORK_H
+#define VIRTUALNETWORK_H
+
+#include <deque>
+#include <functional>
+#include <vector>
+
+#include "mempool.h"
+
+// same contract as Enc28J60Network (see UIPNetwork.h)
+#define UIP_RECEIVEBUFFERHANDLE 0xff
+#define UIP_RECEIVEFILTER_DEFAULT (ERXFCON_UCEN|ERXFCON_CRCEN|ERXFCON_PMEN)
+#define UIP_SENDBUFFER_PADDING 7
+#define UIP_SENDBUFFER_OFFSET 1
+
+#define VIRTUALNETWORK_MEMSIZE 0x2000
+
+struct virtual_network_stats
+{
+  unsigned long rxFrames;
+  unsigned long rxBytes;
+  unsigned long rxFiltered;       // frames the receive filter didn't accept
+  unsigned long rxOverflows;      // frames dropped because the receivebuffer was full
+  unsigned long txFrames;
+  unsigned long txBytes;
+};
+
+/*
+ * Network driver for host builds that keeps the 8K buffer memory in RAM
+ * and hands frames to and from code in the same process. The memory is
+ * split like the ENC28J60s (rxsize bytes of frames may be waiting to be
+ * received, the rest is the MemoryPool) and the receive filter works on
+ * the same ERXFCON_* flags, so the stack behaves the same on either.
+ *
+ * Build the library with UIP_NETWORK=VirtualNetwork and
+ * UIP_NETWORK_HEADER="VirtualNetwork.h" to use it. Sent frames go to
+ * onTransmit, received ones are passed to deliver(). Everything happens
+ * instantly, the clock is left to the caller.
+ */
+class VirtualNetwork : public MemoryPool
+{
+private:
+  static uint8_t mem[VIRTUALNETWORK_MEMSIZE];
+  static uint8_t macaddr[6];
+  static uint16_t rxSize;
+  static uint16_t rxQueued;
+  static std::deque<std::vector<uint8_t> > rxQueue;
+  static struct memblock receivePkt;
+
+  static uint8_t rxFilter;
+  static uint8_t broadcastRefs;
+  static uint8_t hashTable[8];
+  static uint16_t patternOffset;
+  static uint8_t pattern[64];
+  static uint8_t patternMask[8];
+
+  static uint8_t* blockAddress(memhandle handle, memaddress position);
+  static memblock* block(memhandle handle);
+  static bool accept(const uint8_t* frame, uint16_t len);
+
+  friend void mempool_block_move_callback(memaddress,memaddress,memaddress);
+
+public:
+  static void init(uint8_t* macaddr, uint16_t rxsize = RXSIZE_TXHEAVY);
+  static memhandle receivePacket();
+  static void freePacket();
+  static memaddress blockSize(memhandle handle);
+  static bool sendPacket(memhandle handle);
+  static void pollTransmit() {}
+  static bool pollDma() { return true; }
+  static void waitDma() {}
+  static void setReceiveFilter(uint8_t erxfcon);
+  static uint8_t receiveFilter();
+  static void enableBroadcast();
+  static void disableBroadcast();
+  static void setPatternFilter(uint16_t offset, const uint8_t* pattern, const uint8_t* mask);
+  static void setHashFilter(const uint8_t* table);
+  static void addHashFilter(const uint8_t* macaddr);
+  static uint8_t hashFilterBit(const uint8_t* macaddr);
+  static uint16_t readPacket(memhandle handle, memaddress position, uint8_t* buffer, uint16_t len);
+  static uint16_t writePacket(memhandle handle, memaddress position, uint8_t* buffer, uint16_t len);
+  static void copyPacket(memhandle dest, memaddress dest_pos, memhandle src, memaddress src_pos, uint16_t len);
+  static uint16_t chksum(uint16_t sum, memhandle handle, memaddress pos, uint16_t len);
+
+  // a frame from the wire (without FCS). Returns false if it was filtered
+  // or there was no room in the receivebuffer
+  static bool deliver(const uint8_t* frame, uint16_t len);
+  // called for every frame sent (without FCS)
+  static std::function<void(const uint8_t* frame, uint16_t len)> onTransmit;
+  static struct virtual_network_stats stats;
+};
+
+#endif
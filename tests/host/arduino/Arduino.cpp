@@ -0,0 +1,180 @@
+/*
+ Arduino.cpp - minimal Arduino core for building UIPEthernet on a host.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Arduino.h"
+#include "host_hw.h"
+#include <avr/io.h>
+
+#define HOST_PINS 32
+
+volatile uint8_t SPSR = 1<<SPIF;
+volatile uint8_t SPCR;
+host_spi_data SPDR;
+
+uint8_t (*host_spi_transfer)(uint8_t data);
+void (*host_pin_write)(uint8_t pin, uint8_t val);
+void (*host_poll)(void);
+
+static unsigned long long host_micros;
+static uint8_t host_pin_state[HOST_PINS];
+static void (*host_interrupt[HOST_PINS])(void);
+
+host_spi_data&
+host_spi_data::operator=(uint8_t data)
+{
+  received = host_spi_transfer ? host_spi_transfer(data) : 0xFF;
+  return *this;
+}
+
+host_spi_data::operator uint8_t() const
+{
+  return received;
+}
+
+void
+host_advance_micros(unsigned long us)
+{
+  host_micros += us;
+}
+
+unsigned long long
+host_clock(void)
+{
+  return host_micros;
+}
+
+void
+host_raise_interrupt(uint8_t pin)
+{
+  if (pin < HOST_PINS && host_interrupt[pin])
+    host_interrupt[pin]();
+}
+
+void
+pinMode(uint8_t pin, uint8_t mode)
+{
+  (void)pin;
+  (void)mode;
+}
+
+void
+digitalWrite(uint8_t pin, uint8_t val)
+{
+  if (pin < HOST_PINS)
+    host_pin_state[pin] = val;
+  if (host_pin_write)
+    host_pin_write(pin, val);
+}
+
+int
+digitalRead(uint8_t pin)
+{
+  return pin < HOST_PINS ? host_pin_state[pin] : LOW;
+}
+
+static void
+host_run_poll(void)
+{
+  static bool polling;
+  if (host_poll && !polling)
+    {
+      polling = true;
+      host_poll();
+      polling = false;
+    }
+}
+
+unsigned long
+millis(void)
+{
+  host_run_poll();
+  return (unsigned long)(host_micros / 1000);
+}
+
+unsigned long
+micros(void)
+{
+  host_run_poll();
+  return (unsigned long)host_micros;
+}
+
+void
+delay(unsigned long ms)
+{
+  host_micros += (unsigned long long)ms * 1000;
+}
+
+void
+delayMicroseconds(unsigned int us)
+{
+  host_micros += us;
+}
+
+int
+digitalPinToInterrupt(uint8_t pin)
+{
+  // interrupts are numbered by pin
+  return pin;
+}
+
+void
+attachInterrupt(uint8_t interrupt, void (*handler)(void), int mode)
+{
+  (void)mode;
+  if (interrupt < HOST_PINS)
+    host_interrupt[interrupt] = handler;
+}
+
+void
+detachInterrupt(uint8_t interrupt)
+{
+  if (interrupt < HOST_PINS)
+    host_interrupt[interrupt] = NULL;
+}
+
+void
+interrupts(void)
+{
+}
+
+void
+noInterrupts(void)
+{
+}
+
+long
+random(long howbig)
+{
+  if (howbig == 0)
+    return 0;
+  return ::random() % howbig;
+}
+
+long
+random(long howsmall, long howbig)
+{
+  if (howsmall >= howbig)
+    return howsmall;
+  return random(howbig - howsmall) + howsmall;
+}
+
+void
+randomSeed(unsigned long seed)
+{
+  if (seed != 0)
+    srandom(seed);
+}
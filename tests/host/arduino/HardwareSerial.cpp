@@ -0,0 +1,39 @@
+/*
+ HardwareSerial.cpp - Serial on stdin/stdout, host version.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include "HardwareSerial.h"
+
+HardwareSerial Serial;
+
+void
+HardwareSerial::flush()
+{
+  fflush(stdout);
+}
+
+size_t
+HardwareSerial::write(uint8_t c)
+{
+  return putchar(c) == EOF ? 0 : 1;
+}
+
+size_t
+HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+  return fwrite(buffer, 1, size, stdout);
+}
@@ -0,0 +1,89 @@
+/*
+ IPAddress.cpp - IPv4 address class, host version.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "IPAddress.h"
+#include "Print.h"
+
+IPAddress::IPAddress()
+{
+  memset(_address, 0, sizeof(_address));
+}
+
+IPAddress::IPAddress(uint8_t first_octet, uint8_t second_octet, uint8_t third_octet, uint8_t fourth_octet)
+{
+  _address[0] = first_octet;
+  _address[1] = second_octet;
+  _address[2] = third_octet;
+  _address[3] = fourth_octet;
+}
+
+IPAddress::IPAddress(uint32_t address)
+{
+  memcpy(_address, &address, sizeof(_address));
+}
+
+IPAddress::IPAddress(const uint8_t *address)
+{
+  memcpy(_address, address, sizeof(_address));
+}
+
+IPAddress::operator uint32_t() const
+{
+  uint32_t address;
+  memcpy(&address, _address, sizeof(address));
+  return address;
+}
+
+bool
+IPAddress::operator==(const IPAddress& addr) const
+{
+  return memcmp(_address, addr._address, sizeof(_address)) == 0;
+}
+
+bool
+IPAddress::operator==(const uint8_t* addr) const
+{
+  return memcmp(_address, addr, sizeof(_address)) == 0;
+}
+
+IPAddress&
+IPAddress::operator=(const uint8_t *address)
+{
+  memcpy(_address, address, sizeof(_address));
+  return *this;
+}
+
+IPAddress&
+IPAddress::operator=(uint32_t address)
+{
+  memcpy(_address, &address, sizeof(_address));
+  return *this;
+}
+
+size_t
+IPAddress::printTo(Print& p) const
+{
+  size_t n = 0;
+  for (int i = 0; i < 3; i++)
+    {
+      n += p.print(_address[i], DEC);
+      n += p.print('.');
+    }
+  n += p.print(_address[3], DEC);
+  return n;
+}
@@ -0,0 +1,54 @@
+/*
+ IPAddress.h - IPv4 address class, host version.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IPADDRESS_H
+#define IPADDRESS_H
+
+#include <stdint.h>
+#include "Printable.h"
+
+class IPAddress : public Printable
+{
+private:
+  uint8_t _address[4];
+
+public:
+  IPAddress();
+  IPAddress(uint8_t first_octet, uint8_t second_octet, uint8_t third_octet, uint8_t fourth_octet);
+  IPAddress(uint32_t address);
+  IPAddress(const uint8_t *address);
+
+  // the address in memory order, as the Arduino core does
+  operator uint32_t() const;
+  bool operator==(const IPAddress& addr) const;
+  bool operator==(const uint8_t* addr) const;
+
+  uint8_t operator[](int index) const { return _address[index]; }
+  uint8_t& operator[](int index) { return _address[index]; }
+
+  IPAddress& operator=(const uint8_t *address);
+  IPAddress& operator=(uint32_t address);
+
+  // private with friends on the Arduino core, public here for the shims
+  uint8_t* raw_address() { return _address; }
+
+  virtual size_t printTo(Print& p) const;
+};
+
+const IPAddress INADDR_NONE(0,0,0,0);
+
+#endif
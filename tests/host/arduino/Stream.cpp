@@ -0,0 +1,50 @@
+/*
+ Stream.cpp - base class for character streams, host version.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Arduino.h"
+#include "Stream.h"
+
+int
+Stream::timedRead()
+{
+  unsigned long start = millis();
+  do
+    {
+      int c = read();
+      if (c >= 0)
+        return c;
+      // nothing else advances the virtual clock while we spin here
+      delay(1);
+    }
+  while (millis() - start < _timeout);
+  return -1;
+}
+
+size_t
+Stream::readBytes(char *buffer, size_t length)
+{
+  size_t count = 0;
+  while (count < length)
+    {
+      int c = timedRead();
+      if (c < 0)
+        break;
+      *buffer++ = (char)c;
+      count++;
+    }
+  return count;
+}
@@ -0,0 +1,48 @@
+/*
+ avr/io.h - SPI registers of the AVR for building UIPEthernet on a host.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AVR_IO_H
+#define AVR_IO_H
+
+#include <stdint.h>
+
+#define SPIF  7
+#define SPE   6
+#define MSTR  4
+#define SPI2X 0
+
+// SPSR always reads with SPIF set: a transfer completes as soon as SPDR
+// is written
+extern volatile uint8_t SPSR;
+extern volatile uint8_t SPCR;
+
+#ifdef __cplusplus
+// writing SPDR shifts a byte out to the SPI device attached by host_hw.h,
+// reading it returns the byte shifted in by that transfer
+class host_spi_data
+{
+public:
+  host_spi_data& operator=(uint8_t data);
+  operator uint8_t() const;
+private:
+  uint8_t received;
+};
+
+extern host_spi_data SPDR;
+#endif
+
+#endif
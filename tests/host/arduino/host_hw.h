@@ -0,0 +1,39 @@
+/*
+ host_hw.h - hooks to attach simulated hardware to the host Arduino core.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HOST_HW_H
+#define HOST_HW_H
+
+#include <stdint.h>
+
+// called for every byte written to SPDR, returns the byte read back
+extern uint8_t (*host_spi_transfer)(uint8_t data);
+// called for every digitalWrite()
+extern void (*host_pin_write)(uint8_t pin, uint8_t val);
+
+// called whenever millis() or micros() is read, so simulated hardware and
+// links get to run while a sketch busy-waits on the clock
+extern void (*host_poll)(void);
+
+// advance the virtual clock behind millis() and micros()
+void host_advance_micros(unsigned long us);
+// the virtual clock in micros, read without calling host_poll
+unsigned long long host_clock(void);
+// calls the handler attached to the pins interrupt (if any)
+void host_raise_interrupt(uint8_t pin);
+
+#endif
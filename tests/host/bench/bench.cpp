@@ -0,0 +1,251 @@
+/*
+ bench.cpp - end-to-end benchmarks of UIPEthernet on VirtualEthernet.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+
+#include "virtual_ethernet.h"
+#include "bench.h"
+
+// virtual micros a scenario may take before it counts as failed
+#define BENCH_TIMEOUT 600000000UL
+// the device may still be busy with what the peer sent last
+#define BENCH_SETTLE 100000UL
+
+struct scenario
+{
+  const char* name;
+  int id;
+  long count;
+  long quick;
+  uint16_t size;
+  int peers;
+};
+
+static const scenario scenarios[] = {
+  { "tcp_upload", BENCH_TCP_UPLOAD, 65536, 8192, 400, 1 },
+  { "tcp_download", BENCH_TCP_DOWNLOAD, 65536, 8192, 400, 1 },
+  { "udp_request_response", BENCH_UDP_REQUEST, 1000, 100, 64, 1 },
+  { "udp_stream", BENCH_UDP_STREAM, 2000, 200, 512, 1 },
+  { "tcp_connect_close", BENCH_TCP_CHURN, 100, 20, 1, 1 },
+  { "tcp_fanout", BENCH_TCP_FANOUT, 65536, 8192, 400, BENCH_FANOUT_PEERS },
+};
+
+static void
+usage(const char* name)
+{
+  fprintf(stderr, "usage: %s [-q] [-s scenario]... [-o file]\n"
+      "  -q           quick run with small counts, as ctest does\n"
+      "  -s scenario  only run the given scenario (may be repeated):\n", name);
+  for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++)
+    fprintf(stderr, "               %s\n", scenarios[i].name);
+  fprintf(stderr, "  -o file      write the results to file instead of stdout\n");
+  exit(2);
+}
+
+static unsigned long
+percentile(std::vector<unsigned long>& samples, int p)
+{
+  if (samples.empty())
+    return 0;
+  std::sort(samples.begin(), samples.end());
+  // nearest rank
+  size_t rank = (samples.size() * p + 99) / 100;
+  return samples[rank ? rank - 1 : 0];
+}
+
+static double
+rate(double amount, unsigned long long micros)
+{
+  return micros ? amount * 1000000 / micros : 0;
+}
+
+/*
+ * Runs a scenario with the device and the peer on a fresh link and writes
+ * its results as a JSON object. Returns false if it didn't complete.
+ */
+static bool
+run(const scenario& s, bool quick, FILE* out)
+{
+  VirtualEthernet net;
+  net.bandwidth = BENCH_LINK_BPS;
+  net.latency = BENCH_LINK_LATENCY;
+  int d = net.addNode(BENCH_DEVICE_MODULE);
+  bench_state_fn devicefn = (bench_state_fn)net.symbol(d, "bench_get_state");
+  std::vector<bench_state*> peers;
+  for (int i = 0; i < s.peers; i++)
+    {
+      bench_state_fn peerfn = (bench_state_fn)net.symbol(net.addNode(BENCH_PEER_MODULE), "bench_get_state");
+      if (!peerfn)
+        break;
+      peers.push_back(peerfn());
+      peers.back()->peer = i;
+    }
+  if (!devicefn || (int)peers.size() < s.peers)
+    {
+      fprintf(stderr, "%s: no benchmark nodes\n", s.name);
+      return false;
+    }
+  bench_state* device = devicefn();
+  bench_state* peer = peers[0];
+  std::vector<bench_state*> all(peers);
+  all.push_back(device);
+  for (bench_state* state : all)
+    {
+      state->scenario = s.id;
+      state->count = quick ? s.quick : s.count;
+      state->size = s.size;
+    }
+
+  // the upload is complete once the device has read it all, everything
+  // else once the peers are done
+  bool completed = net.runUntil([&s, &all, device, &peers]() {
+    bool done = true;
+    for (bench_state* state : all)
+      if (state->failed)
+        return true;
+    if (s.id == BENCH_TCP_UPLOAD)
+      return device->done;
+    for (bench_state* state : peers)
+      done &= state->done;
+    return done;
+  }, BENCH_TIMEOUT);
+  if (s.id == BENCH_UDP_STREAM)
+    net.run(BENCH_SETTLE);
+  for (bench_state* state : all)
+    completed &= !state->failed;
+
+  unsigned long start = peer->start;
+  unsigned long end = device->end;
+  long payload = 0;
+  long operations = 0;
+  unsigned long peerAllocFailures = 0;
+  std::vector<unsigned long> samples;
+  for (bench_state* state : all)
+    {
+      if (state != device && state->start < start)
+        start = state->start;
+      end = std::max(end, state->end);
+      payload += state->payload;
+      operations = std::max(operations, state->operations);
+      samples.insert(samples.end(), state->latency, state->latency + state->samples);
+      if (state != device)
+        peerAllocFailures += state->allocFailures;
+    }
+  if (s.id == BENCH_UDP_STREAM)
+    operations = device->operations;
+  unsigned long long duration = end > start ? end - start : 0;
+
+  fprintf(out, "    {\n");
+  fprintf(out, "      \"name\": \"%s\",\n", s.name);
+  fprintf(out, "      \"completed\": %s,\n", completed ? "true" : "false");
+  fprintf(out, "      \"count\": %ld,\n", device->count);
+  if (s.peers > 1)
+    fprintf(out, "      \"peers\": %d,\n", s.peers);
+  fprintf(out, "      \"size\": %u,\n", s.size);
+  fprintf(out, "      \"duration_us\": %llu,\n", duration);
+  fprintf(out, "      \"payload_bytes\": %ld,\n", payload);
+  fprintf(out, "      \"throughput_bytes_per_s\": %.0f,\n", rate(payload, duration));
+  fprintf(out, "      \"operations\": %ld,\n", operations);
+  fprintf(out, "      \"operations_per_s\": %.1f,\n", rate(operations, duration));
+  if (s.id == BENCH_UDP_STREAM)
+    fprintf(out, "      \"datagrams_lost\": %ld,\n", peer->operations - device->operations);
+  fprintf(out, "      \"latency_p50_us\": %lu,\n", percentile(samples, 50));
+  fprintf(out, "      \"latency_p99_us\": %lu,\n", percentile(samples, 99));
+  fprintf(out, "      \"spi_bytes\": %lu,\n", device->spiBytes);
+  fprintf(out, "      \"spi_bytes_per_payload_byte\": %.2f,\n", payload ? (double)device->spiBytes / payload : 0);
+  fprintf(out, "      \"pool_exhausted\": %lu,\n", device->allocFailures);
+  fprintf(out, "      \"peer_pool_exhausted\": %lu,\n", peerAllocFailures);
+  fprintf(out, "      \"pool_used_max\": %u,\n", device->poolUsedMax);
+  fprintf(out, "      \"pool_bytes_moved\": %lu,\n", device->poolBytesMoved);
+  fprintf(out, "      \"frames\": %lu,\n", net.framesSent);
+  fprintf(out, "      \"frames_rejected\": %lu\n", net.framesRejected);
+  fprintf(out, "    }");
+  return completed;
+}
+
+/*
+ * The device under test runs on the ENC28J60 emulator, so the SPI traffic
+ * is what the chip would see and every SPI byte takes a micro on its
+ * clock. The peer is a second stack on VirtualNetwork that costs no time.
+ * Everything runs on the virtual clock, so a run is the same on every
+ * machine and the results can be compared from release to release.
+ */
+int
+main(int argc, char** argv)
+{
+  bool quick = false;
+  const char* output = NULL;
+  std::vector<const scenario*> selected;
+  int opt;
+  while ((opt = getopt(argc, argv, "qs:o:")) != -1)
+    {
+      switch (opt)
+        {
+      case 'q':
+        quick = true;
+        break;
+      case 's':
+        {
+          size_t i;
+          for (i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++)
+            if (!strcmp(optarg, scenarios[i].name))
+              break;
+          if (i == sizeof(scenarios) / sizeof(scenarios[0]))
+            usage(argv[0]);
+          selected.push_back(&scenarios[i]);
+        }
+        break;
+      case 'o':
+        output = optarg;
+        break;
+      default:
+        usage(argv[0]);
+        }
+    }
+  if (selected.empty())
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++)
+      selected.push_back(&scenarios[i]);
+
+  FILE* out = output ? fopen(output, "w") : stdout;
+  if (!out)
+    {
+      perror(output);
+      return 1;
+    }
+  int failed = 0;
+  fprintf(out, "{\n");
+  fprintf(out, "  \"link\": { \"bandwidth_bps\": %lu, \"latency_us\": %u },\n", BENCH_LINK_BPS, BENCH_LINK_LATENCY);
+  fprintf(out, "  \"benchmarks\": [\n");
+  for (size_t i = 0; i < selected.size(); i++)
+    {
+      if (!run(*selected[i], quick, out))
+        {
+          fprintf(stderr, "%s did not complete\n", selected[i]->name);
+          failed++;
+        }
+      fprintf(out, i + 1 < selected.size() ? ",\n" : "\n");
+    }
+  fprintf(out, "  ]\n}\n");
+  if (output)
+    fclose(out);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,90 @@
+/*
+ bench.h - state shared by the benchmark runner and its nodes.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+#define BENCH_DEVICE_IP 192,168,0,6
+#define BENCH_PEER_IP 192,168,0,1
+#define BENCH_TCP_PORT 5000
+#define BENCH_UDP_PORT 5001
+#define BENCH_DISCARD_PORT 9
+// link the runner sets up, the peer streams at line rate
+#define BENCH_LINK_BPS 10000000UL
+#define BENCH_LINK_LATENCY 100
+
+// largest write() or datagram
+#define BENCH_MAX_SIZE 1024
+#define BENCH_SAMPLES 4096
+// peers BENCH_TCP_FANOUT writes to
+#define BENCH_FANOUT_PEERS 3
+
+enum bench_scenario
+{
+  BENCH_TCP_UPLOAD,       // peer writes count bytes to the device
+  BENCH_TCP_DOWNLOAD,     // device writes count bytes to the peer
+  BENCH_UDP_REQUEST,      // peer sends count requests, device answers each
+  BENCH_UDP_STREAM,       // peer sends count datagrams as fast as it can
+  BENCH_TCP_CHURN,        // peer connects, exchanges a byte and closes count times
+  BENCH_TCP_FANOUT        // device writes count bytes to all peers with UIPServer::write()
+};
+
+/*
+ * Each node (bench/device.cpp on the ENC28J60 emulator, bench/peer.cpp on
+ * VirtualNetwork) exports its state through bench_get_state(). The runner
+ * sets the scenario before the first loop() and reads the results once
+ * the run is over. All times are micros() of the node that took them.
+ */
+struct bench_state
+{
+  int scenario;
+  long count;             // bytes, requests, datagrams or connections
+  uint16_t size;          // bytes per write() or datagram
+  uint8_t peer;           // which peer this is (when there are several)
+
+  bool done;
+  bool failed;
+  unsigned long start;    // the peer started the first operation
+  unsigned long end;      // the last operation completed
+  long payload;           // bytes the sketch received
+  long operations;        // completed writes, responses, datagrams or connections
+  long samples;
+  unsigned long latency[BENCH_SAMPLES];
+  unsigned long spiBytes;         // since setup(), device only
+  unsigned long allocFailures;    // since setup()
+  unsigned int poolUsedMax;       // device only, see mempool_stats
+  unsigned long poolBytesMoved;
+};
+
+typedef struct bench_state* (*bench_state_fn)(void);
+
+static inline uint8_t
+bench_pattern(long pos)
+{
+  return pos * 7 + (pos >> 8);
+}
+
+static inline void
+bench_sample(struct bench_state* state, unsigned long latency)
+{
+  if (state->samples < BENCH_SAMPLES)
+    state->latency[state->samples++] = latency;
+}
+
+#endif
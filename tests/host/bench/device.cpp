@@ -0,0 +1,225 @@
+/*
+ device.cpp - benchmark node: the device under test, on the ENC28J60 emulator.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <UIPEthernet.h>
+#include "host_hw.h"
+#include "virtual_node.h"
+#include "bench.h"
+
+static uint8_t mac[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x06 };
+
+EthernetServer server(BENCH_TCP_PORT);
+EthernetUDP udp;
+EthernetClient client;
+static struct bench_state state;
+static unsigned long spiStart;
+static unsigned long allocStart;
+static long pos;
+static uint8_t buf[BENCH_MAX_SIZE];
+
+VNODE_EXPORT struct bench_state*
+bench_get_state()
+{
+  return &state;
+}
+
+void
+setup()
+{
+  Ethernet.begin(mac, IPAddress(BENCH_DEVICE_IP));
+  server.begin();
+  udp.begin(BENCH_UDP_PORT);
+  spiStart = Enc28J60Network::stats().spiBytes;
+  allocStart = UIPNetwork::poolStats().allocFailures;
+}
+
+// reads what the peer uploads and checks it
+static void
+upload()
+{
+  EthernetClient c = server.available();
+  if (!c)
+    return;
+  int len = c.read(buf, sizeof(buf));
+  for (int i = 0; i < len; i++)
+    if (buf[i] != bench_pattern(state.payload + i))
+      state.failed = true;
+  if (len > 0)
+    state.payload += len;
+  if (state.payload >= state.count)
+    {
+      state.end = micros();
+      state.done = true;
+    }
+}
+
+// writes count bytes once the peer asked for them, latency is the time
+// write() takes
+static void
+download()
+{
+  if (!client)
+    {
+      client = server.available();
+      if (!client)
+        return;
+      int len = client.read(buf, sizeof(buf));
+      if (len > 0)
+        state.payload += len;
+    }
+  long len = state.count - pos < state.size ? state.count - pos : state.size;
+  for (long i = 0; i < len; i++)
+    buf[i] = bench_pattern(pos + i);
+  unsigned long start = micros();
+  size_t written = client.write(buf, len);
+  if (written == (size_t)-1)
+    {
+      state.failed = true;
+      state.done = true;
+      return;
+    }
+  bench_sample(&state, micros() - start);
+  pos += written;
+  state.operations++;
+  if (pos >= state.count)
+    {
+      client.stop();
+      state.end = micros();
+      state.done = true;
+    }
+}
+
+static void
+request()
+{
+  int len = udp.parsePacket();
+  if (len <= 0)
+    return;
+  len = udp.read(buf, sizeof(buf));
+  state.payload += len;
+  udp.beginPacket(udp.remoteIP(), udp.remotePort());
+  udp.write(buf, len);
+  udp.endPacket();
+  state.operations++;
+}
+
+// the peer puts its micros() into each datagram, latency is one way
+static void
+stream()
+{
+  int len = udp.parsePacket();
+  if (len <= 0)
+    return;
+  len = udp.read(buf, sizeof(buf));
+  unsigned long now = micros();
+  unsigned long sent;
+  if (len >= (int)sizeof(sent))
+    {
+      memcpy(&sent, buf, sizeof(sent));
+      bench_sample(&state, now - sent);
+    }
+  state.payload += len;
+  state.operations++;
+  state.end = now;
+}
+
+// writes count bytes to all peers at once, once each of them asked
+static void
+fanout()
+{
+  if (state.payload < BENCH_FANOUT_PEERS)
+    {
+      EthernetClient c = server.available();
+      if (c)
+        {
+          int len = c.read(buf, sizeof(buf));
+          if (len > 0)
+            state.payload += len;
+        }
+      return;
+    }
+  long len = state.count - pos < state.size ? state.count - pos : state.size;
+  for (long i = 0; i < len; i++)
+    buf[i] = bench_pattern(pos + i);
+  unsigned long start = micros();
+  size_t written = server.write(buf, len);
+  if (written != (size_t)len * BENCH_FANOUT_PEERS)
+    {
+      state.failed = true;
+      state.done = true;
+      return;
+    }
+  bench_sample(&state, micros() - start);
+  pos += len;
+  state.operations++;
+  if (pos >= state.count)
+    {
+      state.end = micros();
+      state.done = true;
+    }
+}
+
+static void
+churn()
+{
+  EthernetClient c = server.available();
+  if (!c)
+    return;
+  int len = c.read(buf, sizeof(buf));
+  if (len > 0)
+    {
+      state.payload += len;
+      c.write(buf, 1);
+    }
+  c.stop();
+  state.operations++;
+}
+
+void
+loop()
+{
+  if (!state.done)
+    {
+      switch (state.scenario)
+        {
+        case BENCH_TCP_UPLOAD:
+          upload();
+          break;
+        case BENCH_TCP_DOWNLOAD:
+          download();
+          break;
+        case BENCH_UDP_REQUEST:
+          request();
+          break;
+        case BENCH_UDP_STREAM:
+          stream();
+          break;
+        case BENCH_TCP_CHURN:
+          churn();
+          break;
+        case BENCH_TCP_FANOUT:
+          fanout();
+          break;
+        }
+    }
+  else
+    Ethernet.maintain();
+  state.spiBytes = Enc28J60Network::stats().spiBytes - spiStart;
+  state.allocFailures = UIPNetwork::poolStats().allocFailures - allocStart;
+  state.poolUsedMax = Enc28J60Network::poolStats().usedMax;
+  state.poolBytesMoved = Enc28J60Network::poolStats().bytesMoved;
+}
@@ -0,0 +1,259 @@
+/*
+ peer.cpp - benchmark node: drives the device under test.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <UIPEthernet.h>
+#include "host_hw.h"
+#include "virtual_node.h"
+#include "bench.h"
+
+// give up on a connection or a request after that many micros
+#define PEER_TIMEOUT 1000000UL
+#define PEER_RETRY 20000UL
+
+static uint8_t mac[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+static IPAddress device(BENCH_DEVICE_IP);
+
+EthernetClient client;
+EthernetUDP udp;
+static struct bench_state state;
+static unsigned long allocStart;
+static long pos;
+static uint8_t buf[BENCH_MAX_SIZE];
+
+VNODE_EXPORT struct bench_state*
+bench_get_state()
+{
+  return &state;
+}
+
+static void
+finish(bool failed)
+{
+  state.end = micros();
+  state.failed |= failed;
+  state.done = true;
+}
+
+void
+setup()
+{
+  IPAddress ip(BENCH_PEER_IP);
+  mac[5] += state.peer;
+  ip[3] += state.peer;
+  Ethernet.begin(mac, ip);
+  udp.begin(BENCH_UDP_PORT);
+  // have both sides know each others mac before anything is measured. The
+  // datagram that started the arp request goes out on the next periodic
+  // timer, until then the socket can't send another one
+  udp.beginPacket(device, BENCH_DISCARD_PORT);
+  udp.write((uint8_t)0);
+  udp.endPacket();
+  unsigned long start = millis();
+  while (millis() - start < 2 * UIP_PERIODIC_TIMER)
+    Ethernet.maintain();
+  allocStart = UIPNetwork::poolStats().allocFailures;
+}
+
+static void
+upload()
+{
+  if (!client.connected())
+    {
+      if (state.start)
+        {
+          finish(true);
+          return;
+        }
+      state.start = micros();
+      if (!client.connect(device, BENCH_TCP_PORT))
+        finish(true);
+      return;
+    }
+  long len = state.count - pos < state.size ? state.count - pos : state.size;
+  for (long i = 0; i < len; i++)
+    buf[i] = bench_pattern(pos + i);
+  unsigned long start = micros();
+  size_t written = client.write(buf, len);
+  if (written == (size_t)-1)
+    {
+      finish(true);
+      return;
+    }
+  bench_sample(&state, micros() - start);
+  pos += written;
+  state.operations++;
+  // the connection stays open, the device might not have read it all yet
+  if (pos >= state.count)
+    finish(false);
+}
+
+static void
+download()
+{
+  if (!client.connected())
+    {
+      if (state.start)
+        {
+          finish(true);
+          return;
+        }
+      state.start = micros();
+      if (!client.connect(device, BENCH_TCP_PORT))
+        {
+          finish(true);
+          return;
+        }
+      client.write((uint8_t)'d');
+      return;
+    }
+  int len = client.read(buf, sizeof(buf));
+  for (int i = 0; i < len; i++)
+    if (buf[i] != bench_pattern(state.payload + i))
+      state.failed = true;
+  if (len > 0)
+    state.payload += len;
+  if (state.payload >= state.count)
+    {
+      client.stop();
+      finish(false);
+    }
+}
+
+// one request at a time, sent again if there was no answer in time
+static void
+request()
+{
+  static unsigned long sent;
+  static bool waiting;
+  if (!state.start)
+    state.start = micros();
+  if (waiting)
+    {
+      int len = udp.parsePacket();
+      if (len > 0)
+        {
+          len = udp.read(buf, sizeof(buf));
+          long seq;
+          memcpy(&seq, buf, sizeof(seq));
+          // a late answer to a request sent again
+          if (len < (int)sizeof(seq) || seq != state.operations)
+            return;
+          state.payload += len;
+          bench_sample(&state, micros() - sent);
+          state.operations++;
+          waiting = false;
+          if (state.operations >= state.count)
+            finish(false);
+          return;
+        }
+      if (micros() - sent < PEER_RETRY)
+        return;
+    }
+  memset(buf, 0, state.size);
+  memcpy(buf, &state.operations, sizeof(state.operations));
+  sent = micros();
+  if (udp.beginPacket(device, BENCH_UDP_PORT))
+    {
+      udp.write(buf, state.size);
+      udp.endPacket();
+    }
+  waiting = true;
+}
+
+// datagrams back to back at line rate, the device drops what it can't take
+static void
+stream()
+{
+  static unsigned long next;
+  unsigned long now = micros();
+  if (!state.start)
+    next = state.start = now;
+  if (now < next)
+    return;
+  // ethernet, ip and udp header, preamble, fcs and gap
+  next += (state.size + 14 + 20 + 8 + 24) * 8 * 1000000ULL / BENCH_LINK_BPS;
+  memset(buf, 0, state.size);
+  memcpy(buf, &now, sizeof(now));
+  if (udp.beginPacket(device, BENCH_UDP_PORT))
+    {
+      udp.write(buf, state.size);
+      if (udp.endPacket())
+        state.operations++;
+    }
+  if (++pos >= state.count)
+    finish(false);
+}
+
+// connect, send a byte, wait for the answer and close. latency is all of it
+static void
+churn()
+{
+  if (!state.start)
+    state.start = micros();
+  unsigned long start = micros();
+  if (!client.connect(device, BENCH_TCP_PORT))
+    {
+      finish(true);
+      return;
+    }
+  client.write((uint8_t)'c');
+  while (!client.available())
+    {
+      if (!client.connected() || micros() - start > PEER_TIMEOUT)
+        {
+          client.stop();
+          finish(true);
+          return;
+        }
+    }
+  state.payload += client.read(buf, sizeof(buf));
+  client.stop();
+  bench_sample(&state, micros() - start);
+  state.operations++;
+  if (state.operations >= state.count)
+    finish(false);
+}
+
+void
+loop()
+{
+  if (!state.done)
+    {
+      switch (state.scenario)
+        {
+        case BENCH_TCP_UPLOAD:
+          upload();
+          break;
+        case BENCH_TCP_DOWNLOAD:
+        case BENCH_TCP_FANOUT:
+          download();
+          break;
+        case BENCH_UDP_REQUEST:
+          request();
+          break;
+        case BENCH_UDP_STREAM:
+          stream();
+          break;
+        case BENCH_TCP_CHURN:
+          churn();
+          break;
+        }
+    }
+  else
+    Ethernet.maintain();
+  state.allocFailures = UIPNetwork::poolStats().allocFailures - allocStart;
+}
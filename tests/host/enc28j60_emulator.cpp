@@ -0,0 +1,627 @@
+/*
+ enc28j60_emulator.cpp - register level emulation of the ENC28J60 for host builds.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "enc28j60_emulator.h"
+#include "Arduino.h"
+#include "host_hw.h"
+#include <string.h>
+
+extern "C" {
+#include "enc28j60.h"
+}
+
+// control register index: bank in bits 5-6, common registers in every bank
+#define REG(address) (((address) & ADDR_MASK) >= EIE ? ((address) & ADDR_MASK) : ((address) & 0x7F))
+
+#define EREVID_B7 0x06
+
+Enc28J60Emulator* Enc28J60Emulator::attached;
+
+Enc28J60Emulator::Enc28J60Emulator() :
+    spiBytes(0),
+    spiOps(0),
+    rxFiltered(0),
+    rxOverflows(0),
+    dmaLatency(2),
+    spiByteMicros(1),
+    link(true),
+    rxBusy(false),
+    intPin(-1),
+    state(SPI_IDLE),
+    argument(0),
+    dummy(false),
+    selected(false),
+    dmaPending(0),
+    cs(0),
+    intLevel(false)
+{
+  memset(mem, 0, sizeof(mem));
+  reset();
+}
+
+Enc28J60Emulator::~Enc28J60Emulator()
+{
+  detach();
+}
+
+void
+Enc28J60Emulator::attach(uint8_t cspin)
+{
+  cs = cspin;
+  attached = this;
+  host_spi_transfer = spiTransfer;
+  host_pin_write = pinWrite;
+}
+
+void
+Enc28J60Emulator::detach()
+{
+  if (attached != this)
+    return;
+  attached = NULL;
+  host_spi_transfer = NULL;
+  host_pin_write = NULL;
+}
+
+uint8_t
+Enc28J60Emulator::spiTransfer(uint8_t data)
+{
+  return attached ? attached->transfer(data) : 0xFF;
+}
+
+void
+Enc28J60Emulator::pinWrite(uint8_t pin, uint8_t val)
+{
+  Enc28J60Emulator* e = attached;
+  if (!e || pin != e->cs)
+    return;
+  if (val == LOW && !e->selected)
+    {
+      e->selected = true;
+      e->state = SPI_OPCODE;
+      e->spiOps++;
+      // DMA runs in the background while the SPI bus is used otherwise:
+      if (e->dmaPending && --e->dmaPending == 0)
+        e->runDma();
+    }
+  else if (val != LOW)
+    {
+      e->selected = false;
+      e->state = SPI_IDLE;
+      // the operation just finished may have set or cleared a flag
+      e->updateInterrupt();
+    }
+}
+
+void
+Enc28J60Emulator::reset()
+{
+  // values after power on or system reset (see datasheet table 3-2 and 3-3)
+  memset(regs, 0, sizeof(regs));
+  set16(REG(ERDPTL), 0x05FA);
+  set16(REG(ERXSTL), 0x05FA);
+  set16(REG(ERXNDL), 0x1FFF);
+  set16(REG(ERXRDPTL), 0x05FA);
+  regs[REG(ERXFCON)] = ERXFCON_UCEN|ERXFCON_CRCEN|ERXFCON_BCEN;
+  regs[REG(MACLCON1)] = 0x0F;
+  regs[REG(MACLCON2)] = 0x37;
+  set16(REG(MAMXFLL), 0x0600);
+  regs[REG(EREVID)] = EREVID_B7;
+  set16(REG(EPAUSL), 0x1000);
+  regs[REG(ECON2)] = ECON2_AUTOINC;
+  regs[REG(ESTAT)] = ESTAT_CLKRDY;
+  memset(phyregs, 0, sizeof(phyregs));
+  phyregs[PHSTAT1] = PHSTAT1_PFDPX|PHSTAT1_PHDPX;
+  phyregs[PHHID1] = 0x0083;
+  phyregs[PHHID2] = 0x1400;
+  phyregs[PHLCON] = 0x3422;
+  pktcnt = 0;
+  rxwrpt = 0;
+  dmaPending = 0;
+}
+
+uint8_t
+Enc28J60Emulator::transfer(uint8_t data)
+{
+  spiBytes++;
+  host_advance_micros(spiByteMicros);
+  if (!selected)
+    return 0xFF;
+  switch (state)
+    {
+  case SPI_OPCODE:
+    argument = data & ADDR_MASK;
+    if (data == ENC28J60_SOFT_RESET)
+      {
+        reset();
+        state = SPI_DONE;
+        break;
+      }
+    switch (data & 0xE0)
+      {
+    case ENC28J60_READ_CTRL_REG:
+      state = SPI_READ_REG;
+      // MAC and MII registers shift out a dummy byte first
+      dummy = isMacMii(index(argument));
+      break;
+    case ENC28J60_READ_BUF_MEM & 0xE0:
+      state = SPI_READ_BUF;
+      break;
+    case ENC28J60_WRITE_CTRL_REG:
+      state = SPI_WRITE_REG;
+      break;
+    case ENC28J60_WRITE_BUF_MEM & 0xE0:
+      state = SPI_WRITE_BUF;
+      break;
+    case ENC28J60_BIT_FIELD_SET:
+      state = SPI_BIT_SET;
+      break;
+    case ENC28J60_BIT_FIELD_CLR:
+      state = SPI_BIT_CLR;
+      break;
+    default:
+      state = SPI_DONE;
+      }
+    break;
+  case SPI_READ_REG:
+    if (dummy)
+      {
+        dummy = false;
+        return 0xFF;
+      }
+    state = SPI_DONE;
+    return readRegister(index(argument));
+  case SPI_READ_BUF:
+    {
+      uint16_t ptr = get16(REG(ERDPTL));
+      uint8_t ret = mem[ptr];
+      if (regs[REG(ECON2)] & ECON2_AUTOINC)
+        set16(REG(ERDPTL), rxNext(ptr));
+      return ret;
+    }
+  case SPI_WRITE_REG:
+    writeRegister(index(argument), data);
+    state = SPI_DONE;
+    break;
+  case SPI_WRITE_BUF:
+    {
+      uint16_t ptr = get16(REG(EWRPTL));
+      mem[ptr] = data;
+      if (regs[REG(ECON2)] & ECON2_AUTOINC)
+        set16(REG(EWRPTL), (ptr + 1) & (ENC28J60_EMULATOR_MEMSIZE - 1));
+      break;
+    }
+  case SPI_BIT_SET:
+    writeRegister(index(argument), regs[index(argument)] | data);
+    state = SPI_DONE;
+    break;
+  case SPI_BIT_CLR:
+    writeRegister(index(argument), regs[index(argument)] & ~data);
+    state = SPI_DONE;
+    break;
+  default:
+    break;
+    }
+  return 0xFF;
+}
+
+uint8_t
+Enc28J60Emulator::index(uint8_t address) const
+{
+  address &= ADDR_MASK;
+  return address >= EIE ? address : ((regs[REG(ECON1)] & (ECON1_BSEL1|ECON1_BSEL0)) << 5) | address;
+}
+
+bool
+Enc28J60Emulator::isMacMii(uint8_t index)
+{
+  // all registers of bank 2, MAADR and MISTAT of bank 3
+  if ((index & ADDR_MASK) >= EIE)
+    return false;
+  return (index & BANK_MASK) == 0x40
+      || (index >= (MAADR1 & 0x7F) && index <= (MAADR4 & 0x7F))
+      || index == (MISTAT & 0x7F);
+}
+
+uint8_t
+Enc28J60Emulator::readRegister(uint8_t index)
+{
+  switch (index)
+    {
+  case REG(EPKTCNT):
+    return pktcnt;
+  case REG(ERXWRPTL):
+    return rxwrpt & 0xFF;
+  case REG(ERXWRPTH):
+    return rxwrpt >> 8;
+  case REG(ESTAT):
+    return regs[index] | (interruptAsserted() ? ESTAT_INT : 0) | (rxBusy ? ESTAT_RXBUSY : 0);
+  default:
+    return regs[index];
+    }
+}
+
+void
+Enc28J60Emulator::writeRegister(uint8_t index, uint8_t data)
+{
+  switch (index)
+    {
+  case REG(EPKTCNT):
+  case REG(ERXWRPTL):
+  case REG(ERXWRPTH):
+  case REG(EREVID):
+  case REG(MISTAT):
+  case REG(ESTAT):
+    // read only
+    return;
+  case REG(ECON2):
+    if (data & ECON2_PKTDEC)
+      {
+        if (pktcnt)
+          pktcnt--;
+        if (!pktcnt)
+          regs[REG(EIR)] &= ~EIR_PKTIF;
+      }
+    regs[index] = data & ~ECON2_PKTDEC;
+    return;
+  case REG(ECON1):
+    {
+      uint8_t old = regs[index];
+      regs[index] = data;
+      if (data & ECON1_TXRST)
+        regs[index] &= ~ECON1_TXRTS;
+      else if ((data & ECON1_TXRTS) && !(old & ECON1_TXRTS))
+        transmit();
+      if ((data & ECON1_DMAST) && !(old & ECON1_DMAST))
+        {
+          dmaPending = dmaLatency;
+          if (!dmaPending)
+            runDma();
+        }
+      // clearing DMAST aborts the DMA
+      else if ((old & ECON1_DMAST) && !(data & ECON1_DMAST))
+        dmaPending = 0;
+      return;
+    }
+  case REG(ERXSTL):
+  case REG(ERXSTH):
+    regs[index] = data;
+    // programming ERXST resets the receive write pointer
+    rxwrpt = get16(REG(ERXSTL));
+    return;
+  case REG(MICMD):
+    regs[index] = data;
+    if (data & MICMD_MIIRD)
+      {
+        uint16_t value = phy(regs[REG(MIREGADR)]);
+        regs[REG(MIRDL)] = value & 0xFF;
+        regs[REG(MIRDH)] = value >> 8;
+      }
+    return;
+  case REG(MIWRH):
+    regs[index] = data;
+    // writing MIWRH starts the MII write
+    phyregs[regs[REG(MIREGADR)] & 0x1F] = regs[REG(MIWRL)] | data << 8;
+    return;
+  default:
+    regs[index] = data;
+    }
+}
+
+uint16_t
+Enc28J60Emulator::get16(uint8_t index) const
+{
+  return (regs[index] | regs[index+1] << 8) & (ENC28J60_EMULATOR_MEMSIZE - 1);
+}
+
+void
+Enc28J60Emulator::set16(uint8_t index, uint16_t value)
+{
+  regs[index] = value & 0xFF;
+  regs[index+1] = value >> 8;
+}
+
+uint16_t
+Enc28J60Emulator::rxNext(uint16_t address) const
+{
+  // pointers wrap from ERXND to ERXST within the receivebuffer
+  if (address == get16(REG(ERXNDL)))
+    return get16(REG(ERXSTL));
+  return (address + 1) & (ENC28J60_EMULATOR_MEMSIZE - 1);
+}
+
+uint8_t
+Enc28J60Emulator::reg(uint8_t address) const
+{
+  uint8_t i = REG(address);
+  switch (i)
+    {
+  case REG(EPKTCNT):
+    return pktcnt;
+  case REG(ERXWRPTL):
+    return rxwrpt & 0xFF;
+  case REG(ERXWRPTH):
+    return rxwrpt >> 8;
+  default:
+    return regs[i];
+    }
+}
+
+uint16_t
+Enc28J60Emulator::reg16(uint8_t address) const
+{
+  return reg(address) | reg(address + 1) << 8;
+}
+
+uint16_t
+Enc28J60Emulator::phy(uint8_t address) const
+{
+  switch (address & 0x1F)
+    {
+  case PHSTAT1:
+    return phyregs[PHSTAT1] | (link ? PHSTAT1_LLSTAT : 0);
+  case PHSTAT2:
+    return phyregs[PHSTAT2] | (link ? 0x0400 : 0);
+  default:
+    return phyregs[address & 0x1F];
+    }
+}
+
+bool
+Enc28J60Emulator::interruptAsserted() const
+{
+  return (regs[REG(EIE)] & EIE_INTIE) && (regs[REG(EIE)] & regs[REG(EIR)] & 0x7F);
+}
+
+void
+Enc28J60Emulator::updateInterrupt()
+{
+  // INT is active low, the handler sees the falling edge only
+  bool asserted = interruptAsserted();
+  if (asserted && !intLevel && intPin >= 0)
+    host_raise_interrupt(intPin);
+  intLevel = asserted;
+}
+
+void
+Enc28J60Emulator::transmit()
+{
+  uint16_t start = get16(REG(ETXSTL));
+  uint16_t end = get16(REG(ETXNDL));
+  // first byte is the per packet control byte
+  std::vector<uint8_t> frame;
+  for (uint16_t i = start + 1; i <= end && i < ENC28J60_EMULATOR_MEMSIZE; i++)
+    frame.push_back(mem[i]);
+  uint8_t control = mem[start];
+  uint8_t padcfg = control & PKTCTRL_POVERRIDE ? (control & PKTCTRL_PPADEN ? MACON3_PADCFG0 : 0) : regs[REG(MACON3)] & (MACON3_PADCFG2|MACON3_PADCFG1|MACON3_PADCFG0);
+  if (padcfg && frame.size() < 60)
+    frame.resize(60, 0);
+
+  // transmit status vector behind the frame (see datasheet table 5-1)
+  uint16_t count = frame.size() + 4;
+  uint8_t tsv[7];
+  tsv[0] = count & 0xFF;
+  tsv[1] = count >> 8;
+  tsv[2] = 0x80; // done, no collisions
+  tsv[3] = (frame.size() && frame[0] & 1) ? (memcmp(&frame[0], "\xff\xff\xff\xff\xff\xff", 6) == 0 ? 0x02 : 0x01) : 0;
+  tsv[4] = count & 0xFF;
+  tsv[5] = count >> 8;
+  tsv[6] = 0;
+  for (uint8_t i = 0; i < sizeof(tsv); i++)
+    mem[(end + 1 + i) & (ENC28J60_EMULATOR_MEMSIZE - 1)] = tsv[i];
+
+  regs[REG(ECON1)] &= ~ECON1_TXRTS;
+  regs[REG(EIR)] |= EIR_TXIF;
+
+  if (onTransmit)
+    onTransmit(frame.data(), frame.size());
+  else
+    transmitted.push_back(frame);
+}
+
+void
+Enc28J60Emulator::runDma()
+{
+  uint16_t src = get16(REG(EDMASTL));
+  uint16_t end = get16(REG(EDMANDL));
+  uint16_t dest = get16(REG(EDMADSTL));
+  bool checksum = regs[REG(ECON1)] & ECON1_CSUMEN;
+  uint32_t sum = 0;
+  bool high = true;
+  // the source wraps within the receivebuffer, the destination only at the
+  // end of memory. Stop after 8K in case the pointers never meet.
+  for (uint16_t n = 0; n < ENC28J60_EMULATOR_MEMSIZE; n++)
+    {
+      if (checksum)
+        {
+          sum += high ? mem[src] << 8 : mem[src];
+          high = !high;
+        }
+      else
+        {
+          mem[dest] = mem[src];
+          dest = (dest + 1) & (ENC28J60_EMULATOR_MEMSIZE - 1);
+        }
+      if (src == end)
+        break;
+      src = rxNext(src);
+    }
+  if (checksum)
+    {
+      while (sum >> 16)
+        sum = (sum & 0xFFFF) + (sum >> 16);
+      sum = ~sum & 0xFFFF;
+      regs[REG(EDMACSL)] = sum & 0xFF;
+      regs[REG(EDMACSH)] = sum >> 8;
+    }
+  regs[REG(ECON1)] &= ~ECON1_DMAST;
+  regs[REG(EIR)] |= EIR_DMAIF;
+}
+
+bool
+Enc28J60Emulator::inject(const uint8_t* frame, uint16_t len, bool crcok)
+{
+  if (!(regs[REG(ECON1)] & ECON1_RXEN))
+    {
+      rxFiltered++;
+      return false;
+    }
+  // short frames are padded on the wire
+  std::vector<uint8_t> data(frame, frame + len);
+  if (data.size() < 60)
+    data.resize(60, 0);
+  uint32_t fcs = crc32(data.data(), data.size());
+  if (!crcok)
+    fcs ^= 1;
+  for (uint8_t i = 0; i < 4; i++)
+    data.push_back(fcs >> (8 * i));
+
+  uint8_t filter = regs[REG(ERXFCON)];
+  if ((!crcok && (filter & ERXFCON_CRCEN)) || !accept(data.data(), data.size()))
+    {
+      rxFiltered++;
+      return false;
+    }
+
+  uint16_t rxst = get16(REG(ERXSTL));
+  uint16_t rxnd = get16(REG(ERXNDL));
+  uint16_t rdpt = get16(REG(ERXRDPTL));
+  uint16_t size = rxnd - rxst + 1;
+  // the chip never writes to the byte ERXRDPT points to
+  uint16_t free = rdpt >= rxwrpt ? rdpt - rxwrpt : size - (rxwrpt - rdpt);
+  uint16_t needed = 6 + data.size();
+  needed += needed & 1; // packets start at even addresses
+  if (pktcnt == 255 || needed > free)
+    {
+      rxOverflows++;
+      regs[REG(EIR)] |= EIR_RXERIF;
+      return false;
+    }
+
+  uint16_t next = rxwrpt;
+  for (uint16_t i = 0; i < needed; i++)
+    next = rxNext(next);
+  // receive status vector (see datasheet table 7-3)
+  uint8_t rsv[6];
+  rsv[0] = next & 0xFF;
+  rsv[1] = next >> 8;
+  rsv[2] = data.size() & 0xFF;
+  rsv[3] = data.size() >> 8;
+  rsv[4] = 0x80 | (crcok ? 0 : 0x10);
+  rsv[5] = (data[0] & 1) ? (memcmp(&data[0], "\xff\xff\xff\xff\xff\xff", 6) == 0 ? 0x02 : 0x01) : 0;
+  uint16_t ptr = rxwrpt;
+  for (uint8_t i = 0; i < sizeof(rsv); i++, ptr = rxNext(ptr))
+    mem[ptr] = rsv[i];
+  for (uint16_t i = 0; i < data.size(); i++, ptr = rxNext(ptr))
+    mem[ptr] = data[i];
+  rxwrpt = next;
+  pktcnt++;
+  regs[REG(EIR)] |= EIR_PKTIF;
+  updateInterrupt();
+  return true;
+}
+
+bool
+Enc28J60Emulator::accept(const uint8_t* frame, uint16_t len) const
+{
+  uint8_t filter = regs[REG(ERXFCON)];
+  uint8_t filters = filter & (ERXFCON_UCEN|ERXFCON_PMEN|ERXFCON_MPEN|ERXFCON_HTEN|ERXFCON_MCEN|ERXFCON_BCEN);
+  // all filters disabled: promiscuous
+  if (!filters)
+    return true;
+
+  static const uint8_t broadcast[6] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+  // MAADR5 (datasheet: MAADR1) holds the first byte of the address
+  uint8_t mac[6] = {
+    regs[REG(MAADR5)], regs[REG(MAADR4)], regs[REG(MAADR3)],
+    regs[REG(MAADR2)], regs[REG(MAADR1)], regs[REG(MAADR0)]
+  };
+  bool isbroadcast = memcmp(frame, broadcast, 6) == 0;
+  uint8_t matched = 0;
+
+  if (memcmp(frame, mac, 6) == 0)
+    matched |= ERXFCON_UCEN;
+  if (isbroadcast)
+    matched |= ERXFCON_BCEN;
+  if ((frame[0] & 1) && !isbroadcast)
+    matched |= ERXFCON_MCEN;
+  if (filter & ERXFCON_HTEN)
+    {
+      // bits 28:23 of the CRC (shifted msb first) of the destination address
+      uint32_t crc = ~crc32(frame, 6);
+      uint32_t msbfirst = 0;
+      for (uint8_t i = 0; i < 32; i++)
+        if (crc & (1UL << i))
+          msbfirst |= 1UL << (31 - i);
+      uint8_t bit = (msbfirst >> 23) & 0x3F;
+      if (regs[REG(EHT0) + (bit >> 3)] & (1 << (bit & 7)))
+        matched |= ERXFCON_HTEN;
+    }
+  if (filter & ERXFCON_PMEN)
+    {
+      uint16_t offset = regs[REG(EPMOL)] | regs[REG(EPMOH)] << 8;
+      if (offset + 64 <= len)
+        {
+          uint32_t sum = 0;
+          bool high = true;
+          for (uint8_t i = 0; i < 64; i++)
+            if (regs[REG(EPMM0) + (i >> 3)] & (1 << (i & 7)))
+              {
+                sum += high ? frame[offset + i] << 8 : frame[offset + i];
+                high = !high;
+              }
+          while (sum >> 16)
+            sum = (sum & 0xFFFF) + (sum >> 16);
+          if ((~sum & 0xFFFF) == (uint16_t)(regs[REG(EPMCSL)] | regs[REG(EPMCSH)] << 8))
+            matched |= ERXFCON_PMEN;
+        }
+    }
+  if (filter & ERXFCON_MPEN && (matched & (ERXFCON_UCEN|ERXFCON_BCEN)))
+    {
+      // six times 0xff followed by 16 repetitions of our address
+      for (uint16_t i = 6; i + 6 + 96 <= len; i++)
+        {
+          if (memcmp(&frame[i], broadcast, 6) != 0)
+            continue;
+          uint8_t n;
+          for (n = 0; n < 16 && memcmp(&frame[i + 6 + n * 6], mac, 6) == 0; n++);
+          if (n == 16)
+            {
+              matched |= ERXFCON_MPEN;
+              break;
+            }
+        }
+    }
+
+  if (filter & ERXFCON_ANDOR)
+    return (matched & filters) == filters;
+  return (matched & filters) != 0;
+}
+
+uint32_t
+Enc28J60Emulator::crc32(const uint8_t* data, uint16_t len)
+{
+  // ethernet FCS (reflected polynomial 0xEDB88320)
+  uint32_t crc = 0xFFFFFFFF;
+  for (uint16_t i = 0; i < len; i++)
+    {
+      crc ^= data[i];
+      for (uint8_t j = 0; j < 8; j++)
+        crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+    }
+  return ~crc;
+}
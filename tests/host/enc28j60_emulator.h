@@ -0,0 +1,136 @@
+/*
+ enc28j60_emulator.h - register level emulation of the ENC28J60 for host builds.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ENC28J60_EMULATOR_H
+#define ENC28J60_EMULATOR_H
+
+#include <stdint.h>
+#include <deque>
+#include <functional>
+#include <vector>
+
+#define ENC28J60_EMULATOR_MEMSIZE 0x2000
+
+/*
+ * Emulates the ENC28J60 as seen through its SPI interface: the opcodes,
+ * banked control registers, PHY registers via MII, the 8K buffer memory
+ * with the receive ringbuffer, receive filters, EPKTCNT, transmission
+ * (including the status vector) and the DMA copy and checksum engine.
+ *
+ * attach() connects the emulator to SPDR and the CS pin of the host
+ * Arduino core so Enc28J60Network runs against it unchanged. Frames are
+ * injected by inject() and sent frames are collected in transmitted (or
+ * passed to onTransmit). There is no wire of its own, a HostLink provides
+ * one: transmission and reception complete instantly, each SPI byte
+ * advances the virtual clock.
+ */
+class Enc28J60Emulator
+{
+public:
+  Enc28J60Emulator();
+  ~Enc28J60Emulator();
+
+  void attach(uint8_t cspin);
+  void detach();
+
+  // receive a frame (without FCS) from the wire. Returns false if the
+  // frame was filtered or the receivebuffer was full
+  bool inject(const uint8_t* frame, uint16_t len, bool crcok = true);
+
+  // frames sent by the driver (without FCS), oldest first. Only collected
+  // while onTransmit isn't set
+  std::deque<std::vector<uint8_t> > transmitted;
+  // called for every frame sent instead of collecting it (see HostLink)
+  std::function<void(const uint8_t* frame, uint16_t len)> onTransmit;
+
+  // register as addressed by the driver (bank and MAC/MII flag in the address)
+  uint8_t reg(uint8_t address) const;
+  uint16_t reg16(uint8_t address) const;
+  uint16_t phy(uint8_t address) const;
+  uint8_t* memory() { return mem; }
+  uint8_t packetCount() const { return pktcnt; }
+  bool interruptAsserted() const;
+
+  // SPI traffic seen by the chip
+  unsigned long spiBytes;
+  unsigned long spiOps;
+  // frames dropped by inject()
+  unsigned long rxFiltered;
+  unsigned long rxOverflows;
+
+  // number of SPI operations a DMA copy or checksum runs before it completes
+  unsigned int dmaLatency;
+  // virtual time (in micros) a SPI byte takes
+  unsigned int spiByteMicros;
+  // link state reported through PHSTAT1/PHSTAT2
+  bool link;
+  // ESTAT.RXBUSY stays set as if a frame never ended
+  bool rxBusy;
+  // pin INT is wired to (see UIP_INT_PIN), -1 for none. Asserting INT
+  // calls the handler attached to that pin (host_raise_interrupt)
+  int intPin;
+
+private:
+  enum spi_state
+  {
+    SPI_IDLE,
+    SPI_OPCODE,
+    SPI_READ_REG,
+    SPI_READ_BUF,
+    SPI_WRITE_REG,
+    SPI_WRITE_BUF,
+    SPI_BIT_SET,
+    SPI_BIT_CLR,
+    SPI_DONE
+  };
+
+  uint8_t mem[ENC28J60_EMULATOR_MEMSIZE];
+  uint8_t regs[0x80];
+  uint16_t phyregs[0x20];
+  uint8_t pktcnt;
+  uint16_t rxwrpt;
+
+  spi_state state;
+  uint8_t argument;
+  bool dummy;
+  bool selected;
+  unsigned int dmaPending;
+  uint8_t cs;
+  bool intLevel;
+
+  static Enc28J60Emulator* attached;
+  static uint8_t spiTransfer(uint8_t data);
+  static void pinWrite(uint8_t pin, uint8_t val);
+
+  void reset();
+  void updateInterrupt();
+  uint8_t transfer(uint8_t data);
+  uint8_t index(uint8_t address) const;
+  static bool isMacMii(uint8_t index);
+  uint8_t readRegister(uint8_t address);
+  void writeRegister(uint8_t address, uint8_t data);
+  uint16_t get16(uint8_t index) const;
+  void set16(uint8_t index, uint16_t value);
+  uint16_t rxNext(uint16_t address) const;
+
+  void transmit();
+  void runDma();
+  bool accept(const uint8_t* frame, uint16_t len) const;
+  static uint32_t crc32(const uint8_t* data, uint16_t len);
+};
+
+#endif
@@ -0,0 +1,74 @@
+/*
+ enc28j60_node.cpp - entry points of a node module on the ENC28J60 emulator.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Arduino.h"
+#include "host_hw.h"
+#include "Enc28J60Network.h"
+#include "enc28j60_emulator.h"
+#include "virtual_node.h"
+
+void setup();
+void loop();
+
+static Enc28J60Emulator enc;
+static vnode_send_fn node_send;
+static vnode_poll_fn node_poll;
+static void* node_ctx;
+
+static void
+poll_harness()
+{
+  node_poll(node_ctx);
+}
+
+// like virtual_node.cpp, but the stack runs on Enc28J60Network and the
+// emulated chip, so every SPI byte costs time on the nodes clock
+VNODE_EXPORT void
+vnode_connect(vnode_send_fn send, vnode_poll_fn poll, void* ctx)
+{
+  node_send = send;
+  node_poll = poll;
+  node_ctx = ctx;
+  enc.attach(ENC28J60_CONTROL_CS);
+  enc.onTransmit = [](const uint8_t* frame, uint16_t len) { node_send(node_ctx, frame, len); };
+  host_poll = poll_harness;
+}
+
+VNODE_EXPORT bool
+vnode_deliver(const uint8_t* frame, uint16_t len)
+{
+  return enc.inject(frame, len);
+}
+
+VNODE_EXPORT void
+vnode_clock(unsigned long long micros)
+{
+  if (micros > host_clock())
+    host_advance_micros(micros - host_clock());
+}
+
+VNODE_EXPORT void
+vnode_setup()
+{
+  setup();
+}
+
+VNODE_EXPORT void
+vnode_loop()
+{
+  loop();
+}
@@ -0,0 +1,447 @@
+/*
+ enc28j60_test.cpp - runs Enc28J60Network against the ENC28J60 emulator.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "Arduino.h"
+#include "Enc28J60Network.h"
+#include "UIPEthernet.h"
+#include "enc28j60_emulator.h"
+#include "host_hw.h"
+
+extern "C" {
+#include "enc28j60.h"
+}
+
+static int failures;
+
+#define CHECK(cond) do { if (!(cond)) { \
+    printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+    failures++; } } while(0)
+
+static uint8_t mac[6] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05 };
+
+static Enc28J60Emulator enc;
+
+static void
+frame(uint8_t* buf, uint16_t len, const uint8_t* dest, uint16_t type, uint8_t seed)
+{
+  memcpy(buf, dest, 6);
+  memcpy(buf + 6, "\x02\x00\x00\x00\x00\x01", 6);
+  buf[12] = type >> 8;
+  buf[13] = type & 0xFF;
+  for (uint16_t i = 14; i < len; i++)
+    buf[i] = seed + i;
+}
+
+static uint16_t
+reference_chksum(const uint8_t* data, uint16_t len)
+{
+  uint32_t sum = 0;
+  for (uint16_t i = 0; i < len; i++)
+    sum += i & 1 ? data[i] : data[i] << 8;
+  while (sum >> 16)
+    sum = (sum & 0xFFFF) + (sum >> 16);
+  return sum;
+}
+
+static void
+test_init()
+{
+  Enc28J60Network::init(mac);
+  CHECK(enc.reg16(ERXSTL) == RXSTART_INIT);
+  CHECK(enc.reg16(ERXNDL) == RXSTOP_INIT);
+  CHECK(enc.reg(MAADR5) == mac[0]);
+  CHECK(enc.reg(MAADR0) == mac[5]);
+  CHECK(enc.reg(MACON1) & MACON1_MARXEN);
+  CHECK(enc.reg(ECON1) & ECON1_RXEN);
+  CHECK(enc.reg(ERXFCON) == UIP_RECEIVEFILTER_DEFAULT);
+  CHECK(enc.phy(PHCON2) == PHCON2_HDLDIS);
+  CHECK(enc.phy(PHLCON) == 0x476);
+  CHECK(Enc28J60.getrev() == 0x06);
+  CHECK(Enc28J60.linkStatus());
+}
+
+static void
+test_receive()
+{
+  Enc28J60Network::init(mac);
+  uint8_t buf[600], rd[600];
+  unsigned long frames = Enc28J60Network::stats().rxFrames;
+  // enough frames to wrap around the receivebuffer several times
+  for (uint8_t n = 0; n < 20; n++)
+    {
+      uint16_t len = 100 + n * 23;
+      frame(buf, len, mac, 0x0800, n);
+      CHECK(enc.inject(buf, len));
+      memhandle h = Enc28J60Network::receivePacket();
+      CHECK(h == UIP_RECEIVEBUFFERHANDLE);
+      CHECK(Enc28J60Network::blockSize(h) == len);
+      memset(rd, 0, sizeof(rd));
+      CHECK(Enc28J60Network::readPacket(h, 0, rd, len) == len);
+      CHECK(memcmp(buf, rd, len) == 0);
+      // checksum over the ring, odd start and length
+      CHECK(Enc28J60Network::chksum(0, h, 15, len - 20) == reference_chksum(buf + 15, len - 20));
+      // reception paused for the checksum engine only
+      CHECK(enc.reg(ECON1) & ECON1_RXEN);
+      Enc28J60Network::freePacket();
+    }
+  CHECK(Enc28J60Network::stats().rxFrames == frames + 20);
+  CHECK(enc.packetCount() == 0);
+  CHECK(Enc28J60Network::receivePacket() == NOBLOCK);
+  Enc28J60Network::resetStats();
+  CHECK(Enc28J60Network::stats().rxFrames == 0);
+  CHECK(Enc28J60Network::spiOperations() == 0);
+}
+
+#if UIP_HW_CHECKSUM
+static void
+test_chksum_timeout()
+{
+  Enc28J60Network::init(mac);
+  Enc28J60Network::resetStats();
+  uint8_t buf[500];
+  frame(buf, sizeof(buf), mac, 0x0800, 7);
+  CHECK(enc.inject(buf, sizeof(buf)));
+  memhandle h = Enc28J60Network::receivePacket();
+  CHECK(h == UIP_RECEIVEBUFFERHANDLE);
+  uint16_t sum = reference_chksum(buf + 14, sizeof(buf) - 14);
+
+  // a frame that never ends: the receiver doesn't go idle
+  enc.rxBusy = true;
+  CHECK(Enc28J60Network::chksum(0, h, 14, sizeof(buf) - 14) == sum);
+  enc.rxBusy = false;
+  CHECK(Enc28J60Network::stats().chksumTimeouts == 1);
+  CHECK(Enc28J60Network::stats().rxPauses == 1);
+  CHECK(Enc28J60Network::stats().rxPauseWaits == 1);
+  CHECK(enc.reg(ECON1) & ECON1_RXEN);
+
+  // the checksum engine hangs
+  enc.dmaLatency = 60000;
+  CHECK(Enc28J60Network::chksum(0, h, 14, sizeof(buf) - 14) == sum);
+  enc.dmaLatency = 2;
+  CHECK(Enc28J60Network::stats().chksumTimeouts == 2);
+  CHECK(!(enc.reg(ECON1) & (ECON1_DMAST | ECON1_CSUMEN)));
+  CHECK(enc.reg(ECON1) & ECON1_RXEN);
+
+  // and works again
+  CHECK(Enc28J60Network::chksum(0, h, 15, 301) == reference_chksum(buf + 15, 301));
+  CHECK(Enc28J60Network::stats().chksumTimeouts == 2);
+  CHECK(Enc28J60Network::stats().rxPauses == 3);
+  CHECK(Enc28J60Network::stats().rxPauseWaits == 1);
+  Enc28J60Network::freePacket();
+}
+#endif
+
+static void
+test_filter()
+{
+  Enc28J60Network::init(mac);
+  uint8_t buf[64];
+  static const uint8_t broadcast[6] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+  static const uint8_t other[6] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x06 };
+  frame(buf, 60, other, 0x0800, 0);
+  CHECK(!enc.inject(buf, 60));
+  // arp broadcasts pass the pattern match, other broadcasts only on demand
+  frame(buf, 42, broadcast, 0x0806, 0);
+  CHECK(enc.inject(buf, 42));
+  frame(buf, 60, broadcast, 0x0800, 0);
+  CHECK(!enc.inject(buf, 60));
+  Enc28J60Network::enableBroadcast();
+  CHECK(enc.inject(buf, 60));
+  Enc28J60Network::disableBroadcast();
+  CHECK(!enc.inject(buf, 60));
+  // multicast through the hash table
+  static const uint8_t group[6] = { 0x01, 0x00, 0x5e, 0x01, 0x02, 0x03 };
+  frame(buf, 60, group, 0x0800, 0);
+  CHECK(!enc.inject(buf, 60));
+  Enc28J60Network::addHashFilter(group);
+  Enc28J60Network::setReceiveFilter(UIP_RECEIVEFILTER_DEFAULT | ERXFCON_HTEN);
+  CHECK(enc.inject(buf, 60));
+  Enc28J60Network::setReceiveFilter(UIP_RECEIVEFILTER_DEFAULT);
+  while (Enc28J60Network::receivePacket() != NOBLOCK)
+    Enc28J60Network::freePacket();
+}
+
+static void
+test_transmit()
+{
+  Enc28J60Network::init(mac);
+  enc.transmitted.clear();
+  uint8_t buf[300];
+  unsigned long frames = Enc28J60Network::stats().txFrames;
+  for (uint8_t n = 0; n < 5; n++)
+    {
+      frame(buf, sizeof(buf), mac, 0x0800, n);
+      memhandle h = Enc28J60Network::allocBlock(sizeof(buf) + UIP_SENDBUFFER_OFFSET + UIP_SENDBUFFER_PADDING);
+      CHECK(h != NOBLOCK);
+      Enc28J60Network::writePacket(h, UIP_SENDBUFFER_OFFSET, buf, sizeof(buf));
+      CHECK(Enc28J60Network::sendPacket(h));
+      Enc28J60Network::pollTransmit();
+      CHECK(enc.transmitted.size() == n + 1u);
+      CHECK(enc.transmitted.back().size() == sizeof(buf));
+      CHECK(memcmp(enc.transmitted.back().data(), buf, sizeof(buf)) == 0);
+    }
+  CHECK(Enc28J60Network::txQueueDepth() == 0);
+  CHECK(Enc28J60Network::stats().txFrames == frames + 5);
+}
+
+static void
+test_copy()
+{
+  Enc28J60Network::init(mac);
+  uint8_t buf[500], rd[400];
+  // move the ring pointers close to the end so the copy source wraps
+  for (uint8_t n = 0; n < 4; n++)
+    {
+      frame(buf, 500, mac, 0x0800, n);
+      enc.inject(buf, 500);
+      Enc28J60Network::receivePacket();
+      Enc28J60Network::freePacket();
+    }
+  frame(buf, sizeof(rd), mac, 0x0800, 42);
+  CHECK(enc.inject(buf, sizeof(rd)));
+  // write pointer wrapped, so did the packet
+  CHECK(enc.reg16(ERXWRPTL) < 1024);
+  memhandle h = Enc28J60Network::receivePacket();
+  CHECK(h == UIP_RECEIVEBUFFERHANDLE);
+  unsigned long waits = Enc28J60Network::stats().dmaWaits;
+  memhandle b = Enc28J60Network::allocBlock(sizeof(rd));
+  CHECK(b != NOBLOCK);
+  Enc28J60Network::copyPacket(b, 0, h, 0, sizeof(rd));
+  // the copy runs in the background, the read has to wait for it
+  memset(rd, 0, sizeof(rd));
+  Enc28J60Network::readPacket(b, 0, rd, sizeof(rd));
+  CHECK(memcmp(buf, rd, sizeof(rd)) == 0);
+  CHECK(Enc28J60Network::stats().dmaWaits == waits + 1);
+  CHECK(Enc28J60Network::chksum(0, b, 1, 301) == reference_chksum(buf + 1, 301));
+  Enc28J60Network::freePacket();
+  Enc28J60Network::freeBlock(b);
+}
+
+static void
+test_chain()
+{
+  Enc28J60Network::init(mac);
+  enc.transmitted.clear();
+  // fragment the pool: no gap takes the frame in one piece
+  memhandle b[MEMPOOL_NUM_MEMBLOCKS];
+  int n = 0;
+  while ((b[n] = Enc28J60Network::allocBlock(1000)) != NOBLOCK)
+    n++;
+  b[n++] = Enc28J60Network::allocBlock(Enc28J60Network::freeBytes());
+  CHECK(n >= 5);
+  Enc28J60Network::freeBlock(b[1]);
+  Enc28J60Network::freeBlock(b[3]);
+  uint8_t buf[1400], rd[1400];
+  frame(buf, sizeof(buf), mac, 0x0800, 5);
+  uint16_t size = sizeof(buf) + UIP_SENDBUFFER_OFFSET + UIP_SENDBUFFER_PADDING;
+  memhandle h = Enc28J60Network::allocChain(size);
+  CHECK(h != NOBLOCK);
+  CHECK(Enc28J60Network::nextExtent(h) != NOBLOCK);
+  CHECK(Enc28J60Network::blockSize(h) == size);
+  // written and read across the extents
+  Enc28J60Network::writePacket(h, UIP_SENDBUFFER_OFFSET, buf, sizeof(buf));
+  memset(rd, 0, sizeof(rd));
+  CHECK(Enc28J60Network::readPacket(h, UIP_SENDBUFFER_OFFSET, rd, sizeof(rd)) == sizeof(rd));
+  CHECK(memcmp(buf, rd, sizeof(rd)) == 0);
+  // the first extent ends 999 bytes in: the second one starts on an odd offset
+  CHECK(Enc28J60Network::chksum(0, h, UIP_SENDBUFFER_OFFSET, sizeof(buf) - 1)
+      == reference_chksum(buf, sizeof(buf) - 1));
+  CHECK(Enc28J60Network::chksum(0, h, UIP_SENDBUFFER_OFFSET + 1, sizeof(buf) - 1)
+      == reference_chksum(buf + 1, sizeof(buf) - 1));
+  // copied in one piece for the transmitter
+  Enc28J60Network::freeBlock(b[2]);
+  CHECK(Enc28J60Network::sendPacket(h));
+  Enc28J60Network::pollTransmit();
+  CHECK(enc.transmitted.size() == 1);
+  CHECK(enc.transmitted.back().size() == sizeof(buf));
+  CHECK(memcmp(enc.transmitted.back().data(), buf, sizeof(buf)) == 0);
+  CHECK(Enc28J60Network::poolStats().linearized == 1);
+  for (int i = 0; i < n; i++)
+    if (i < 1 || i > 3)
+      Enc28J60Network::freeBlock(b[i]);
+  CHECK(Enc28J60Network::liveBlocks() == 0);
+}
+
+static void
+test_spi_accounting()
+{
+  Enc28J60Network::init(mac);
+  unsigned long bytes = enc.spiBytes - Enc28J60Network::stats().spiBytes;
+  unsigned long ops = enc.spiOps - Enc28J60Network::stats().spiOps;
+  uint8_t buf[200];
+  frame(buf, sizeof(buf), mac, 0x0800, 7);
+  enc.inject(buf, sizeof(buf));
+  memhandle h = Enc28J60Network::receivePacket();
+  Enc28J60Network::readPacket(h, 0, buf, sizeof(buf));
+  Enc28J60Network::freePacket();
+  // the drivers own accounting matches what the chip saw
+  CHECK(enc.spiBytes - Enc28J60Network::stats().spiBytes == bytes);
+  CHECK(enc.spiOps - Enc28J60Network::stats().spiOps == ops);
+}
+
+static void
+test_alloc_failed()
+{
+  Enc28J60Network::init(mac);
+  unsigned long failures = Enc28J60Network::poolStats().allocFailures;
+  // the pool runs out of memory before it runs out of handles
+  memhandle b[MEMPOOL_NUM_MEMBLOCKS];
+  int n = 0;
+  while (n < MEMPOOL_NUM_MEMBLOCKS && (b[n] = Enc28J60Network::allocBlock(1024)) != NOBLOCK)
+    n++;
+  CHECK(n < MEMPOOL_NUM_MEMBLOCKS);
+  CHECK(Enc28J60Network::poolStats().allocFailures == failures + 1);
+  while (n--)
+    Enc28J60Network::freeBlock(b[n]);
+}
+
+static void
+test_profile()
+{
+  Enc28J60Network::init(mac);
+  Enc28J60Profile::reset();
+  unsigned long bytes = Enc28J60Network::stats().spiBytes;
+  uint8_t buf[200];
+  frame(buf, sizeof(buf), mac, 0x0800, 3);
+  enc.inject(buf, sizeof(buf));
+  memhandle h = Enc28J60Network::receivePacket();
+  memhandle b = Enc28J60Network::allocBlock(sizeof(buf));
+  Enc28J60Network::copyPacket(b, 0, h, 0, sizeof(buf));
+  Enc28J60Network::freePacket();
+  // has to wait for the copy
+  Enc28J60Network::readPacket(b, 0, buf, sizeof(buf));
+  Enc28J60Network::freeBlock(b);
+  Enc28J60.linkStatus();
+  struct enc28j60_profile_entry* sites = Enc28J60Profile::sites;
+  CHECK(sites[ENC28J60_PROFILE_RECEIVE].calls == 1);
+  CHECK(sites[ENC28J60_PROFILE_RECEIVE].spiBytes > 0);
+  CHECK(sites[ENC28J60_PROFILE_COPY].calls == 1);
+  CHECK(sites[ENC28J60_PROFILE_FREE].calls == 1);
+  CHECK(sites[ENC28J60_PROFILE_READ].spiBytes >= sizeof(buf));
+  CHECK(sites[ENC28J60_PROFILE_READ].waitMicros > 0);
+  // linkStatus() is all PHY access
+  CHECK(sites[ENC28J60_PROFILE_PHY].calls == 1);
+  CHECK(sites[ENC28J60_PROFILE_OTHER].spiBytes == 0);
+  Enc28J60Profile::dump(Serial);
+  unsigned long total = 0;
+  for (int i = 0; i < ENC28J60_PROFILE_SITES; i++)
+    total += sites[i].spiBytes;
+  CHECK(total == Enc28J60Network::stats().spiBytes - bytes);
+}
+
+// a datagram the driver can't linearize is dropped, the socket must not
+// keep (and later free) the handle
+static void
+test_udp_send_failed()
+{
+  UIPEthernet.begin(mac, IPAddress(192,168,0,2));
+  EthernetUDP udp;
+  CHECK(udp.begin(5000));
+  // fill the pool, then free every other block: the gaps fit a chained
+  // datagram, but then the rest doesn't fit its linear copy
+  memhandle b[MEMPOOL_NUM_MEMBLOCKS];
+  int n = 0;
+  while (n < MEMPOOL_NUM_MEMBLOCKS && (b[n] = Enc28J60Network::allocBlock(500)) != NOBLOCK)
+    n++;
+  if (Enc28J60Network::freeBytes())
+    b[n++] = Enc28J60Network::allocBlock(Enc28J60Network::freeBytes());
+  CHECK(n >= 8 && Enc28J60Network::freeBytes() == 0);
+  for (int i = 0; i < 8; i += 2)
+    {
+      Enc28J60Network::freeBlock(b[i]);
+      b[i] = NOBLOCK;
+    }
+  unsigned long chained = Enc28J60Network::poolStats().chained;
+  uint8_t buf[1000];
+  memset(buf, 0x55, sizeof(buf));
+  CHECK(udp.beginPacket(IPAddress(255,255,255,255), 9, sizeof(buf)));
+  CHECK(Enc28J60Network::poolStats().chained == chained + 1);
+  CHECK(udp.write(buf, sizeof(buf)) == sizeof(buf));
+  CHECK(udp.endPacket() == 0);
+  // the handles of the dropped datagram are taken by other blocks now
+  memhandle x[MEMPOOL_MAX_EXTENTS];
+  for (int i = 0; i < MEMPOOL_MAX_EXTENTS; i++)
+    x[i] = Enc28J60Network::allocBlock(100);
+  udp.stop();
+  for (int i = 0; i < MEMPOOL_MAX_EXTENTS; i++)
+    {
+      CHECK(Enc28J60Network::blockSize(x[i]) == 100);
+      Enc28J60Network::freeBlock(x[i]);
+    }
+  while (n--)
+    Enc28J60Network::freeBlock(b[n]);
+  CHECK(Enc28J60Network::liveBlocks() == 0);
+}
+
+// enc28j60_int_test runs with UIP_INT_PIN and UIP_FULL_DUPLEX set
+static void
+test_config()
+{
+  Enc28J60Network::init(mac);
+#if UIP_FULL_DUPLEX
+  CHECK(enc.reg(MACON3) & MACON3_FULDPX);
+  CHECK(enc.phy(PHCON1) & PHCON1_PDPXMD);
+#else
+  CHECK(!(enc.reg(MACON3) & MACON3_FULDPX));
+  CHECK(!(enc.phy(PHCON1) & PHCON1_PDPXMD));
+#endif
+#if UIP_INT_PIN >= 0
+  while (Enc28J60Network::receivePacket() != NOBLOCK)
+    Enc28J60Network::freePacket();
+  // no SPI traffic while INT doesn't signal a packet
+  unsigned long ops = enc.spiOps;
+  CHECK(Enc28J60Network::receivePacket() == NOBLOCK);
+  CHECK(enc.spiOps == ops);
+  uint8_t buf[100];
+  frame(buf, sizeof(buf), mac, 0x0800, 0);
+  CHECK(enc.inject(buf, sizeof(buf)));
+  CHECK(Enc28J60Network::receivePacket() == UIP_RECEIVEBUFFERHANDLE);
+  Enc28J60Network::freePacket();
+#endif
+}
+
+int
+main()
+{
+  enc.attach(ENC28J60_CONTROL_CS);
+#if UIP_INT_PIN >= 0
+  enc.intPin = UIP_INT_PIN;
+#endif
+  test_init();
+  test_config();
+  test_receive();
+#if UIP_HW_CHECKSUM
+  test_chksum_timeout();
+#endif
+  test_filter();
+  test_transmit();
+  test_copy();
+  test_chain();
+  test_spi_accounting();
+  test_alloc_failed();
+  test_profile();
+  test_udp_send_failed();
+  if (failures)
+    {
+      printf("%d checks failed\n", failures);
+      return 1;
+    }
+  printf("all checks passed\n");
+  return 0;
+}
@@ -0,0 +1,154 @@
+/*
+ host_link.cpp - connects the ENC28J60 emulator to a network.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <net/if.h>
+#include <linux/if_tun.h>
+
+#include "host_link.h"
+#include "enc28j60_emulator.h"
+
+// largest frame the ENC28J60 is set up to receive
+#define HOST_LINK_MAXFRAME 1518
+
+HostLink::HostLink() :
+    enc(NULL)
+{
+}
+
+HostLink::~HostLink()
+{
+  detach();
+}
+
+void
+HostLink::attach(Enc28J60Emulator& e)
+{
+  detach();
+  enc = &e;
+  enc->onTransmit = [this](const uint8_t* frame, uint16_t len) { send(frame, len); };
+}
+
+void
+HostLink::detach()
+{
+  if (enc)
+    enc->onTransmit = nullptr;
+  enc = NULL;
+}
+
+void
+CallbackLink::receive(const uint8_t* frame, uint16_t len)
+{
+  pending.push_back(std::vector<uint8_t>(frame, frame + len));
+}
+
+int
+CallbackLink::poll()
+{
+  int n = 0;
+  while (!pending.empty())
+    {
+      if (enc)
+        enc->inject(pending.front().data(), pending.front().size());
+      pending.pop_front();
+      n++;
+    }
+  return n;
+}
+
+void
+CallbackLink::send(const uint8_t* frame, uint16_t len)
+{
+  if (onSend)
+    onSend(frame, len);
+}
+
+TapLink::TapLink() :
+    tapfd(-1)
+{
+}
+
+TapLink::~TapLink()
+{
+  close();
+}
+
+bool
+TapLink::open(const char* ifname)
+{
+  close();
+  tapfd = ::open("/dev/net/tun", O_RDWR | O_NONBLOCK);
+  if (tapfd < 0)
+    {
+      perror("/dev/net/tun");
+      return false;
+    }
+  struct ifreq ifr;
+  memset(&ifr, 0, sizeof(ifr));
+  ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
+  strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+  if (ioctl(tapfd, TUNSETIFF, &ifr) < 0)
+    {
+      perror(ifname);
+      close();
+      return false;
+    }
+  return true;
+}
+
+void
+TapLink::close()
+{
+  if (tapfd >= 0)
+    ::close(tapfd);
+  tapfd = -1;
+}
+
+int
+TapLink::poll()
+{
+  uint8_t frame[HOST_LINK_MAXFRAME];
+  int n = 0;
+  if (tapfd < 0)
+    return 0;
+  for (;;)
+    {
+      ssize_t len = read(tapfd, frame, sizeof(frame));
+      if (len < 0)
+        {
+          if (errno != EAGAIN && errno != EINTR)
+            perror("tap read");
+          return n;
+        }
+      if (enc && len >= 14)
+        enc->inject(frame, len);
+      n++;
+    }
+}
+
+void
+TapLink::send(const uint8_t* frame, uint16_t len)
+{
+  if (tapfd >= 0 && write(tapfd, frame, len) < 0)
+    perror("tap write");
+}
@@ -0,0 +1,94 @@
+/*
+ host_link.h - connects the ENC28J60 emulator to a network.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HOST_LINK_H
+#define HOST_LINK_H
+
+#include <stdint.h>
+#include <deque>
+#include <functional>
+#include <vector>
+
+class Enc28J60Emulator;
+
+/*
+ * The wire behind the emulated ENC28J60. A link takes over the
+ * emulators onTransmit and hands frames from the network to inject()
+ * when poll() is called, so the owner decides when frames arrive.
+ */
+class HostLink
+{
+public:
+  HostLink();
+  virtual ~HostLink();
+
+  void attach(Enc28J60Emulator& enc);
+  void detach();
+
+  // deliver frames that arrived from the network, returns their number
+  virtual int poll() = 0;
+
+protected:
+  Enc28J60Emulator* enc;
+
+  // a frame sent by the emulator
+  virtual void send(const uint8_t* frame, uint16_t len) = 0;
+};
+
+/*
+ * Link to code in the same process: sent frames go to onSend, frames
+ * passed to receive() are queued until the next poll().
+ */
+class CallbackLink : public HostLink
+{
+public:
+  std::function<void(const uint8_t* frame, uint16_t len)> onSend;
+
+  void receive(const uint8_t* frame, uint16_t len);
+  virtual int poll();
+
+protected:
+  virtual void send(const uint8_t* frame, uint16_t len);
+
+private:
+  std::deque<std::vector<uint8_t> > pending;
+};
+
+/*
+ * Link to a Linux TAP interface, so the stack talks to the host kernel
+ * and whatever is bridged to it. Needs CAP_NET_ADMIN or a TAP interface
+ * owned by the user (ip tuntap add dev tap0 mode tap user $USER).
+ */
+class TapLink : public HostLink
+{
+public:
+  TapLink();
+  virtual ~TapLink();
+
+  bool open(const char* ifname);
+  void close();
+  int fd() const { return tapfd; }
+  virtual int poll();
+
+protected:
+  virtual void send(const uint8_t* frame, uint16_t len);
+
+private:
+  int tapfd;
+};
+
+#endif
@@ -0,0 +1,687 @@
+/*
+ mempool_test.cpp - checks MemoryPool against a model of its blocks.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define MEMPOOLTEST_H
+
+#include <stdio.h>
+#include <string.h>
+#include <random>
+#include <vector>
+
+#include "mempool.h"
+
+#define POOL_START 0x100
+#define POOL_SIZE 0x1800
+
+static int failures;
+
+#define CHECK(cond) do { if (!(cond)) { \
+    printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+    failures++; } } while(0)
+
+// the buffer memory the pool hands out, moved around by compaction
+static uint8_t mem[0x2000];
+static unsigned long moves;
+
+void
+mempool_block_move_callback(memaddress dest, memaddress src, memaddress len)
+{
+  memmove(mem + dest, mem + src, len);
+  moves++;
+}
+
+struct expected
+{
+  memhandle handle;
+  memaddress size;
+  uint8_t fill;
+};
+
+class MemoryPoolTest
+{
+public:
+  static memaddress
+  begin(memhandle h)
+  {
+    return MemoryPool::blocks[h].begin;
+  }
+
+  // the address list is sorted, linked both ways and doesn't overlap,
+  // and every block with free space behind it is in the right free list
+  static void
+  checkStructure(const std::vector<expected>& allocated)
+  {
+    unsigned int count = 0;
+    memhandle prev = POOLSTART;
+    memaddress end = MemoryPool::blocks[POOLSTART].begin;
+    memaddress used = 0;
+    memaddress largest = 0;
+    for (memhandle h = MemoryPool::blocks[POOLSTART].nextblock; h != NOBLOCK; h = MemoryPool::blocks[h].nextblock)
+      {
+        memblock* b = &MemoryPool::blocks[h];
+        CHECK(b->prevblock == prev);
+        CHECK(b->begin >= end);
+        if (b->begin - end > largest)
+          largest = b->begin - end;
+        end = b->begin + b->size;
+        used += b->size;
+        prev = h;
+        count++;
+      }
+    CHECK(end <= POOL_START + POOL_SIZE);
+    if (POOL_START + POOL_SIZE - end > largest)
+      largest = POOL_START + POOL_SIZE - end;
+    // chained blocks take a memblock per extent
+    std::vector<memhandle> extents;
+    for (size_t i = 0; i < allocated.size(); i++)
+      {
+        CHECK(MemoryPool::blockSize(allocated[i].handle) == allocated[i].size);
+        for (memhandle h = allocated[i].handle; h != NOBLOCK; h = MemoryPool::nextExtent(h))
+          extents.push_back(h);
+      }
+    CHECK(count == extents.size());
+    CHECK(MemoryPool::liveBlocks() == count);
+    CHECK(MemoryPool::freeBytes() == POOL_SIZE - used);
+    CHECK(MemoryPool::largestFree() == largest);
+    unsigned int slots = 0;
+    for (memhandle h = MemoryPool::freeSlots; h != NOBLOCK; h = MemoryPool::blocks[h].nextblock)
+      slots++;
+    CHECK(count + slots == MEMPOOL_NUM_MEMBLOCKS);
+
+    unsigned int listed = 0;
+    for (uint8_t c = 0; c < MEMPOOL_CLASSES; c++)
+      {
+        CHECK(!(MemoryPool::freeClasses & (1 << c)) == (MemoryPool::freeLists[c] == 0xff));
+        memhandle prevfree = 0xff;
+        for (memhandle h = MemoryPool::freeLists[c]; h != 0xff; h = MemoryPool::blocks[h].nextfree)
+          {
+            memaddress free = MemoryPool::freeSize(h);
+            CHECK(free && MemoryPool::sizeClass(free) == c);
+            CHECK(MemoryPool::blocks[h].prevfree == prevfree);
+            prevfree = h;
+            listed++;
+          }
+      }
+    unsigned int withFree = MemoryPool::freeSize(POOLSTART) ? 1 : 0;
+    for (size_t i = 0; i < extents.size(); i++)
+      if (MemoryPool::freeSize(extents[i]))
+        withFree++;
+    CHECK(listed == withFree);
+  }
+};
+
+// the byte at position of a (chained) block
+static uint8_t*
+at(memhandle h, memaddress position)
+{
+  h = MemoryPool::extent(h, position);
+  return mem + MemoryPoolTest::begin(h) + position;
+}
+
+static void
+fill(memhandle h, uint8_t value)
+{
+  memaddress size = MemoryPool::blockSize(h);
+  for (memaddress i = 0; i < size; i++)
+    *at(h, i) = value + i;
+}
+
+// h starts with the contents e expects
+static bool
+starts(memhandle h, const expected& e)
+{
+  for (memaddress i = 0; i < e.size; i++)
+    if (*at(h, i) != (uint8_t)(e.fill + i))
+      return false;
+  return true;
+}
+
+static bool
+holds(const expected& e)
+{
+  return MemoryPool::blockSize(e.handle) == e.size && starts(e.handle, e);
+}
+
+static void
+test_random()
+{
+  MemoryPool::init(POOL_START, POOL_SIZE);
+  std::mt19937 random(7);
+  std::vector<expected> allocated;
+  unsigned long failed = 0;
+  for (int n = 0; n < 100000; n++)
+    {
+      unsigned int op = random() % 10;
+      if (op < 5)
+        {
+          memaddress size = random() % 3 ? random() % 600 + 1 : random() % 40;
+          memhandle h = random() % 4 ? MemoryPool::allocBlock(size) : MemoryPool::allocChain(size);
+          if (h == NOBLOCK)
+            {
+              failed++;
+              continue;
+            }
+          expected e = { h, size, (uint8_t)n };
+          fill(h, e.fill);
+          allocated.push_back(e);
+        }
+      else if (op < 9 && !allocated.empty())
+        {
+          size_t i = random() % allocated.size();
+          MemoryPool::freeBlock(allocated[i].handle);
+          allocated.erase(allocated.begin() + i);
+        }
+      else if (!allocated.empty())
+        {
+          // drop the front (as UIPUDP::read does) or cut the block down
+          expected& e = allocated[random() % allocated.size()];
+          memaddress position = e.size ? random() % e.size : 0;
+          bool chained = MemoryPool::nextExtent(e.handle) != NOBLOCK;
+          if (random() % 3 == 0)
+            {
+              // as UIPUDP::write() does
+              memaddress size = e.size + random() % 300;
+              memhandle h = MemoryPool::growBlock(e.handle, size);
+              if (h != NOBLOCK)
+                {
+                  CHECK(MemoryPool::blockSize(h) == size);
+                  CHECK(starts(h, e));
+                  e.handle = h;
+                  for (memaddress i = e.size; i < size; i++)
+                    *at(h, i) = e.fill + i;
+                  e.size = size;
+                }
+            }
+          else if (chained && random() % 2)
+            {
+              // as the drivers do before sending
+              memhandle h = MemoryPool::linearize(e.handle);
+              if (h != NOBLOCK)
+                {
+                  e.handle = h;
+                  CHECK(MemoryPool::nextExtent(h) == NOBLOCK);
+                  CHECK(holds(e));
+                }
+            }
+          else if (chained)
+            {
+              // chained blocks are only cut at the end
+              memaddress size = random() % (e.size + 1);
+              MemoryPool::resizeBlock(e.handle, 0, size);
+              e.size = size;
+            }
+          else if (random() % 2)
+            {
+              MemoryPool::resizeBlock(e.handle, position);
+              e.size -= position;
+              e.fill += position;
+            }
+          else
+            {
+              memaddress size = e.size - position ? random() % (e.size - position) : 0;
+              MemoryPool::resizeBlock(e.handle, position, size);
+              e.size = size;
+              e.fill += position;
+            }
+        }
+      // as tick() does when idle
+      if (n % 3 == 0)
+        MemoryPool::compactStep();
+      if (n % 97 == 0)
+        MemoryPoolTest::checkStructure(allocated);
+    }
+  MemoryPoolTest::checkStructure(allocated);
+  bool intact = true;
+  for (size_t i = 0; i < allocated.size(); i++)
+    intact &= holds(allocated[i]);
+  CHECK(intact);
+  // the mix has to exercise running out and compacting
+  CHECK(failed > 0);
+  CHECK(moves > 0);
+  CHECK(MemoryPool::poolStats().chained > 0);
+  CHECK(MemoryPool::poolStats().linearized > 0);
+  CHECK(MemoryPool::poolStats().grown > 0);
+  printf("%lu failed allocations, %lu blocks moved, %lu chained\n", failed, moves, MemoryPool::poolStats().chained);
+}
+
+static void
+test_handles()
+{
+  MemoryPool::init(POOL_START, POOL_SIZE);
+  memhandle h[MEMPOOL_NUM_MEMBLOCKS];
+  for (int i = 0; i < MEMPOOL_NUM_MEMBLOCKS; i++)
+    {
+      h[i] = MemoryPool::allocBlock(1);
+      CHECK(h[i] != NOBLOCK);
+    }
+  // out of handles with plenty of memory left
+  CHECK(MemoryPool::allocBlock(1) == NOBLOCK);
+  CHECK(MemoryPool::poolStats().noHandle == 1);
+  MemoryPool::freeBlock(h[3]);
+  // freeing twice (or handles never allocated) is ignored
+  MemoryPool::freeBlock(h[3]);
+  MemoryPool::freeBlock(0xff);
+  memhandle again = MemoryPool::allocBlock(1);
+  CHECK(again == h[3]);
+  CHECK(MemoryPool::allocBlock(1) == NOBLOCK);
+}
+
+static void
+test_fit()
+{
+  MemoryPool::init(POOL_START, POOL_SIZE);
+  memhandle a = MemoryPool::allocBlock(100);
+  memhandle b = MemoryPool::allocBlock(1000);
+  memhandle c = MemoryPool::allocBlock(100);
+  CHECK(MemoryPoolTest::begin(b) == POOL_START + 100);
+  MemoryPool::freeBlock(b);
+  // the hole b left is used again instead of the rest of the pool
+  memhandle d = MemoryPool::allocBlock(600);
+  CHECK(MemoryPoolTest::begin(d) == POOL_START + 100);
+  // exactly what is left, compacting first
+  memhandle e = MemoryPool::allocBlock(POOL_SIZE - 800);
+  CHECK(e != NOBLOCK);
+  CHECK(MemoryPoolTest::begin(c) == POOL_START + 700);
+  CHECK(MemoryPool::allocBlock(1) == NOBLOCK);
+  // an empty block fits anywhere
+  CHECK(MemoryPool::allocBlock(0) != NOBLOCK);
+  MemoryPool::freeBlock(a);
+  MemoryPool::freeBlock(c);
+  MemoryPool::freeBlock(d);
+  MemoryPool::freeBlock(e);
+}
+
+static void
+test_compact_step()
+{
+  MemoryPool::init(POOL_START, POOL_SIZE);
+  std::vector<expected> allocated;
+  for (int i = 0; i < 40; i++)
+    {
+      expected e = { MemoryPool::allocBlock(140), 140, (uint8_t)i };
+      fill(e.handle, e.fill);
+      allocated.push_back(e);
+    }
+  // the gap at the end is too small
+  CHECK(!MemoryPool::compactStep());
+  // every other block freed: room enough, but not in one piece
+  for (int i = 39; i >= 0; i -= 2)
+    {
+      MemoryPool::freeBlock(allocated[i - 1].handle);
+      allocated.erase(allocated.begin() + i - 1);
+    }
+  unsigned long before = moves;
+  int steps = 0;
+  while (MemoryPool::compactStep())
+    {
+      CHECK(moves == before + ++steps);
+      MemoryPoolTest::checkStructure(allocated);
+    }
+  // moved just enough blocks to collect the gap
+  CHECK(steps > 0 && steps < 20);
+  CHECK((POOL_SIZE - 40 * 140) + steps * 140 >= MEMPOOL_COMPACT_GAP);
+  before = moves;
+  memhandle h = MemoryPool::allocBlock(MEMPOOL_COMPACT_GAP);
+  CHECK(h != NOBLOCK);
+  CHECK(moves == before);
+  bool intact = true;
+  for (size_t i = 0; i < allocated.size(); i++)
+    intact &= holds(allocated[i]);
+  CHECK(intact);
+}
+
+static void
+test_compact_on_alloc()
+{
+#if MEMPOOL_COMPACT_ON_ALLOC > 0
+  MemoryPool::init(POOL_START, POOL_SIZE);
+  std::vector<expected> allocated;
+  for (int i = 0; i < 40; i++)
+    {
+      expected e = { MemoryPool::allocBlock(140), 140, (uint8_t)i };
+      fill(e.handle, e.fill);
+      allocated.push_back(e);
+    }
+  for (int i = 39; i >= 0; i -= 2)
+    {
+      MemoryPool::freeBlock(allocated[i - 1].handle);
+      allocated.erase(allocated.begin() + i - 1);
+    }
+  // no more than MEMPOOL_COMPACT_ON_ALLOC blocks are moved per allocation,
+  // the next one goes on where the last stopped
+  unsigned long before = moves;
+  memhandle h = NOBLOCK;
+  int attempts = 0;
+  while (h == NOBLOCK && attempts++ < 20)
+    {
+      h = MemoryPool::allocBlock(1000);
+      CHECK(moves - before <= MEMPOOL_COMPACT_ON_ALLOC);
+      before = moves;
+    }
+  CHECK(h != NOBLOCK);
+  CHECK(attempts > 1 || MEMPOOL_COMPACT_ON_ALLOC * 140 >= 1000);
+  CHECK(MemoryPool::poolStats().compactions == 0);
+  expected e = { h, 1000, 40 };
+  fill(e.handle, e.fill);
+  allocated.push_back(e);
+  MemoryPoolTest::checkStructure(allocated);
+  bool intact = true;
+  for (size_t i = 0; i < allocated.size(); i++)
+    intact &= holds(allocated[i]);
+  CHECK(intact);
+#endif
+}
+
+static void
+test_stats()
+{
+  MemoryPool::init(POOL_START, POOL_SIZE);
+  memhandle a = MemoryPool::allocBlock(1000);
+  memhandle b = MemoryPool::allocBlock(2000);
+  memhandle c = MemoryPool::allocBlock(3000);
+  CHECK(MemoryPool::poolStats().allocs == 3);
+  CHECK(MemoryPool::poolStats().usedMax == 6000);
+  CHECK(MemoryPool::poolStats().blocksMax == 3);
+  MemoryPool::freeBlock(a);
+  MemoryPool::freeBlock(c);
+  CHECK(MemoryPool::liveBlocks() == 1);
+  CHECK(MemoryPool::freeBytes() == POOL_SIZE - 2000);
+  CHECK(MemoryPool::largestFree() == POOL_SIZE - 3000);
+  // too large even when compacted
+  CHECK(MemoryPool::allocBlock(POOL_SIZE) == NOBLOCK);
+  CHECK(MemoryPool::poolStats().compactions == 0);
+  CHECK(MemoryPool::poolStats().allocFailures == 1);
+  CHECK(MemoryPool::poolStats().failedBySize[MEMPOOL_SIZE_BUCKETS - 1] == 1);
+  CHECK(MemoryPool::poolStats().lastFailedSize == POOL_SIZE);
+  // fits once b is moved down
+  memhandle d = MemoryPool::allocBlock(POOL_SIZE - 2000);
+  CHECK(d != NOBLOCK);
+  CHECK(MemoryPool::poolStats().compactions == 0);
+  CHECK(MemoryPool::poolStats().compactSteps == 1);
+  CHECK(MemoryPool::poolStats().bytesMoved == 2000);
+  CHECK(MemoryPool::poolStats().usedMax == POOL_SIZE);
+  CHECK(MemoryPool::largestFree() == 0);
+  CHECK(MemoryPool::allocBlock(10) == NOBLOCK);
+  CHECK(MemoryPool::poolStats().failedBySize[0] == 1);
+  CHECK(MemoryPool::poolStats().noHandle == 0);
+  MemoryPool::freeBlock(b);
+  CHECK(MemoryPool::poolStats().blocksMax == 3);
+  // counters start over, the high-water marks from what is in use
+  MemoryPool::resetPoolStats();
+  CHECK(MemoryPool::poolStats().allocs == 0);
+  CHECK(MemoryPool::poolStats().allocFailures == 0);
+  CHECK(MemoryPool::poolStats().bytesMoved == 0);
+  CHECK(MemoryPool::poolStats().usedMax == POOL_SIZE - 2000);
+  CHECK(MemoryPool::poolStats().blocksMax == 1);
+  MemoryPool::freeBlock(d);
+}
+
+static void
+test_quota()
+{
+  MemoryPool::init(POOL_START, POOL_SIZE);
+  memhandle u0 = MemoryPool::allocBlock(2000, MEMPOOL_OWNER_UDP(0));
+  memhandle u1 = MemoryPool::allocBlock(2000, MEMPOOL_OWNER_UDP(1));
+  CHECK(u0 != NOBLOCK && u1 != NOBLOCK);
+  // over the udp quota though there is room
+  CHECK(MemoryPool::allocBlock(100, MEMPOOL_OWNER_UDP(2)) == NOBLOCK);
+  CHECK(MemoryPool::poolStats().quotaDenied == 1);
+  // a socket can't hold more than its quota
+  memhandle t0 = MemoryPool::allocBlock(1000, MEMPOOL_OWNER_TCP(0));
+  CHECK(t0 != NOBLOCK);
+  CHECK(MemoryPool::allocBlock(MEMPOOL_SOCKET_QUOTA - 999, MEMPOOL_OWNER_TCP(0)) == NOBLOCK);
+  memhandle t1 = MemoryPool::allocBlock(MemoryPool::freeBytes() - MEMPOOL_CONTROL_RESERVE - 50, MEMPOOL_OWNER_TCP(1));
+  CHECK(t1 != NOBLOCK);
+  CHECK(MemoryPool::ownerBytes(MEMPOOL_OWNER_TCP(0)) == 1000);
+  CHECK(MemoryPool::ownerBytes(MEMPOOL_OWNER_UDP(1)) == 2000);
+  // the rest is reserved for the stack
+  memaddress free = MemoryPool::freeBytes();
+  CHECK(free < MEMPOOL_CONTROL_RESERVE + 100);
+  CHECK(MemoryPool::allocBlock(100, MEMPOOL_OWNER_TCP(2)) == NOBLOCK);
+  memhandle c = MemoryPool::allocBlock(free);
+  CHECK(c != NOBLOCK);
+  CHECK(MemoryPool::poolStats().quotaDenied == 3);
+  // returned to the owner on free and resize
+  MemoryPool::resizeBlock(t0, 100);
+  CHECK(MemoryPool::ownerBytes(MEMPOOL_OWNER_TCP(0)) == 900);
+  MemoryPool::resizeBlock(t0, 0, 500);
+  CHECK(MemoryPool::ownerBytes(MEMPOOL_OWNER_TCP(0)) == 500);
+  MemoryPool::freeBlock(u0);
+  CHECK(MemoryPool::ownerBytes(MEMPOOL_OWNER_UDP(0)) == 0);
+  memhandle u2 = MemoryPool::allocBlock(100, MEMPOOL_OWNER_UDP(2));
+  CHECK(u2 != NOBLOCK);
+  MemoryPool::freeBlock(u1);
+  MemoryPool::freeBlock(u2);
+  MemoryPool::freeBlock(t0);
+  MemoryPool::freeBlock(t1);
+  MemoryPool::freeBlock(c);
+  for (uint8_t i = 0; i < MEMPOOL_NUM_OWNERS; i++)
+    CHECK(MemoryPool::ownerBytes(i) == 0);
+}
+
+static void
+test_overhead()
+{
+  MemoryPool::init(POOL_START, POOL_SIZE);
+  // room for frame headers and padding counts against the pool only
+  memhandle t = MemoryPool::allocBlock(MEMPOOL_SOCKET_QUOTA + 62, MEMPOOL_OWNER_TCP(0), 62);
+  CHECK(t != NOBLOCK);
+  CHECK(MemoryPool::ownerBytes(MEMPOOL_OWNER_TCP(0)) == MEMPOOL_SOCKET_QUOTA);
+  CHECK(MemoryPool::freeBytes() == POOL_SIZE - MEMPOOL_SOCKET_QUOTA - 62);
+  CHECK(!MemoryPool::withinQuota(63, MEMPOOL_OWNER_TCP(0), 62));
+  MemoryPool::resizeBlock(t, 100);
+  CHECK(MemoryPool::ownerBytes(MEMPOOL_OWNER_TCP(0)) == MEMPOOL_SOCKET_QUOTA - 100);
+  MemoryPool::freeBlock(t);
+  CHECK(MemoryPool::ownerBytes(MEMPOOL_OWNER_TCP(0)) == 0);
+}
+
+static void
+test_chain()
+{
+  MemoryPool::init(POOL_START, POOL_SIZE);
+  memhandle a = MemoryPool::allocBlock(1000);
+  memhandle b = MemoryPool::allocBlock(1200);
+  memhandle c = MemoryPool::allocBlock(1000);
+  memhandle d = MemoryPool::allocBlock(800);
+  memhandle e = MemoryPool::allocBlock(1000);
+  // leaves room for the reserve
+  memhandle f = MemoryPool::allocBlock(MemoryPool::freeBytes() - MEMPOOL_CONTROL_RESERVE);
+  MemoryPool::freeBlock(b);
+  MemoryPool::freeBlock(d);
+  // no gap is large enough, the block is made of both instead of compacting
+  unsigned long moved = moves;
+  expected x = { MemoryPool::allocChain(1550, MEMPOOL_OWNER_UDP(0)), 1550, 7 };
+  CHECK(x.handle != NOBLOCK);
+  CHECK(moves == moved);
+  CHECK(MemoryPool::poolStats().chained == 1);
+  CHECK(MemoryPoolTest::begin(x.handle) == POOL_START + 1000);
+  memhandle tail = MemoryPool::nextExtent(x.handle);
+  CHECK(tail != NOBLOCK && MemoryPool::nextExtent(tail) == NOBLOCK);
+  CHECK(MemoryPoolTest::begin(tail) == POOL_START + 3200);
+  CHECK(MemoryPool::blockSize(x.handle) == 1550);
+  CHECK(MemoryPool::ownerBytes(MEMPOOL_OWNER_UDP(0)) == 1550);
+  memaddress position = 1300;
+  CHECK(MemoryPool::extent(x.handle, position) == tail && position == 100);
+  fill(x.handle, x.fill);
+  CHECK(holds(x));
+  // cut at the end only
+  MemoryPool::resizeBlock(x.handle, 0, 1400);
+  x.size = 1400;
+  CHECK(holds(x));
+  CHECK(MemoryPool::ownerBytes(MEMPOOL_OWNER_UDP(0)) == 1400);
+  // not enough room for a copy
+  CHECK(MemoryPool::linearize(x.handle) == NOBLOCK);
+  CHECK(holds(x));
+  // grown in place into the space c leaves
+  MemoryPool::freeBlock(c);
+  CHECK(MemoryPool::linearize(x.handle) == x.handle);
+  CHECK(MemoryPool::nextExtent(x.handle) == NOBLOCK);
+  CHECK(MemoryPool::poolStats().linearized == 1);
+  CHECK(holds(x));
+  CHECK(MemoryPool::liveBlocks() == 4);
+  CHECK(MemoryPool::ownerBytes(MEMPOOL_OWNER_UDP(0)) == 1400);
+  MemoryPool::freeBlock(x.handle);
+  CHECK(MemoryPool::ownerBytes(MEMPOOL_OWNER_UDP(0)) == 0);
+  MemoryPool::freeBlock(a);
+  MemoryPool::freeBlock(e);
+  MemoryPool::freeBlock(f);
+  CHECK(MemoryPool::liveBlocks() == 0);
+  CHECK(MemoryPool::freeBytes() == POOL_SIZE);
+}
+
+static void
+test_grow()
+{
+  MemoryPool::init(POOL_START, POOL_SIZE);
+  expected x = { MemoryPool::allocBlock(100, MEMPOOL_OWNER_UDP(0)), 100, 3 };
+  memhandle a = MemoryPool::allocBlock(500);
+  memhandle b = MemoryPool::allocBlock(400);
+  fill(x.handle, x.fill);
+  MemoryPool::freeBlock(a);
+  // into the space behind it
+  CHECK(MemoryPool::growBlock(x.handle, 600) == x.handle);
+  CHECK(MemoryPool::nextExtent(x.handle) == NOBLOCK);
+  CHECK(MemoryPool::poolStats().grownInPlace == 1);
+  CHECK(starts(x.handle, x));
+  x.size = 600;
+  fill(x.handle, x.fill);
+  // b is in the way: another extent is chained to it
+  CHECK(MemoryPool::growBlock(x.handle, 1000) == x.handle);
+  memhandle tail = MemoryPool::nextExtent(x.handle);
+  CHECK(tail != NOBLOCK);
+  CHECK(MemoryPoolTest::begin(tail) == POOL_START + 1000);
+  CHECK(starts(x.handle, x));
+  // the last extent grows in place
+  CHECK(MemoryPool::growBlock(x.handle, 1100) == x.handle);
+  CHECK(MemoryPool::nextExtent(tail) == NOBLOCK);
+  CHECK(MemoryPool::poolStats().grownInPlace == 2);
+  CHECK(MemoryPool::ownerBytes(MEMPOOL_OWNER_UDP(0)) == 1100);
+  // over the quota the block is left alone
+  CHECK(MemoryPool::growBlock(x.handle, MEMPOOL_SOCKET_QUOTA + 1) == NOBLOCK);
+  CHECK(MemoryPool::blockSize(x.handle) == 1100);
+  // up to a full chain
+  memhandle c[MEMPOOL_MAX_EXTENTS - 1];
+  for (uint8_t i = 0; i < MEMPOOL_MAX_EXTENTS - 2; i++)
+    {
+      c[i] = MemoryPool::allocBlock(10);
+      CHECK(MemoryPool::growBlock(x.handle, 1200 + 100 * i) == x.handle);
+    }
+  memhandle last = x.handle;
+  for (uint8_t i = 1; i < MEMPOOL_MAX_EXTENTS; i++)
+    last = MemoryPool::nextExtent(last);
+  CHECK(last != NOBLOCK && MemoryPool::nextExtent(last) == NOBLOCK);
+  x.size = MemoryPool::blockSize(x.handle);
+  fill(x.handle, x.fill);
+  // which is copied into a new block then
+  c[MEMPOOL_MAX_EXTENTS - 2] = MemoryPool::allocBlock(10);
+  memhandle moved = MemoryPool::growBlock(x.handle, x.size + 100);
+  CHECK(moved != NOBLOCK && moved != x.handle);
+  CHECK(MemoryPool::nextExtent(moved) == NOBLOCK);
+  CHECK(MemoryPool::blockSize(moved) == x.size + 100);
+  CHECK(starts(moved, x));
+  CHECK(MemoryPool::poolStats().grown == 3 + MEMPOOL_MAX_EXTENTS - 2 + 1);
+  CHECK(MemoryPool::ownerBytes(MEMPOOL_OWNER_UDP(0)) == x.size + 100);
+  MemoryPool::freeBlock(moved);
+  MemoryPool::freeBlock(b);
+  for (uint8_t i = 0; i < MEMPOOL_MAX_EXTENTS - 1; i++)
+    MemoryPool::freeBlock(c[i]);
+  CHECK(MemoryPool::liveBlocks() == 0);
+  CHECK(MemoryPool::ownerBytes(MEMPOOL_OWNER_UDP(0)) == 0);
+}
+
+static void
+test_grow_quota()
+{
+  MemoryPool::init(POOL_START, POOL_SIZE);
+  // a full chain with 50 bytes of overhead, c keeps the extents from
+  // growing in place
+  expected x = { MemoryPool::allocBlock(400, MEMPOOL_OWNER_UDP(0), 50), 400, 5 };
+  memhandle c[MEMPOOL_MAX_EXTENTS];
+  c[0] = MemoryPool::allocBlock(10);
+  for (uint8_t i = 1; i < MEMPOOL_MAX_EXTENTS; i++)
+    {
+      CHECK(MemoryPool::growBlock(x.handle, 400 * (i + 1)) == x.handle);
+      c[i] = MemoryPool::allocBlock(10);
+    }
+  x.size = 400 * MEMPOOL_MAX_EXTENTS;
+  fill(x.handle, x.fill);
+  CHECK(MemoryPool::ownerBytes(MEMPOOL_OWNER_UDP(0)) == x.size - 50);
+  // the old extents and the new block don't add up against the quota
+  CHECK(x.size - 50 + x.size + 100 > MEMPOOL_SOCKET_QUOTA);
+  memhandle moved = MemoryPool::growBlock(x.handle, x.size + 100);
+  CHECK(moved != NOBLOCK && moved != x.handle);
+  CHECK(MemoryPool::nextExtent(moved) == NOBLOCK);
+  CHECK(starts(moved, x));
+  CHECK(MemoryPool::ownerBytes(MEMPOOL_OWNER_UDP(0)) == x.size + 100 - 50);
+  MemoryPool::freeBlock(moved);
+  CHECK(MemoryPool::ownerBytes(MEMPOOL_OWNER_UDP(0)) == 0);
+  for (uint8_t i = 0; i < MEMPOOL_MAX_EXTENTS; i++)
+    MemoryPool::freeBlock(c[i]);
+  CHECK(MemoryPool::liveBlocks() == 0);
+}
+
+static void
+test_share()
+{
+  MemoryPool::init(POOL_START, POOL_SIZE);
+  memhandle h = MemoryPool::allocBlock(400, MEMPOOL_OWNER_TCP(0));
+  // queued on three more connections
+  for (int i = 0; i < 3; i++)
+    CHECK(MemoryPool::shareBlock(h) == h);
+  CHECK(MemoryPool::poolStats().shared == 3);
+  for (int i = 0; i < 3; i++)
+    {
+      MemoryPool::freeBlock(h);
+      CHECK(MemoryPool::liveBlocks() == 1);
+    }
+  CHECK(MemoryPool::ownerBytes(MEMPOOL_OWNER_TCP(0)) == 400);
+  // the last reference frees it, after that it can't be shared anymore
+  MemoryPool::freeBlock(h);
+  CHECK(MemoryPool::liveBlocks() == 0);
+  CHECK(MemoryPool::ownerBytes(MEMPOOL_OWNER_TCP(0)) == 0);
+  CHECK(MemoryPool::shareBlock(h) == NOBLOCK);
+  CHECK(MemoryPool::shareBlock(NOBLOCK) == NOBLOCK);
+  // a new block in the slot starts without references
+  memhandle g = MemoryPool::allocBlock(100);
+  CHECK(g == h);
+  MemoryPool::freeBlock(g);
+  CHECK(MemoryPool::liveBlocks() == 0);
+}
+
+int
+main()
+{
+  test_handles();
+  test_fit();
+  test_compact_step();
+  test_compact_on_alloc();
+  test_stats();
+  test_quota();
+  test_overhead();
+  test_chain();
+  test_grow();
+  test_grow_quota();
+  test_share();
+  test_random();
+  if (failures)
+    {
+      printf("%d checks failed\n", failures);
+      return 1;
+    }
+  printf("all checks passed\n");
+  return 0;
+}
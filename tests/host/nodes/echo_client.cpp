@@ -0,0 +1,90 @@
+/*
+ echo_client.cpp - VirtualEthernet node: checks the echo of 192.168.0.6:7.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <UIPEthernet.h>
+#include "virtual_node.h"
+
+#define ECHO_TOTAL 4096
+
+static uint8_t mac[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x07 };
+
+EthernetClient client;
+static long sent;
+static long verified;
+static long errors;
+static long inflight;
+
+static uint8_t
+pattern(long pos)
+{
+  return pos * 7 + (pos >> 8);
+}
+
+// bytes echoed correctly, -1 once a byte came back wrong
+VNODE_EXPORT long
+echo_verified()
+{
+  return errors ? -1 : verified;
+}
+
+// pool blocks in use, none once the connection is gone
+VNODE_EXPORT long
+echo_live_blocks()
+{
+  return UIPNetwork::liveBlocks();
+}
+
+// most bytes the connection had unacknowledged at once
+VNODE_EXPORT long
+echo_inflight()
+{
+  return inflight;
+}
+
+void
+setup()
+{
+  Ethernet.begin(mac, IPAddress(192,168,0,7));
+}
+
+void
+loop()
+{
+  uint8_t buf[200];
+  if (!client.connected())
+    {
+      if (!sent)
+        client.connect(IPAddress(192,168,0,6), 7);
+      return;
+    }
+  if (sent < ECHO_TOTAL)
+    {
+      int len = sent + (long)sizeof(buf) <= ECHO_TOTAL ? sizeof(buf) : ECHO_TOTAL - sent;
+      for (int i = 0; i < len; i++)
+        buf[i] = pattern(sent + i);
+      sent += client.write(buf, len);
+    }
+  for (int i = 0; i < UIP_CONNS; i++)
+    if (uip_outstanding(&uip_conns[i]) > inflight)
+      inflight = uip_outstanding(&uip_conns[i]);
+  int len = client.read(buf, sizeof(buf));
+  for (int i = 0; i < len; i++)
+    if (buf[i] != pattern(verified++))
+      errors++;
+  if (verified == ECHO_TOTAL)
+    client.stop();
+}
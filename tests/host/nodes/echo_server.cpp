@@ -0,0 +1,42 @@
+/*
+ echo_server.cpp - VirtualEthernet node: TCP echo server on 192.168.0.6:7.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <UIPEthernet.h>
+
+static uint8_t mac[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x06 };
+
+EthernetServer server(7);
+
+void
+setup()
+{
+  Ethernet.begin(mac, IPAddress(192,168,0,6));
+  server.begin();
+}
+
+void
+loop()
+{
+  uint8_t buf[128];
+  EthernetClient client = server.available();
+  if (client)
+    {
+      int len = client.read(buf, sizeof(buf));
+      if (len > 0)
+        client.write(buf, len);
+    }
+}
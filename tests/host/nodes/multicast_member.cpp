@@ -0,0 +1,79 @@
+/*
+ multicast_member.cpp - VirtualEthernet node: member of 239.1.2.3 on port
+ 5000, next to a socket on the same port that didn't join the group.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <UIPEthernet.h>
+#include "virtual_node.h"
+
+static uint8_t mac[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x09 };
+
+// bound first, so it comes first when uIP looks for a socket on the port
+EthernetUDP plain;
+EthernetUDP member;
+static long plainReceived;
+static long memberReceived;
+static bool rebind;
+
+// datagrams received by the socket that joined the group
+VNODE_EXPORT long
+multicast_member_received()
+{
+  return memberReceived;
+}
+
+// datagrams received by the socket that didn't
+VNODE_EXPORT long
+multicast_plain_received()
+{
+  return plainReceived;
+}
+
+// the member socket moves on to port 5001 with begin()
+VNODE_EXPORT long
+multicast_rebind()
+{
+  rebind = true;
+  return 0;
+}
+
+void
+setup()
+{
+  Ethernet.begin(mac, IPAddress(192,168,0,9));
+  plain.begin(5000);
+  member.beginMulticast(IPAddress(239,1,2,3), 5000);
+}
+
+void
+loop()
+{
+  if (rebind)
+    {
+      rebind = false;
+      member.begin(5001);
+    }
+  if (plain.parsePacket())
+    {
+      plainReceived++;
+      plain.flush();
+    }
+  if (member.parsePacket())
+    {
+      memberReceived++;
+      member.flush();
+    }
+}
@@ -0,0 +1,43 @@
+/*
+ multicast_sender.cpp - VirtualEthernet node: sends a datagram to
+ 239.1.2.3:5000 every 100ms.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <UIPEthernet.h>
+
+static uint8_t mac[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x0a };
+
+EthernetUDP udp;
+static unsigned long next;
+
+void
+setup()
+{
+  Ethernet.begin(mac, IPAddress(192,168,0,10));
+  udp.begin(5000);
+}
+
+void
+loop()
+{
+  Ethernet.maintain();
+  if ((long)(millis() - next) < 0)
+    return;
+  next = millis() + 100;
+  udp.beginPacket(IPAddress(239,1,2,3), 5000);
+  udp.write((uint8_t)0);
+  udp.endPacket();
+}
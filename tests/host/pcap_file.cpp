@@ -0,0 +1,191 @@
+/*
+ pcap_file.cpp - pcap files on the host: capture target and replay.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pcap_file.h"
+#include "host_hw.h"
+
+#define PCAP_MAGIC       0xa1b2c3d4
+#define PCAP_MAGIC_NANOS 0xa1b23c4d
+
+bool
+FilePrint::open(const char* path)
+{
+  close();
+  file = fopen(path, "wb");
+  if (!file)
+    perror(path);
+  return file != NULL;
+}
+
+void
+FilePrint::close()
+{
+  if (file)
+    fclose(file);
+  file = NULL;
+}
+
+size_t
+FilePrint::write(uint8_t c)
+{
+  return file && fputc(c, file) != EOF ? 1 : 0;
+}
+
+size_t
+FilePrint::write(const uint8_t* buffer, size_t size)
+{
+  return file ? fwrite(buffer, 1, size, file) : 0;
+}
+
+PcapReplay::PcapReplay() :
+    maxSpeed(false),
+    delivered(0),
+    dropped(0),
+    file(NULL),
+    swapped(false),
+    nanos(false),
+    eof(true),
+    pending(false),
+    running(false),
+    started(0),
+    firstStamp(0),
+    haveFirst(false),
+    stamp(0)
+{
+}
+
+PcapReplay::~PcapReplay()
+{
+  close();
+}
+
+bool
+PcapReplay::open(const char* path)
+{
+  close();
+  file = fopen(path, "rb");
+  if (!file)
+    {
+      perror(path);
+      return false;
+    }
+  uint8_t header[24];
+  if (fread(header, 1, sizeof(header), file) != sizeof(header))
+    {
+      fprintf(stderr, "%s: not a pcap file\n", path);
+      close();
+      return false;
+    }
+  uint32_t magic = header[0] | header[1] << 8 | header[2] << 16 | (uint32_t)header[3] << 24;
+  swapped = magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1;
+  nanos = magic == PCAP_MAGIC_NANOS || magic == 0x4d3cb2a1;
+  if (!swapped && magic != PCAP_MAGIC && magic != PCAP_MAGIC_NANOS)
+    {
+      fprintf(stderr, "%s: not a pcap file\n", path);
+      close();
+      return false;
+    }
+  if (get32(&header[20]) != 1)
+    {
+      fprintf(stderr, "%s: not an ethernet capture\n", path);
+      close();
+      return false;
+    }
+  eof = false;
+  pending = false;
+  running = false;
+  haveFirst = false;
+  return true;
+}
+
+void
+PcapReplay::close()
+{
+  if (file)
+    fclose(file);
+  file = NULL;
+  eof = true;
+}
+
+uint32_t
+PcapReplay::get32(const uint8_t* data) const
+{
+  if (swapped)
+    return (uint32_t)data[0] << 24 | data[1] << 16 | data[2] << 8 | data[3];
+  return data[0] | data[1] << 8 | data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+bool
+PcapReplay::readRecord()
+{
+  uint8_t header[16];
+  if (fread(header, 1, sizeof(header), file) != sizeof(header))
+    return false;
+  uint32_t caplen = get32(&header[8]);
+  if (caplen > 0xffff)
+    return false;
+  frame.resize(caplen);
+  if (caplen && fread(frame.data(), 1, caplen, file) != caplen)
+    return false;
+  uint32_t fraction = get32(&header[4]);
+  stamp = (unsigned long long)get32(&header[0]) * 1000000 + (nanos ? fraction / 1000 : fraction);
+  if (!haveFirst)
+    {
+      firstStamp = stamp;
+      haveFirst = true;
+    }
+  return true;
+}
+
+void
+PcapReplay::start()
+{
+  started = host_clock();
+  running = true;
+}
+
+int
+PcapReplay::poll()
+{
+  int n = 0;
+  while (running && !eof)
+    {
+      if (!pending)
+        {
+          if (!readRecord())
+            {
+              eof = true;
+              break;
+            }
+          pending = true;
+        }
+      if (!maxSpeed && host_clock() - started < stamp - firstStamp)
+        break;
+      // frames shorter than an ethernet header can't be received
+      if (frame.size() >= 14 && deliver && deliver(frame.data(), frame.size()))
+        {
+          delivered++;
+          n++;
+        }
+      else if (maxSpeed && frame.size() >= 14 && deliver)
+        break;
+      else
+        dropped++;
+      pending = false;
+    }
+  return n;
+}
@@ -0,0 +1,92 @@
+/*
+ pcap_file.h - pcap files on the host: capture target and replay.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PCAP_FILE_H
+#define PCAP_FILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <functional>
+#include <vector>
+
+#include "Print.h"
+
+// a Print writing to a file, e.g. for UIPPcap::begin()
+class FilePrint : public Print
+{
+public:
+  FilePrint() : file(NULL) {}
+  ~FilePrint() { close(); }
+
+  bool open(const char* path);
+  void close();
+
+  virtual size_t write(uint8_t c);
+  virtual size_t write(const uint8_t* buffer, size_t size);
+  using Print::write;
+
+private:
+  FILE* file;
+};
+
+/*
+ * Feeds the frames of a pcap file (as written by UIPPcap or tcpdump) into
+ * the receive path, either at the recorded times relative to start() on
+ * the virtual clock or as fast as they are taken. deliver returns false
+ * when there was no room for a frame (a filtered frame counts as taken).
+ * At maximum speed it is offered again on the next poll(), at recorded
+ * speed it is dropped as it would be on the wire.
+ */
+class PcapReplay
+{
+public:
+  PcapReplay();
+  ~PcapReplay();
+
+  bool open(const char* path);
+  void close();
+
+  // maximum speed ignores the recorded times
+  bool maxSpeed;
+  std::function<bool(const uint8_t* frame, uint16_t len)> deliver;
+
+  void start();
+  // delivers the frames that are due (none before start()), returns their number
+  int poll();
+  bool done() const { return !file || eof; }
+
+  unsigned long delivered;
+  unsigned long dropped;
+
+private:
+  FILE* file;
+  bool swapped;
+  bool nanos;
+  bool eof;
+  bool pending;
+  bool running;
+  unsigned long long started;
+  unsigned long long firstStamp;
+  bool haveFirst;
+  unsigned long long stamp;
+  std::vector<uint8_t> frame;
+
+  uint32_t get32(const uint8_t* data) const;
+  bool readRecord();
+};
+
+#endif
@@ -0,0 +1,159 @@
+/*
+ pcap_test.cpp - UIPPcap capture and PcapReplay.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+#include "UIPEthernet.h"
+#include "host_hw.h"
+#include "enc28j60_emulator.h"
+#include "pcap_file.h"
+
+static int failures;
+
+#define CHECK(cond) do { if (!(cond)) { \
+    printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+    failures++; } } while(0)
+
+static uint8_t mac[6] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05 };
+
+static Enc28J60Emulator enc;
+
+class BufferPrint : public Print
+{
+public:
+  std::vector<uint8_t> data;
+  virtual size_t write(uint8_t c) { data.push_back(c); return 1; }
+};
+
+static uint32_t
+get32(const std::vector<uint8_t>& data, size_t pos)
+{
+  return data[pos] | data[pos + 1] << 8 | data[pos + 2] << 16 | (uint32_t)data[pos + 3] << 24;
+}
+
+// who-has 192.168.0.6 from 192.168.0.1
+static void
+arp_request(uint8_t* frame)
+{
+  static const uint8_t request[42] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x02, 0x00, 0x00, 0x00, 0x00, 0x01, 0x08, 0x06,
+    0x00, 0x01, 0x08, 0x00, 0x06, 0x04, 0x00, 0x01, 0x02, 0x00, 0x00, 0x00, 0x00, 0x01,
+    192, 168, 0, 1, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 192, 168, 0, 6
+  };
+  memset(frame, 0, 60);
+  memcpy(frame, request, sizeof(request));
+}
+
+static std::vector<uint8_t> captured;
+
+static void
+test_capture()
+{
+  BufferPrint out;
+  UIPEthernet.begin(mac, IPAddress(192,168,0,6));
+  UIPPcap::begin(out, 100);
+  CHECK(out.data.size() == 24);
+  CHECK(get32(out.data, 0) == 0xa1b2c3d4);
+  CHECK(get32(out.data, 16) == 100);
+  CHECK(get32(out.data, 20) == 1);
+
+  uint8_t frame[60];
+  arp_request(frame);
+  enc.transmitted.clear();
+  host_advance_micros(1500000);
+  CHECK(enc.inject(frame, sizeof(frame)));
+  UIPEthernet.maintain();
+  CHECK(enc.transmitted.size() == 1);
+  CHECK(UIPPcap::frames == 2);
+  // the request as received
+  size_t pos = 24;
+  CHECK(get32(out.data, pos) == 1);
+  CHECK(get32(out.data, pos + 8) == 60);
+  CHECK(get32(out.data, pos + 12) == 60);
+  CHECK(memcmp(&out.data[pos + 16], frame, 60) == 0);
+  // and the reply as handed to the chip, which pads it to 60 bytes
+  pos += 16 + 60;
+  uint16_t len = 42;
+  CHECK(get32(out.data, pos + 8) == len);
+  CHECK(out.data.size() == pos + 16 + len);
+  CHECK(memcmp(&out.data[pos + 16], enc.transmitted.back().data(), len) == 0);
+  UIPPcap::end();
+  captured = out.data;
+}
+
+static void
+test_replay()
+{
+  char path[] = "/tmp/pcap_testXXXXXX";
+  int fd = mkstemp(path);
+  CHECK(fd >= 0);
+  CHECK(write(fd, captured.data(), captured.size()) == (ssize_t)captured.size());
+  close(fd);
+
+  PcapReplay replay;
+  std::vector<unsigned long long> times;
+  replay.deliver = [&times](const uint8_t* frame, uint16_t len) {
+    times.push_back(host_clock());
+    return true;
+  };
+  CHECK(replay.open(path));
+  replay.start();
+  unsigned long long start = host_clock();
+  while (!replay.done())
+    {
+      replay.poll();
+      host_advance_micros(10);
+    }
+  CHECK(replay.delivered == 2);
+  CHECK(times.size() == 2);
+  // the reply was sent right after the request came in
+  CHECK(times[0] == start);
+  CHECK(times[1] - times[0] < 1000);
+
+  // at maximum speed frames the receiver has no room for are kept
+  int room = 0;
+  replay.deliver = [&room](const uint8_t* frame, uint16_t len) { return room-- > 0; };
+  replay.maxSpeed = true;
+  CHECK(replay.open(path));
+  replay.start();
+  CHECK(replay.poll() == 0);
+  room = 1;
+  CHECK(replay.poll() == 1);
+  room = 1;
+  CHECK(replay.poll() == 1);
+  CHECK(replay.done());
+  CHECK(replay.dropped == 0);
+  unlink(path);
+}
+
+int
+main()
+{
+  enc.attach(ENC28J60_CONTROL_CS);
+  test_capture();
+  test_replay();
+  if (failures)
+    {
+      printf("%d checks failed\n", failures);
+      return 1;
+    }
+  printf("all checks passed\n");
+  return 0;
+}
@@ -0,0 +1,173 @@
+/*
+ sketch_main.cpp - runs an Arduino sketch against the ENC28J60 emulator.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "host_hw.h"
+#include "host_link.h"
+#include "pcap_file.h"
+#include "Enc28J60Network.h"
+#include "enc28j60_emulator.h"
+#include "uip_pcap.h"
+
+extern "C" {
+#include "enc28j60.h"
+}
+
+void setup();
+void loop();
+
+static TapLink tap;
+static PcapReplay replay;
+static unsigned long long start;
+
+static unsigned long long
+monotonic_micros()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void
+usage(const char* name)
+{
+  fprintf(stderr, "usage: %s [-t tapif] [-n loops] [-w file] [-r file [-R]] [-p]\n"
+      "  -t tapif  connect to TAP interface tapif, the clock follows real time\n"
+      "  -n loops  return after the given number of loop() calls\n"
+      "  -w file   capture all frames to the pcap file\n"
+      "  -r file   replay the frames of the pcap file at the recorded times\n"
+      "            and return when done\n"
+      "  -R        replay as fast as the sketch takes the frames\n"
+      "  -p        print the SPI profile of the driver on return\n", name);
+  exit(2);
+}
+
+static void
+link_poll()
+{
+  if (tap.fd() >= 0)
+    {
+      unsigned long long now = monotonic_micros() - start;
+      if (now > host_clock())
+        host_advance_micros(now - host_clock());
+      tap.poll();
+    }
+  replay.poll();
+}
+
+/*
+ * Without -t the sketch runs on the virtual clock with nothing on the
+ * wire, which is enough to profile setup() and the idle loop. With a TAP
+ * interface the virtual clock is kept in step with real time so the
+ * stacks timers behave as on the board. A replayed pcap file makes a
+ * repeatable load for profiling.
+ */
+int
+main(int argc, char** argv)
+{
+  const char* tapif = NULL;
+  const char* capture = NULL;
+  const char* replayfile = NULL;
+  unsigned long loops = 0;
+  bool profile = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "t:n:w:r:Rp")) != -1)
+    {
+      switch (opt)
+        {
+      case 't':
+        tapif = optarg;
+        break;
+      case 'n':
+        loops = strtoul(optarg, NULL, 0);
+        break;
+      case 'w':
+        capture = optarg;
+        break;
+      case 'r':
+        replayfile = optarg;
+        break;
+      case 'R':
+        replay.maxSpeed = true;
+        break;
+      case 'p':
+        profile = true;
+        break;
+      default:
+        usage(argv[0]);
+        }
+    }
+
+  // Serial output shows up as it does on the board
+  setvbuf(stdout, NULL, _IOLBF, 0);
+
+  Enc28J60Emulator enc;
+  enc.attach(ENC28J60_CONTROL_CS);
+  if (tapif)
+    {
+      if (!tap.open(tapif))
+        return 1;
+      tap.attach(enc);
+      enc.spiByteMicros = 0;
+    }
+  FilePrint pcap;
+  if (capture)
+    {
+      if (!pcap.open(capture))
+        return 1;
+      UIPPcap::begin(pcap);
+    }
+  if (replayfile)
+    {
+      if (!replay.open(replayfile))
+        return 1;
+      replay.deliver = [&enc](const uint8_t* frame, uint16_t len) {
+        unsigned long overflows = enc.rxOverflows;
+        return enc.inject(frame, len) || enc.rxOverflows == overflows;
+      };
+    }
+  host_poll = link_poll;
+
+  start = monotonic_micros();
+  setup();
+  replay.start();
+  for (unsigned long n = 0; !loops || n < loops; n++)
+    {
+      // done once the sketch has taken the last frame
+      if (replayfile && replay.done() && !enc.packetCount())
+        break;
+      if (tapif)
+        {
+          // don't spin on an idle link
+          struct pollfd pfd = { tap.fd(), POLLIN, 0 };
+          ::poll(&pfd, 1, 1);
+        }
+      loop();
+    }
+  if (replayfile)
+    fprintf(stderr, "replayed %lu frames, %lu dropped\n", replay.delivered, replay.dropped);
+  if (profile)
+    Enc28J60Profile::dump(Serial);
+  Serial.flush();
+  return 0;
+}
@@ -0,0 +1,236 @@
+/*
+ virtual_ethernet.cpp - runs several UIPEthernet stacks on one virtual link.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "virtual_ethernet.h"
+
+#define VIRTUAL_ETHERNET_STACKSIZE (256 * 1024)
+
+VirtualEthernet::Node* VirtualEthernet::starting;
+
+VirtualEthernet::VirtualEthernet() :
+    latency(100),
+    loss(0),
+    bandwidth(10000000),
+    quantum(10),
+    framesSent(0),
+    framesLost(0),
+    framesDelivered(0),
+    framesRejected(0),
+    time(0),
+    wireFree(0),
+    random(1),
+    running(NULL)
+{
+}
+
+VirtualEthernet::~VirtualEthernet()
+{
+  for (size_t i = 0; i < nodelist.size(); i++)
+    {
+      dlclose(nodelist[i]->handle);
+      free(nodelist[i]->stack);
+      delete nodelist[i];
+    }
+}
+
+void
+VirtualEthernet::seed(unsigned long seed)
+{
+  random.seed(seed);
+}
+
+int
+VirtualEthernet::addNode(const char* module)
+{
+  // dlopen() returns the already loaded instance for a path it has seen,
+  // so every node gets a private copy of the module
+  char path[] = "/tmp/vnodeXXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0)
+    {
+      perror("mkstemp");
+      return -1;
+    }
+  FILE* in = fopen(module, "rb");
+  FILE* out = fdopen(fd, "wb");
+  if (!in || !out)
+    {
+      perror(module);
+      if (in)
+        fclose(in);
+      if (out)
+        fclose(out);
+      else
+        close(fd);
+      unlink(path);
+      return -1;
+    }
+  char buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), in)) > 0)
+    fwrite(buf, 1, n, out);
+  fclose(in);
+  fclose(out);
+  void* handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  unlink(path);
+  if (!handle)
+    {
+      fprintf(stderr, "%s\n", dlerror());
+      return -1;
+    }
+
+  Node* node = new Node();
+  node->owner = this;
+  node->index = nodelist.size();
+  node->handle = handle;
+  vnode_connect_fn connect = (vnode_connect_fn)dlsym(handle, "vnode_connect");
+  node->deliver = (vnode_deliver_fn)dlsym(handle, "vnode_deliver");
+  node->clock = (vnode_clock_fn)dlsym(handle, "vnode_clock");
+  node->setup = (vnode_run_fn)dlsym(handle, "vnode_setup");
+  node->loop = (vnode_run_fn)dlsym(handle, "vnode_loop");
+  if (!connect || !node->deliver || !node->clock || !node->setup || !node->loop)
+    {
+      fprintf(stderr, "%s: not a node module\n", module);
+      dlclose(handle);
+      delete node;
+      return -1;
+    }
+  connect(send, poll, node);
+  node->clock(time);
+  node->stack = malloc(VIRTUAL_ETHERNET_STACKSIZE);
+  getcontext(&node->context);
+  node->context.uc_stack.ss_sp = node->stack;
+  node->context.uc_stack.ss_size = VIRTUAL_ETHERNET_STACKSIZE;
+  node->context.uc_link = NULL;
+  makecontext(&node->context, start, 0);
+  nodelist.push_back(node);
+  return node->index;
+}
+
+void*
+VirtualEthernet::symbol(int node, const char* name)
+{
+  if (node < 0 || node >= (int)nodelist.size())
+    return NULL;
+  return dlsym(nodelist[node]->handle, name);
+}
+
+void
+VirtualEthernet::run(unsigned long micros)
+{
+  unsigned long long end = time + micros;
+  while (time < end)
+    step();
+}
+
+bool
+VirtualEthernet::runUntil(std::function<bool()> done, unsigned long timeout)
+{
+  unsigned long long end = time + timeout;
+  while (!done())
+    {
+      if (time >= end)
+        return false;
+      step();
+    }
+  return true;
+}
+
+void
+VirtualEthernet::step()
+{
+  time += quantum;
+  for (size_t i = 0; i < nodelist.size(); i++)
+    nodelist[i]->clock(time);
+  while (!wire.empty() && wire.front().due <= time)
+    {
+      Frame& frame = wire.front();
+      for (size_t i = 0; i < nodelist.size(); i++)
+        {
+          if ((int)i == frame.from)
+            continue;
+          if (nodelist[i]->deliver(frame.data.data(), frame.data.size()))
+            framesDelivered++;
+          else
+            framesRejected++;
+        }
+      wire.pop_front();
+    }
+  for (size_t i = 0; i < nodelist.size(); i++)
+    {
+      running = nodelist[i];
+      // makecontext() only passes ints, the node starts through starting
+      starting = running;
+      swapcontext(&scheduler, &running->context);
+      running = NULL;
+    }
+}
+
+void
+VirtualEthernet::start()
+{
+  Node* node = starting;
+  node->setup();
+  for (;;)
+    {
+      node->loop();
+      swapcontext(&node->context, &node->owner->scheduler);
+    }
+}
+
+void
+VirtualEthernet::transmit(int from, const uint8_t* frame, uint16_t len)
+{
+  framesSent++;
+  if (tap)
+    tap(from, frame, len);
+  if (loss > 0 && std::uniform_real_distribution<double>(0, 1)(random) < loss)
+    {
+      framesLost++;
+      return;
+    }
+  // frames leave one after the other: preamble, FCS and gap add 24 bytes
+  unsigned long long start = wireFree > time ? wireFree : time;
+  unsigned long long duration = bandwidth ? (unsigned long long)(len + 24) * 8 * 1000000 / bandwidth : 0;
+  wireFree = start + duration;
+  Frame f;
+  f.due = wireFree + latency;
+  f.from = from;
+  f.data.assign(frame, frame + len);
+  wire.push_back(f);
+}
+
+void
+VirtualEthernet::send(void* ctx, const uint8_t* frame, uint16_t len)
+{
+  Node* node = (Node*)ctx;
+  node->owner->transmit(node->index, frame, len);
+}
+
+void
+VirtualEthernet::poll(void* ctx)
+{
+  Node* node = (Node*)ctx;
+  // outside of step() there is nothing to yield to
+  if (node->owner->running == node)
+    swapcontext(&node->context, &node->owner->scheduler);
+}
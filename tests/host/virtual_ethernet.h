@@ -0,0 +1,116 @@
+/*
+ virtual_ethernet.h - runs several UIPEthernet stacks on one virtual link.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VIRTUAL_ETHERNET_H
+#define VIRTUAL_ETHERNET_H
+
+#include <stdint.h>
+#include <ucontext.h>
+#include <deque>
+#include <functional>
+#include <random>
+#include <vector>
+
+#include "virtual_node.h"
+
+/*
+ * Runs node modules (see virtual_node.h) in this process, all attached
+ * to one link that works like a hub: every frame reaches every other
+ * node after the configured latency, unless it is lost.
+ *
+ * Every node runs as a coroutine on its own stack: setup() once, then
+ * loop() over and over. A node yields whenever it reads the clock and
+ * after each loop(). The nodes share a virtual clock that advances by
+ * quantum per round, in which due frames are delivered and each node
+ * runs until it yields. So a node blocking in connect() or DHCP still
+ * sees its peers answer, and a run with the same settings and seed is
+ * always the same run.
+ */
+class VirtualEthernet
+{
+public:
+  VirtualEthernet();
+  ~VirtualEthernet();
+
+  // loads another instance of the module, returns its node number or -1
+  int addNode(const char* module);
+  void* symbol(int node, const char* name);
+  int nodes() const { return (int)nodelist.size(); }
+
+  // one way delay in micros
+  unsigned long latency;
+  // probability a frame gets lost
+  double loss;
+  // bits per second, 0 for no limit
+  unsigned long bandwidth;
+  // micros the clock advances on every read
+  unsigned int quantum;
+  void seed(unsigned long seed);
+  // sees every frame a node sends, including the ones that get lost
+  std::function<void(int from, const uint8_t* frame, uint16_t len)> tap;
+  // sends a frame from outside of the nodes (from is -1 for the tap)
+  void inject(const uint8_t* frame, uint16_t len) { transmit(-1, frame, len); }
+
+  unsigned long long now() const { return time; }
+  // runs setup() of new nodes and loop() of all nodes for the given time
+  void run(unsigned long micros);
+  // runs until done() returns true, false if timeout micros pass first
+  bool runUntil(std::function<bool()> done, unsigned long timeout);
+
+  unsigned long framesSent;
+  unsigned long framesLost;
+  unsigned long framesDelivered;
+  unsigned long framesRejected;   // filtered or receivebuffer full
+
+private:
+  struct Node
+  {
+    VirtualEthernet* owner;
+    int index;
+    void* handle;
+    vnode_deliver_fn deliver;
+    vnode_clock_fn clock;
+    vnode_run_fn setup;
+    vnode_run_fn loop;
+    ucontext_t context;
+    void* stack;
+  };
+
+  struct Frame
+  {
+    unsigned long long due;
+    int from;
+    std::vector<uint8_t> data;
+  };
+
+  std::vector<Node*> nodelist;
+  std::deque<Frame> wire;
+  unsigned long long time;
+  unsigned long long wireFree;
+  std::mt19937 random;
+  ucontext_t scheduler;
+  Node* running;
+
+  static Node* starting;
+  static void start();
+  void step();
+  void transmit(int from, const uint8_t* frame, uint16_t len);
+  static void send(void* ctx, const uint8_t* frame, uint16_t len);
+  static void poll(void* ctx);
+};
+
+#endif
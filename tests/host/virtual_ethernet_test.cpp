@@ -0,0 +1,200 @@
+/*
+ virtual_ethernet_test.cpp - two UIPEthernet stacks on VirtualEthernet.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "virtual_ethernet.h"
+
+static int failures;
+
+#define CHECK(cond) do { if (!(cond)) { \
+    printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+    failures++; } } while(0)
+
+typedef long (*verified_fn)(void);
+
+static void
+test_echo(unsigned long latency, double loss)
+{
+  VirtualEthernet net;
+  net.latency = latency;
+  net.loss = loss;
+  int server = net.addNode(ECHO_SERVER_MODULE);
+  int client = net.addNode(ECHO_CLIENT_MODULE);
+  CHECK(server >= 0 && client >= 0);
+  if (server < 0 || client < 0)
+    return;
+  verified_fn verified = (verified_fn)net.symbol(client, "echo_verified");
+  CHECK(verified);
+  verified_fn inflight = (verified_fn)net.symbol(client, "echo_inflight");
+  CHECK(inflight);
+  bool done = net.runUntil([verified]() { return verified() < 0 || verified() == 4096; }, 60000000);
+  printf("latency %luus loss %.2f: %ld bytes echoed in %llums, %lu frames sent, %lu lost, %ld bytes in flight\n",
+      latency, loss, verified(), net.now() / 1000, net.framesSent, net.framesLost, inflight());
+  CHECK(done);
+  CHECK(verified() == 4096);
+  if (loss == 0)
+    CHECK(net.framesLost == 0);
+  // the client writes faster than a segment per round trip
+  if (latency >= 5000)
+    CHECK(inflight() > 512); // more than one segment (UIP_CONF_TCP_MSS)
+  // segments are sent from the socket's blocks, all of them are released
+  // once the connection closed
+  verified_fn live = (verified_fn)net.symbol(client, "echo_live_blocks");
+  CHECK(live);
+  net.runUntil([live]() { return live() == 0; }, 10000000);
+  CHECK(live() == 0);
+}
+
+static void
+test_deterministic()
+{
+  unsigned long long t[2];
+  unsigned long frames[2];
+  for (int i = 0; i < 2; i++)
+    {
+      VirtualEthernet net;
+      net.loss = 0.1;
+      net.seed(42);
+      net.addNode(ECHO_SERVER_MODULE);
+      int client = net.addNode(ECHO_CLIENT_MODULE);
+      verified_fn verified = (verified_fn)net.symbol(client, "echo_verified");
+      net.runUntil([verified]() { return verified() == 4096; }, 60000000);
+      t[i] = net.now();
+      frames[i] = net.framesSent;
+    }
+  CHECK(t[0] == t[1]);
+  CHECK(frames[0] == frames[1]);
+}
+
+// counts the igmp messages of type sent on the link
+static void
+count_igmp(const uint8_t* frame, uint16_t len, uint8_t type, int& count)
+{
+  // ip (with the router alert option) and igmp behind the ethernet header
+  if (len < 14 + 24 + 8 || frame[12] != 0x08 || frame[13] != 0x00 || frame[14 + 9] != 2)
+    return;
+  if (frame[14 + ((frame[14] & 0x0f) << 2)] == type)
+    count++;
+}
+
+// an igmp message from 192.168.0.1 as a router or another member sends it
+static void
+igmp_frame(uint8_t* frame, uint8_t type, uint8_t maxresp, const uint8_t* group, const uint8_t* dest)
+{
+  static const uint8_t header[] = {
+      0x01, 0x00, 0x5e, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x01, 0x08, 0x00,
+      0x46, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x00, 0x00,
+      192, 168, 0, 1, 0, 0, 0, 0, 0x94, 0x04, 0x00, 0x00 };
+  memcpy(frame, header, sizeof(header));
+  frame[3] = dest[1] & 0x7f;
+  frame[4] = dest[2];
+  frame[5] = dest[3];
+  memcpy(frame + 14 + 16, dest, 4);
+  uint8_t* igmp = frame + 14 + 24;
+  igmp[0] = type;
+  igmp[1] = maxresp;
+  igmp[2] = igmp[3] = 0;
+  memcpy(igmp + 4, group, 4);
+  // the stack doesn't check the checksums of igmp messages
+}
+
+static void
+test_multicast()
+{
+  VirtualEthernet net;
+  int reports = 0;
+  int leaves = 0;
+  unsigned long long reported = 0;
+  net.tap = [&net, &reports, &leaves, &reported](int from, const uint8_t* frame, uint16_t len) {
+    if (from < 0)
+      return;
+    int n = reports;
+    count_igmp(frame, len, 0x16, reports);
+    count_igmp(frame, len, 0x17, leaves);
+    if (reports != n)
+      reported = net.now();
+  };
+  int member = net.addNode(MULTICAST_MEMBER_MODULE);
+  int sender = net.addNode(MULTICAST_SENDER_MODULE);
+  CHECK(member >= 0 && sender >= 0);
+  if (member < 0 || sender < 0)
+    return;
+  verified_fn memberReceived = (verified_fn)net.symbol(member, "multicast_member_received");
+  verified_fn plainReceived = (verified_fn)net.symbol(member, "multicast_plain_received");
+  verified_fn rebind = (verified_fn)net.symbol(member, "multicast_rebind");
+  CHECK(memberReceived && plainReceived && rebind);
+  if (!memberReceived || !plainReceived || !rebind)
+    return;
+  // the report sent on joining is repeated once, 10s later
+  net.run(5000000);
+  CHECK(reports == 1);
+  net.run(10000000);
+  printf("multicast: %ld datagrams to the member, %ld to the other socket, %d reports\n",
+      memberReceived(), plainReceived(), reports);
+  CHECK(reports == 2);
+  // only the socket that joined gets the datagrams to the group
+  CHECK(memberReceived() > 100);
+  CHECK(plainReceived() == 0);
+
+  // a general query with a maximum response time of 1s is answered in time
+  static const uint8_t allhosts[] = { 224, 0, 0, 1 };
+  static const uint8_t any[] = { 0, 0, 0, 0 };
+  static const uint8_t group[] = { 239, 1, 2, 3 };
+  uint8_t frame[14 + 24 + 8];
+  igmp_frame(frame, 0x11, 10, any, allhosts);
+  net.inject(frame, sizeof(frame));
+  unsigned long long queried = net.now();
+  net.run(3000000);
+  CHECK(reports == 3);
+  CHECK(reported > queried && reported <= queried + 1000000 + 250000);
+  // no answer if another member answers first
+  igmp_frame(frame, 0x11, 100, group, group);
+  net.inject(frame, sizeof(frame));
+  igmp_frame(frame, 0x16, 0, group, group);
+  net.inject(frame, sizeof(frame));
+  net.run(12000000);
+  CHECK(reports == 3);
+
+  // binding the member to another port leaves the group
+  rebind();
+  net.run(1000000);
+  CHECK(leaves == 1);
+  long received = memberReceived();
+  net.run(15000000);
+  CHECK(memberReceived() == received);
+  CHECK(plainReceived() == 0);
+  CHECK(reports == 3);
+}
+
+int
+main()
+{
+  test_echo(100, 0);
+  test_echo(5000, 0);
+  test_echo(1000, 0.2);
+  test_deterministic();
+  test_multicast();
+  if (failures)
+    {
+      printf("%d checks failed\n", failures);
+      return 1;
+    }
+  printf("all checks passed\n");
+  return 0;
+}
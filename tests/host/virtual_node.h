@@ -0,0 +1,45 @@
+/*
+ virtual_node.h - entry points of a node module run by VirtualEthernet.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VIRTUAL_NODE_H
+#define VIRTUAL_NODE_H
+
+#include <stdint.h>
+
+// symbols a node module makes visible to the harness
+#define VNODE_EXPORT extern "C" __attribute__((visibility("default")))
+
+typedef void (*vnode_send_fn)(void* ctx, const uint8_t* frame, uint16_t len);
+typedef void (*vnode_poll_fn)(void* ctx);
+
+/*
+ * A node module is a sketch (setup() and loop()) linked with UIPEthernet
+ * on VirtualNetwork and the host Arduino core into a shared object. Each
+ * copy VirtualEthernet loads is a complete stack with its own state.
+ * virtual_node.cpp adds these entry points to every module
+ * (enc28j60_node.cpp to modules on Enc28J60Network and the emulator):
+ */
+// vnode_connect: sent frames go to send, poll is called on reading the clock
+typedef void (*vnode_connect_fn)(vnode_send_fn send, vnode_poll_fn poll, void* ctx);
+// vnode_deliver: a frame from the link
+typedef bool (*vnode_deliver_fn)(const uint8_t* frame, uint16_t len);
+// vnode_clock: moves the nodes clock forward to micros
+typedef void (*vnode_clock_fn)(unsigned long long micros);
+// vnode_setup, vnode_loop: the sketch
+typedef void (*vnode_run_fn)(void);
+
+#endif
@@ -24,6 +24,7 @@
 
 #include "Enc28J60Network.h"
 #include "Arduino.h"
+#include <string.h>
 
 extern "C" {
 #include <avr/io.h>
@@ -35,8 +36,8 @@ extern "C" {
 #include "HardwareSerial.h"
 #endif
 
-// set CS to 0 = active
-#define CSACTIVE digitalWrite(ENC28J60_CONTROL_CS, LOW)
+// set CS to 0 = active (every SPI operation starts here, so count it)
+#define CSACTIVE do { counters.spiOps++; digitalWrite(ENC28J60_CONTROL_CS, LOW); } while(0)
 // set CS to 1 = passive
 #define CSPASSIVE digitalWrite(ENC28J60_CONTROL_CS, HIGH)
 //
@@ -44,12 +45,55 @@ extern "C" {
 
 uint16_t Enc28J60Network::nextPacketPtr;
 uint8_t Enc28J60Network::bank=0xff;
+uint16_t Enc28J60Network::rxStop = RXSTOP_INIT;
+struct enc28j60_stats Enc28J60Network::counters;
+uint8_t Enc28J60Network::rxFilter = UIP_RECEIVEFILTER_DEFAULT;
+uint8_t Enc28J60Network::broadcastRefs;
 
 struct memblock Enc28J60Network::receivePkt;
 
-void Enc28J60Network::init(uint8_t* macaddr)
+memhandle Enc28J60Network::txQueue[UIP_TX_QUEUE];
+uint8_t Enc28J60Network::txQueueLen;
+bool Enc28J60Network::txBusy;
+unsigned long Enc28J60Network::txStarted;
+
+bool Enc28J60Network::dmaBusy;
+bool Enc28J60Network::dmaFromRx;
+memaddress Enc28J60Network::dmaSrc;
+memaddress Enc28J60Network::dmaDest;
+memaddress Enc28J60Network::dmaLen;
+bool Enc28J60Network::rxReleasePending;
+uint16_t Enc28J60Network::rxReleasePtr;
+
+#if UIP_FULL_DUPLEX
+bool Enc28J60Network::rxPaused;
+#endif
+
+#if UIP_INT_PIN >= 0
+volatile bool Enc28J60Network::rxInterrupt;
+unsigned long Enc28J60Network::rxPolled;
+
+void
+Enc28J60Network::interrupt()
 {
-  MemoryPool::init(); // 1 byte in between RX_STOP_INIT and pool to allow prepending of controlbyte
+  rxInterrupt = true;
+}
+#endif
+
+void Enc28J60Network::init(uint8_t* macaddr, uint16_t rxsize)
+{
+  ENC28J60_PROFILE(INIT);
+  if (rxsize < RXSIZE_MIN)
+    rxsize = RXSIZE_MIN;
+  if (rxsize > RXSIZE_MAX)
+    rxsize = RXSIZE_MAX;
+  // receive buffer end must be odd (see Rev. B1,B4,B5,B7 Silicon Errata 'Memory (Ethernet Buffer)')
+  rxStop = RXSTART_INIT + (rxsize & ~1) - 1;
+  MemoryPool::init(rxStop + 2, TXSTOP_INIT - rxStop - 1); // 1 byte in between rxStop and pool to allow prepending of controlbyte
+  txQueueLen = 0;
+  txBusy = false;
+  dmaBusy = false;
+  rxReleasePending = false;
   // initialize I/O
   // ss as output:
   pinMode(ENC28J60_CONTROL_CS, OUTPUT);
@@ -76,70 +120,102 @@ void Enc28J60Network::init(uint8_t* macaddr)
   SPSR |= (1<<SPI2X);
   // perform system reset
   writeOp(ENC28J60_SOFT_RESET, 0, ENC28J60_SOFT_RESET);
-  delay(50);
+  {
+    ENC28J60_PROFILE_WAIT();
+    delay(50);
+  }
+  // reset selects bank 0 (ECON1 = 0)
+  bank = 0;
   // check CLKRDY bit to see if reset is complete
   // The CLKRDY does not work. See Rev. B4 Silicon Errata point. Just wait.
   //while(!(readReg(ESTAT) & ESTAT_CLKRDY));
-  // do bank 0 stuff
-  // initialize receive buffer
-  // 16-bit transfers, must write low byte first
-  // set receive buffer start address
   nextPacketPtr = RXSTART_INIT;
-  // Rx start
-  writeRegPair(ERXSTL, RXSTART_INIT);
-  // RX end
-  writeRegPair(ERXNDL, RXSTOP_INIT);
-  // set receive pointer address
-  //writeRegPair(ERXRDPTL, RXSTART_INIT); // TODO: First packet received to even address? Errata 14. /Frol
-  setERXRDPT();
-  // TX start
-  //writeRegPair(ETXSTL, TXSTART_INIT);
-  // TX end
-  //writeRegPair(ETXNDL, TXSTOP_INIT);
-  // do bank 1 stuff, packet filter:
-  // For broadcast packets we allow only ARP packtets
-  // All other packets should be unicast only for our mac (MAADR)
-  //
-  // The pattern to match on is therefore
-  // Type     ETH.DST
-  // ARP      BROADCAST
-  // 06 08 -- ff ff ff ff ff ff -> ip checksum for theses bytes=f7f9
-  // in binary these poitions are:11 0000 0011 1111
-  // This is hex 303F->EPMM0=0x3f,EPMM1=0x30
-  //TODO define specific pattern to receive dhcp-broadcast packages instead of setting ERFCON_BCEN!
-  writeReg(ERXFCON, ERXFCON_UCEN|ERXFCON_CRCEN|ERXFCON_PMEN|ERXFCON_BCEN);
-  writeRegPair(EPMM0, 0x303f);
-  writeRegPair(EPMCSL, 0xf7f9);
-  //
-  //
-  // do bank 2 stuff
-  // enable MAC receive
-  // and bring MAC out of reset (writes 0x00 to MACON2)
-  writeRegPair(MACON1, MACON1_MARXEN|MACON1_TXPAUS|MACON1_RXPAUS);
-  // enable automatic padding to 60bytes and CRC operations
-  writeOp(ENC28J60_BIT_FIELD_SET, MACON3, MACON3_PADCFG0|MACON3_TXCRCEN|MACON3_FRMLNEN);
-  // set inter-frame gap (non-back-to-back)
-  writeRegPair(MAIPGL, 0x0C12);
-  // set inter-frame gap (back-to-back)
-  writeReg(MABBIPG, 0x12);
-  // Set the maximum packet size which the controller will accept
-  // Do not send packets longer than MAX_FRAMELEN:
-  writeRegPair(MAMXFLL, MAX_FRAMELEN);
-  // do bank 3 stuff
-  // write MAC address
-  // NOTE: MAC address in ENC28J60 is byte-backward
-  writeReg(MAADR5, macaddr[0]);
-  writeReg(MAADR4, macaddr[1]);
-  writeReg(MAADR3, macaddr[2]);
-  writeReg(MAADR2, macaddr[3]);
-  writeReg(MAADR1, macaddr[4]);
-  writeReg(MAADR0, macaddr[5]);
+  enc28j60_regwrite regs[] = {
+    // do bank 0 stuff
+    // initialize receive buffer
+    // 16-bit transfers, must write low byte first
+    // Rx start
+    { ERXSTL, RXSTART_INIT & 0xFF },
+    { ERXSTH, RXSTART_INIT >> 8 },
+    // RX end
+    { ERXNDL, (uint8_t)(rxStop & 0xFF) },
+    { ERXNDH, (uint8_t)(rxStop >> 8) },
+    // set receive pointer address (as setERXRDPT() does for nextPacketPtr == RXSTART_INIT)
+    //writeRegPair(ERXRDPTL, RXSTART_INIT); // TODO: First packet received to even address? Errata 14. /Frol
+    { ERXRDPTL, (uint8_t)(rxStop & 0xFF) },
+    { ERXRDPTH, (uint8_t)(rxStop >> 8) },
+    // TX start and end are set by startTransmit()
+    // do bank 1 stuff, packet filter:
+    // For broadcast packets we allow only ARP packtets
+    // All other packets should be unicast only for our mac (MAADR)
+    // Other broadcasts are accepted only while enableBroadcast() is in effect
+    // (DHCP in progress or UDP socket listening)
+    //
+    // The pattern to match on is therefore
+    // Type     ETH.DST
+    // ARP      BROADCAST
+    // 06 08 -- ff ff ff ff ff ff -> ip checksum for theses bytes=f7f9
+    // in binary these poitions are:11 0000 0011 1111
+    // This is hex 303F->EPMM0=0x3f,EPMM1=0x30
+    { ERXFCON, (uint8_t)(rxFilter | (broadcastRefs ? ERXFCON_BCEN : 0)) },
+    { EPMM0, 0x3f },
+    { EPMM1, 0x30 },
+    { EPMCSL, 0xf9 },
+    { EPMCSH, 0xf7 },
+    //
+    //
+    // do bank 2 stuff
+    // enable MAC receive
+    { MACON1, MACON1_MARXEN|MACON1_TXPAUS|MACON1_RXPAUS },
+    // bring MAC out of reset
+    { MACON2, 0x00 },
+    // enable automatic padding to 60bytes and CRC operations
+    // (MACON3 is a MAC register, BFS/BFC only work on ETH registers)
+#if UIP_FULL_DUPLEX
+    { MACON3, MACON3_PADCFG0|MACON3_TXCRCEN|MACON3_FRMLNEN|MACON3_FULDPX },
+    // set inter-frame gap (non-back-to-back, MAIPGH is unused in full-duplex)
+    { MAIPGL, 0x12 },
+    // set inter-frame gap (back-to-back, 9.6us in full-duplex)
+    { MABBIPG, 0x15 },
+#else
+    { MACON3, MACON3_PADCFG0|MACON3_TXCRCEN|MACON3_FRMLNEN },
+    // set inter-frame gap (non-back-to-back)
+    { MAIPGL, 0x12 },
+    { MAIPGH, 0x0C },
+    // set inter-frame gap (back-to-back)
+    { MABBIPG, 0x12 },
+#endif
+    // Set the maximum packet size which the controller will accept
+    // Do not send packets longer than MAX_FRAMELEN:
+    { MAMXFLL, MAX_FRAMELEN & 0xFF },
+    { MAMXFLH, MAX_FRAMELEN >> 8 },
+    // do bank 3 stuff
+    // write MAC address
+    // NOTE: MAC address in ENC28J60 is byte-backward
+    { MAADR5, macaddr[0] },
+    { MAADR4, macaddr[1] },
+    { MAADR3, macaddr[2] },
+    { MAADR2, macaddr[3] },
+    { MAADR1, macaddr[4] },
+    { MAADR0, macaddr[5] }
+  };
+  writeRegBatch(regs, sizeof(regs)/sizeof(enc28j60_regwrite));
   // no loopback of transmitted frames
   phyWrite(PHCON2, PHCON2_HDLDIS);
-  // switch to bank 0
-  setBank(ECON1);
+#if UIP_FULL_DUPLEX
+  // PHY duplex mode must match MACON3.FULDPX
+  phyWrite(PHCON1, PHCON1_PDPXMD);
+  rxPaused = false;
+#endif
   // enable interrutps
   writeOp(ENC28J60_BIT_FIELD_SET, EIE, EIE_INTIE|EIE_PKTIE);
+#if UIP_INT_PIN >= 0
+  // INT is held low while packets are pending, so there might be no edge
+  // for packets received before attaching the interrupt
+  pinMode(UIP_INT_PIN, INPUT);
+  rxInterrupt = true;
+  attachInterrupt(digitalPinToInterrupt(UIP_INT_PIN), interrupt, FALLING);
+#endif
   // enable packet reception
   writeOp(ENC28J60_BIT_FIELD_SET, ECON1, ECON1_RXEN);
   //Configure leds
@@ -149,14 +225,37 @@ void Enc28J60Network::init(uint8_t* macaddr)
 memhandle
 Enc28J60Network::receivePacket()
 {
+  ENC28J60_PROFILE(RECEIVE);
   uint8_t rxstat;
   uint16_t len;
+#if UIP_INT_PIN >= 0
+  // don't touch the SPI bus unless INT signaled a packet. Poll once per
+  // periodic interval anyway in case an edge was missed (errata point 6).
+  if (!rxInterrupt && millis() - rxPolled < UIP_PERIODIC_TIMER)
+    return (NOBLOCK);
+  // clear the flag before reading EPKTCNT so a packet arriving meanwhile
+  // triggers another read:
+  rxInterrupt = false;
+  rxPolled = millis();
+#endif
   // check if a packet has been received and buffered
   //if( !(readReg(EIR) & EIR_PKTIF) ){
   // The above does not work. See Rev. B4 Silicon Errata point 6.
-  if (readReg(EPKTCNT) != 0)
+  uint8_t pktcnt = readReg(EPKTCNT);
+  if (pktcnt != 0)
     {
-      uint16_t readPtr = nextPacketPtr+6 > RXSTOP_INIT ? nextPacketPtr+6-RXSTOP_INIT+RXSTART_INIT : nextPacketPtr+6;
+      // frames were lost because the receivebuffer ran full:
+      if (readReg(EIR) & EIR_RXERIF)
+        {
+          counters.rxOverflows++;
+          writeOp(ENC28J60_BIT_FIELD_CLR, EIR, EIR_RXERIF);
+        }
+#if UIP_INT_PIN >= 0
+      // there might be more packets pending which don't raise another
+      // edge on INT, so check again on next call:
+      rxInterrupt = true;
+#endif
+      uint16_t readPtr = rxWrap(nextPacketPtr+6);
       // Set the read pointer to the start of the received packet
       writeRegPair(ERDPTL, nextPacketPtr);
       // read the next packet pointer
@@ -173,7 +272,7 @@ Enc28J60Network::receivePacket()
       Serial.print("receivePacket [");
       Serial.print(readPtr,HEX);
       Serial.print("-");
-      Serial.print((readPtr+len) % (RXSTOP_INIT+1),HEX);
+      Serial.print(rxWrap(readPtr+len),HEX);
       Serial.print("], next: ");
       Serial.print(nextPacketPtr,HEX);
       Serial.print(", stat: ");
@@ -182,6 +281,12 @@ Enc28J60Network::receivePacket()
       Serial.print(readReg(EPKTCNT));
       Serial.print(" -> ");
       Serial.println((rxstat & 0x80)!=0 ? "OK" : "failed");
+#endif
+#if UIP_FULL_DUPLEX
+      // a backlog of packets (or pause frames being sent) indicates the
+      // receivebuffer might be running full:
+      if (pktcnt > 1 || rxPaused)
+        rxFlowControl(readPtr);
 #endif
       // decrement the packet counter indicate we are done with this packet
       writeOp(ENC28J60_BIT_FIELD_SET, ECON2, ECON2_PKTDEC);
@@ -190,66 +295,159 @@ Enc28J60Network::receivePacket()
       // need to check this.
       if ((rxstat & 0x80) != 0)
         {
+          counters.rxFrames++;
+          counters.rxBytes += len;
           receivePkt.begin = readPtr;
           receivePkt.size = len;
           return UIP_RECEIVEBUFFERHANDLE;
         }
+      if (rxstat & 0x10)
+        counters.rxCrcErrors++;
+      else if (rxstat & 0x20)
+        counters.rxLengthErrors++;
+      else
+        counters.rxDropped++;
       // Move the RX read pointer to the start of the next received packet
       // This frees the memory we just read out
       setERXRDPT();
     }
+#if UIP_FULL_DUPLEX
+  else if (rxPaused)
+    {
+      // receivebuffer drained: send a pause frame with zero time to resume
+      writeReg(EFLOCON, EFLOCON_FCEN1|EFLOCON_FCEN0);
+      rxPaused = false;
+    }
+#endif
   return (NOBLOCK);
 }
 
+#if UIP_FULL_DUPLEX
+void
+Enc28J60Network::rxFlowControl(uint16_t packetPtr)
+{
+  // bytes between the packet being read and the hardware write pointer:
+  uint16_t wrpt = readReg(ERXWRPTL) | readReg(ERXWRPTH) << 8;
+  uint16_t size = rxStop - RXSTART_INIT + 1;
+  uint16_t used = wrpt >= packetPtr ? wrpt - packetPtr : wrpt + size - packetPtr;
+  if (!rxPaused && used > size - (size >> 2))
+    {
+      // more than 3/4 full: send pause frames periodically (EPAUS timer)
+      writeReg(EFLOCON, EFLOCON_FCEN1);
+      rxPaused = true;
+    }
+  else if (rxPaused && used < (size >> 2))
+    {
+      // less than 1/4 full: send a pause frame with zero time, then stop
+      writeReg(EFLOCON, EFLOCON_FCEN1|EFLOCON_FCEN0);
+      rxPaused = false;
+    }
+}
+#endif
+
 void
 Enc28J60Network::setERXRDPT()
 {
-  writeRegPair(ERXRDPTL, nextPacketPtr == RXSTART_INIT ? RXSTOP_INIT : nextPacketPtr-1);
+  // a running DMA still reads from the receivebuffer, release it on completion:
+  if (dmaBusy && dmaFromRx)
+    {
+      rxReleasePtr = nextPacketPtr;
+      rxReleasePending = true;
+      return;
+    }
+  writeERXRDPT(nextPacketPtr);
+}
+
+void
+Enc28J60Network::writeERXRDPT(uint16_t ptr)
+{
+  writeRegPair(ERXRDPTL, ptr == RXSTART_INIT ? rxStop : ptr-1);
+}
+
+uint16_t
+Enc28J60Network::rxWrap(uint16_t address)
+{
+  // the receivebuffer is a ringbuffer, addresses beyond rxStop continue at RXSTART_INIT
+  return address > rxStop ? address - (rxStop - RXSTART_INIT + 1) : address;
 }
 
 memaddress
 Enc28J60Network::blockSize(memhandle handle)
 {
-  return handle == NOBLOCK ? 0 : handle == UIP_RECEIVEBUFFERHANDLE ? receivePkt.size : blocks[handle].size;
+  return handle == NOBLOCK ? 0 : handle == UIP_RECEIVEBUFFERHANDLE ? receivePkt.size : MemoryPool::blockSize(handle);
 }
 
 bool
 Enc28J60Network::sendPacket(memhandle handle)
 {
-  memblock *packet = &blocks[handle];
-  uint16_t start = packet->begin;
-  uint16_t end = start + packet->size - (UIP_SENDBUFFER_OFFSET + UIP_SENDBUFFER_PADDING);
-
-  // write control-byte
-  writeByte(start, 0);
-
-  // TX start
-  writeRegPair(ETXSTL, start);
-  // Set the TXND pointer to correspond to the packet size given
-  writeRegPair(ETXNDL, end);
-
-  uint8_t eir;
+  if (handle == NOBLOCK)
+    return false;
+  ENC28J60_PROFILE(SEND);
+  // the transmitter needs the frame in one piece
+  handle = linearize(handle);
+  if (handle == NOBLOCK)
+    return false;
+  // all slots taken: wait for the frame on the wire to complete
+  if (txQueueLen == UIP_TX_QUEUE)
+    {
+      ENC28J60_PROFILE_WAIT();
+      unsigned long start = micros();
+      do
+        {
+          pollTransmit();
+        }
+      while (txQueueLen == UIP_TX_QUEUE);
+      counters.txQueueFull++;
+      counters.txWaitMicros += micros() - start;
+    }
+  txQueue[txQueueLen++] = handle;
+  if (txQueueLen > counters.txQueueMax)
+    counters.txQueueMax = txQueueLen;
+  // start transmission right away if the transmitter is idle
+  if (!txBusy)
+    startTransmit();
+  return true;
+}
 
-  // Reset the transmit logic problem. See Rev. B7 Silicon Errata issues 12 and 13
-  writeOp(ENC28J60_BIT_FIELD_SET, ECON1, ECON1_TXRST);
-  writeOp(ENC28J60_BIT_FIELD_CLR, ECON1, ECON1_TXRST);
-  writeOp(ENC28J60_BIT_FIELD_CLR, EIR, EIR_TXERIF |  EIR_TXIF);
-  // send the contents of the transmit buffer onto the network
-  writeOp(ENC28J60_BIT_FIELD_SET, ECON1, ECON1_TXRTS);
-  // wait for transmission to complete or fail
-  {
-    unsigned long timer = millis();
-    while (((eir = readReg(EIR)) & (EIR_TXIF | EIR_TXERIF)) == 0) {
-      if (millis() - timer > 1000) {
-	/* Transmit hardware probably hung, try again later. */
-	/* Shouldn't happen according to errata 12 and 13. */
-	writeOp(ENC28J60_BIT_FIELD_CLR, ECON1, ECON1_TXRTS);
-	return false;
-      }
+void
+Enc28J60Network::pollTransmit()
+{
+  if (!txBusy)
+    return;
+  ENC28J60_PROFILE(TRANSMIT);
+  uint8_t eir = readReg(EIR);
+  if ((eir & (EIR_TXIF | EIR_TXERIF)) == 0)
+    {
+      if (millis() - txStarted <= 1000)
+        return;
+      /* Transmit hardware probably hung, drop the frame. */
+      /* Shouldn't happen according to errata 12 and 13. */
+      eir |= EIR_TXERIF;
     }
-  }
   writeOp(ENC28J60_BIT_FIELD_CLR, ECON1, ECON1_TXRTS);
+  txBusy = false;
 
+  memhandle handle = txQueue[0];
+  memblock *packet = &blocks[handle];
+  uint16_t start = packet->begin;
+  uint16_t end = start + packet->size - (UIP_SENDBUFFER_OFFSET + UIP_SENDBUFFER_PADDING);
+  // the transmit status vector is written right behind the frame
+  // (see datasheet page 42, table 7-1):
+  uint8_t tsv[4];
+  writeRegPair(ERDPTL, end+1);
+  readBuffer(sizeof(tsv), tsv);
+  counters.txCollisions += tsv[2] & 0x0F;
+  if (tsv[3] & 0x20)
+    counters.txLateCollisions++;
+  if (tsv[3] & 0x18)
+    counters.txAborts++;
+  if (eir & EIR_TXERIF)
+    counters.txErrors++;
+  else
+    {
+      counters.txFrames++;
+      counters.txBytes += end - start;
+    }
 #ifdef ENC28J60DEBUG
   Serial.print(F("sendPacket("));
   Serial.print(handle);
@@ -274,16 +472,110 @@ Enc28J60Network::sendPacket(memhandle handle)
   Serial.print(eir,BIN);
   Serial.println();
 #endif
-  return (eir & EIR_TXERIF) == 0;
+  // the frame is on the wire (or failed), release its memory:
+  freeBlock(handle);
+  txQueueLen--;
+  for (uint8_t i = 0; i < txQueueLen; i++)
+    txQueue[i] = txQueue[i+1];
+  if (txQueueLen)
+    startTransmit();
+}
+
+void
+Enc28J60Network::startTransmit()
+{
+  memblock *packet = &blocks[txQueue[0]];
+  uint16_t start = packet->begin;
+  uint16_t end = start + packet->size - (UIP_SENDBUFFER_OFFSET + UIP_SENDBUFFER_PADDING);
+
+  // the transmitter reads the whole frame:
+  dmaGuard(start, packet->size, false);
+
+  // write control-byte
+  writeByte(start, 0);
+
+  // TX start
+  writeRegPair(ETXSTL, start);
+  // Set the TXND pointer to correspond to the packet size given
+  writeRegPair(ETXNDL, end);
+
+  // Reset the transmit logic problem. See Rev. B7 Silicon Errata issues 12 and 13
+  writeOp(ENC28J60_BIT_FIELD_SET, ECON1, ECON1_TXRST);
+  writeOp(ENC28J60_BIT_FIELD_CLR, ECON1, ECON1_TXRST);
+  writeOp(ENC28J60_BIT_FIELD_CLR, EIR, EIR_TXERIF |  EIR_TXIF);
+  // send the contents of the transmit buffer onto the network
+  writeOp(ENC28J60_BIT_FIELD_SET, ECON1, ECON1_TXRTS);
+  txStarted = millis();
+  txBusy = true;
+}
+
+void
+Enc28J60Network::waitTransmit()
+{
+  // wait for the transmitter to finish the current frame without touching
+  // the queue (we might be called from within MemoryPool::allocBlock):
+  if (!txBusy)
+    return;
+  ENC28J60_PROFILE_WAIT();
+  unsigned long start = micros();
+  while ((readReg(EIR) & (EIR_TXIF | EIR_TXERIF)) == 0 && millis() - txStarted <= 1000);
+  counters.txWaitMicros += micros() - start;
+}
+
+uint8_t
+Enc28J60Network::txQueueDepth()
+{
+  return txQueueLen;
+}
+
+const struct enc28j60_stats&
+Enc28J60Network::stats()
+{
+  return counters;
+}
+
+void
+Enc28J60Network::resetStats()
+{
+  memset(&counters, 0, sizeof(counters));
+#if UIP_SPI_PROFILE
+  // the profile is taken from the same counters, it starts over as well
+  Enc28J60Profile::reset();
+#endif
+}
+
+uint8_t
+Enc28J60Network::txQueueMaxDepth()
+{
+  return counters.txQueueMax;
+}
+
+unsigned long
+Enc28J60Network::txWaitMicros()
+{
+  return counters.txWaitMicros;
+}
+
+unsigned long
+Enc28J60Network::spiOperations()
+{
+  return counters.spiOps;
+}
+
+memaddress
+Enc28J60Network::blockAddress(memhandle handle, memaddress position)
+{
+  if (handle == UIP_RECEIVEBUFFERHANDLE)
+    return rxWrap(receivePkt.begin + position);
+  return blocks[handle].begin + position;
 }
 
 uint16_t
 Enc28J60Network::setReadPtr(memhandle handle, memaddress position, uint16_t len)
 {
   memblock *packet = handle == UIP_RECEIVEBUFFERHANDLE ? &receivePkt : &blocks[handle];
-  memaddress start = handle == UIP_RECEIVEBUFFERHANDLE && packet->begin + position > RXSTOP_INIT ? packet->begin + position-RXSTOP_INIT+RXSTART_INIT : packet->begin + position;
 
-  writeRegPair(ERDPTL, start);
+  writeRegPair(ERDPTL, blockAddress(handle,position));
   
   if (len > packet->size - position)
     len = packet->size - position;
@@ -293,30 +585,49 @@ Enc28J60Network::setReadPtr(memhandle handle, memaddress position, uint16_t len)
 uint16_t
 Enc28J60Network::readPacket(memhandle handle, memaddress position, uint8_t* buffer, uint16_t len)
 {
-  len = setReadPtr(handle, position, len);
-  readBuffer(len, buffer);
-  return len;
+  ENC28J60_PROFILE(READ);
+  uint16_t read = 0;
+  // a chained block is read extent by extent
+  for (handle = extent(handle, position); handle != NOBLOCK && read < len; handle = nextExtent(handle), position = 0)
+    {
+      uint16_t n = setReadPtr(handle, position, len - read);
+      if (handle != UIP_RECEIVEBUFFERHANDLE)
+        dmaGuard(blocks[handle].begin + position, n, false);
+      readBuffer(n, buffer + read);
+      read += n;
+    }
+  return read;
 }
 
 uint16_t
 Enc28J60Network::writePacket(memhandle handle, memaddress position, uint8_t* buffer, uint16_t len)
 {
-  memblock *packet = &blocks[handle];
-  uint16_t start = packet->begin + position;
+  ENC28J60_PROFILE(WRITE);
+  uint16_t written = 0;
+  for (handle = extent(handle, position); handle != NOBLOCK && written < len; handle = nextExtent(handle), position = 0)
+    {
+      memblock *packet = &blocks[handle];
+      uint16_t start = packet->begin + position;
 
-  writeRegPair(EWRPTL, start);
+      writeRegPair(EWRPTL, start);
 
-  if (len > packet->size - position)
-    len = packet->size - position;
-  writeBuffer(len, buffer);
-  return len;
+      uint16_t n = len - written;
+      if (n > packet->size - position)
+        n = packet->size - position;
+      dmaGuard(start, n, true);
+      writeBuffer(n, buffer + written);
+      written += n;
+    }
+  return written;
 }
 
 uint8_t Enc28J60Network::readByte(uint16_t addr)
 {
+  dmaGuard(addr, 1, false);
   writeRegPair(ERDPTL, addr);
 
   CSACTIVE;
+  counters.spiBytes += 2;
   // issue read command
   SPDR = ENC28J60_READ_BUF_MEM;
   waitspi();
@@ -329,9 +640,11 @@ uint8_t Enc28J60Network::readByte(uint16_t addr)
 
 void Enc28J60Network::writeByte(uint16_t addr, uint8_t data)
 {
+  dmaGuard(addr, 1, true);
   writeRegPair(EWRPTL, addr);
 
   CSACTIVE;
+  counters.spiBytes += 2;
   // issue write command
   SPDR = ENC28J60_WRITE_BUF_MEM;
   waitspi();
@@ -344,28 +657,105 @@ void Enc28J60Network::writeByte(uint16_t addr, uint8_t data)
 void
 Enc28J60Network::copyPacket(memhandle dest_pkt, memaddress dest_pos, memhandle src_pkt, memaddress src_pos, uint16_t len)
 {
-  memblock *dest = &blocks[dest_pkt];
-  memblock *src = src_pkt == UIP_RECEIVEBUFFERHANDLE ? &receivePkt : &blocks[src_pkt];
-  memaddress start = src_pkt == UIP_RECEIVEBUFFERHANDLE && src->begin + src_pos > RXSTOP_INIT ? src->begin + src_pos-RXSTOP_INIT+RXSTART_INIT : src->begin + src_pos;
-  enc28J60_mempool_block_move_callback(dest->begin+dest_pos,start,len);
+  ENC28J60_PROFILE(COPY);
+  // one DMA copy per piece where neither block continues in another extent
+  while (len)
+    {
+      dest_pkt = extent(dest_pkt, dest_pos);
+      src_pkt = extent(src_pkt, src_pos);
+      uint16_t n = len;
+      if (n > blocks[dest_pkt].size - dest_pos)
+        n = blocks[dest_pkt].size - dest_pos;
+      if (src_pkt != UIP_RECEIVEBUFFERHANDLE && n > blocks[src_pkt].size - src_pos)
+        n = blocks[src_pkt].size - src_pos;
+      if (!n)
+        break;
+      dmaCopy(blockAddress(dest_pkt,dest_pos),blockAddress(src_pkt,src_pos),n);
+      dest_pos += n;
+      src_pos += n;
+      len -= n;
+    }
   // Move the RX read pointer to the start of the next received packet
-  // This frees the memory we just read out
+  // This frees the memory we just read out (deferred until the DMA is done)
   setERXRDPT();
 }
 
+bool
+Enc28J60Network::pollDma()
+{
+  ENC28J60_PROFILE(DMA);
+  if (dmaBusy && !(readOp(ENC28J60_READ_CTRL_REG, ECON1) & ECON1_DMAST))
+    dmaComplete();
+  return !dmaBusy;
+}
+
+void
+Enc28J60Network::waitDma()
+{
+  if (!dmaBusy)
+    return;
+  counters.dmaWaits++;
+  {
+    // waiting is accounted to the call that has to wait
+    ENC28J60_PROFILE_WAIT();
+    // wait until runnig DMA is completed
+    while (readOp(ENC28J60_READ_CTRL_REG, ECON1) & ECON1_DMAST);
+  }
+  dmaComplete();
+}
+
+void
+Enc28J60Network::dmaGuard(memaddress start, memaddress len, bool write)
+{
+  // reading is safe unless the DMA writes to the range, writing also
+  // has to wait for the DMA to have read its source
+  if (dmaBusy
+      && ((start < dmaDest + dmaLen && dmaDest < start + len)
+          || (write && !dmaFromRx && start < dmaSrc + dmaLen && dmaSrc < start + len)))
+    waitDma();
+}
+
+void
+Enc28J60Network::dmaComplete()
+{
+  dmaBusy = false;
+  if (rxReleasePending)
+    {
+      rxReleasePending = false;
+      writeERXRDPT(rxReleasePtr);
+    }
+}
+
+void
+mempool_block_move_callback(memaddress dest, memaddress src, memaddress len)
+{
+  ENC28J60_PROFILE(COMPACT);
+  Enc28J60Network::dmaCopy(dest, src, len);
+}
+
 void
-enc28J60_mempool_block_move_callback(memaddress dest, memaddress src, memaddress len)
+Enc28J60Network::dmaCopy(memaddress dest, memaddress src, memaddress len)
 {
-//void
-//Enc28J60Network::memblock_mv_cb(uint16_t dest, uint16_t src, uint16_t len)
-//{
+  // never move a frame the transmitter is still reading from:
+  if (txBusy)
+    {
+      memblock *tx = &blocks[txQueue[0]];
+      if (src < tx->begin + tx->size && tx->begin < src + len)
+        waitTransmit();
+    }
+  // there is only one DMA engine:
+  waitDma();
   //as ENC28J60 DMA is unable to copy single bytes:
   if (len == 1)
     {
-      Enc28J60Network::writeByte(dest,Enc28J60Network::readByte(src));
+      writeByte(dest,readByte(src));
     }
   else
     {
+      dmaSrc = src;
+      dmaDest = dest;
+      dmaLen = len;
+      dmaFromRx = src <= rxStop;
       // calculate address of last byte
       len += src - 1;
 
@@ -383,11 +773,11 @@ enc28J60_mempool_block_move_callback(memaddress dest, memaddress src, memaddress
        prevent a never ending DMA operation which
        would overwrite the entire 8-Kbyte buffer.
        */
-      Enc28J60Network::writeRegPair(EDMASTL, src);
-      Enc28J60Network::writeRegPair(EDMADSTL, dest);
+      writeRegPair(EDMASTL, src);
+      writeRegPair(EDMADSTL, dest);
 
-      if ((src <= RXSTOP_INIT)&& (len > RXSTOP_INIT))len -= (RXSTOP_INIT-RXSTART_INIT);
-      Enc28J60Network::writeRegPair(EDMANDL, len);
+      if (src <= rxStop) len = rxWrap(len);
+      writeRegPair(EDMANDL, len);
 
       /*
        2. If an interrupt at the end of the copy process is
@@ -395,19 +785,21 @@ enc28J60_mempool_block_move_callback(memaddress dest, memaddress src, memaddress
        clear EIR.DMAIF.
 
        3. Verify that ECON1.CSUMEN is clear. */
-      Enc28J60Network::writeOp(ENC28J60_BIT_FIELD_CLR, ECON1, ECON1_CSUMEN);
+      writeOp(ENC28J60_BIT_FIELD_CLR, ECON1, ECON1_CSUMEN);
 
       /* 4. Start the DMA copy by setting ECON1.DMAST. */
-      Enc28J60Network::writeOp(ENC28J60_BIT_FIELD_SET, ECON1, ECON1_DMAST);
+      writeOp(ENC28J60_BIT_FIELD_SET, ECON1, ECON1_DMAST);
 
-      // wait until runnig DMA is completed
-      while (Enc28J60Network::readOp(ENC28J60_READ_CTRL_REG, ECON1) & ECON1_DMAST);
+      // don't wait for completion. Any later access to the source or
+      // destination range calls dmaGuard() which waits if required.
+      dmaBusy = true;
     }
 }
 
 void
 Enc28J60Network::freePacket()
 {
+    ENC28J60_PROFILE(FREE);
     setERXRDPT();
 }
 
@@ -415,6 +807,7 @@ uint8_t
 Enc28J60Network::readOp(uint8_t op, uint8_t address)
 {
   CSACTIVE;
+  counters.spiBytes += address & 0x80 ? 3 : 2;
   // issue read command
   SPDR = op | (address & ADDR_MASK);
   waitspi();
@@ -436,6 +829,7 @@ void
 Enc28J60Network::writeOp(uint8_t op, uint8_t address, uint8_t data)
 {
   CSACTIVE;
+  counters.spiBytes += 2;
   // issue write command
   SPDR = op | (address & ADDR_MASK);
   waitspi();
@@ -449,6 +843,7 @@ void
 Enc28J60Network::readBuffer(uint16_t len, uint8_t* data)
 {
   CSACTIVE;
+  counters.spiBytes += len + 1;
   // issue read command
   SPDR = ENC28J60_READ_BUF_MEM;
   waitspi();
@@ -469,6 +864,7 @@ void
 Enc28J60Network::writeBuffer(uint16_t len, uint8_t* data)
 {
   CSACTIVE;
+  counters.spiBytes += len + 1;
   // issue write command
   SPDR = ENC28J60_WRITE_BUF_MEM;
   waitspi();
@@ -486,16 +882,49 @@ Enc28J60Network::writeBuffer(uint16_t len, uint8_t* data)
 void
 Enc28J60Network::setBank(uint8_t address)
 {
+  // EIE, EIR, ESTAT, ECON2 and ECON1 are accessible from every bank
+  if ((address & ADDR_MASK) >= EIE)
+    return;
   // set the bank (if needed)
   if((address & BANK_MASK) != bank)
   {
-    // set the bank
-    writeOp(ENC28J60_BIT_FIELD_CLR, ECON1, (ECON1_BSEL1|ECON1_BSEL0));
-    writeOp(ENC28J60_BIT_FIELD_SET, ECON1, (address & BANK_MASK)>>5);
+    uint8_t sel = (address & BANK_MASK)>>5;
+    // bank unknown: clear both BSEL bits
+    uint8_t cur = bank == 0xff ? (ECON1_BSEL1|ECON1_BSEL0) : bank>>5;
+    // only clear and set the BSEL bits that actually change
+    if (cur & ~sel)
+      writeOp(ENC28J60_BIT_FIELD_CLR, ECON1, cur & ~sel);
+    if (bank == 0xff)
+      cur = 0;
+    if (sel & ~cur)
+      writeOp(ENC28J60_BIT_FIELD_SET, ECON1, sel & ~cur);
     bank = (address & BANK_MASK);
+    ENC28J60_PROFILE_BANK();
   }
 }
 
+void
+Enc28J60Network::writeRegBatch(const enc28j60_regwrite* regs, uint8_t len)
+{
+  // write the registers grouped by bank, starting with the current bank,
+  // so each bank is selected at most once. The order of writes within
+  // a bank is kept.
+  uint8_t b = bank == 0xff ? 0 : bank;
+  for (uint8_t n = 0; n < 4; n++)
+    {
+      for (uint8_t i = 0; i < len; i++)
+        {
+          uint8_t address = regs[i].address;
+          if ((address & ADDR_MASK) >= EIE ? n == 0 : (address & BANK_MASK) == b)
+            {
+              setBank(address);
+              writeOp(ENC28J60_WRITE_CTRL_REG, address, regs[i].data);
+            }
+        }
+      b = (b + 0x20) & BANK_MASK;
+    }
+}
+
 uint8_t
 Enc28J60Network::readReg(uint8_t address)
 {
@@ -527,11 +956,13 @@ Enc28J60Network::writeRegPair(uint8_t address, uint16_t data)
 void
 Enc28J60Network::phyWrite(uint8_t address, uint16_t data)
 {
+  ENC28J60_PROFILE(PHY);
   // set the PHY register address
   writeReg(MIREGADR, address);
   // write the PHY data
   writeRegPair(MIWRL, data);
   // wait until the PHY write completes
+  ENC28J60_PROFILE_WAIT();
   while(readReg(MISTAT) & MISTAT_BUSY){
     delayMicroseconds(15);
   }
@@ -540,16 +971,123 @@ Enc28J60Network::phyWrite(uint8_t address, uint16_t data)
 uint16_t
 Enc28J60Network::phyRead(uint8_t address)
 {
+  ENC28J60_PROFILE(PHY);
   writeReg(MIREGADR,address);
   writeReg(MICMD, MICMD_MIIRD);
   // wait until the PHY read completes
-  while(readReg(MISTAT) & MISTAT_BUSY){
-    delayMicroseconds(15);
+  {
+    ENC28J60_PROFILE_WAIT();
+    while(readReg(MISTAT) & MISTAT_BUSY){
+      delayMicroseconds(15);
+    }
   }  //and MIRDH
   writeReg(MICMD, 0);
   return (readReg(MIRDL) | readReg(MIRDH) << 8);
 }
 
+void
+Enc28J60Network::setReceiveFilter(uint8_t erxfcon)
+{
+  ENC28J60_PROFILE(FILTER);
+  rxFilter = erxfcon;
+  writeReg(ERXFCON, rxFilter | (broadcastRefs ? ERXFCON_BCEN : 0));
+}
+
+uint8_t
+Enc28J60Network::receiveFilter()
+{
+  return rxFilter;
+}
+
+void
+Enc28J60Network::enableBroadcast()
+{
+  ENC28J60_PROFILE(FILTER);
+  if (broadcastRefs++ == 0 && !(rxFilter & ERXFCON_BCEN))
+    writeReg(ERXFCON, rxFilter | ERXFCON_BCEN);
+}
+
+void
+Enc28J60Network::disableBroadcast()
+{
+  ENC28J60_PROFILE(FILTER);
+  if (broadcastRefs && --broadcastRefs == 0 && !(rxFilter & ERXFCON_BCEN))
+    writeReg(ERXFCON, rxFilter);
+}
+
+void
+Enc28J60Network::setPatternFilter(uint16_t offset, const uint8_t* pattern, const uint8_t* mask)
+{
+  ENC28J60_PROFILE(FILTER);
+  // the chip checksums the bytes selected by the mask (64 bytes starting at
+  // offset) just like an ip-checksum and compares the result to EPMCS
+  uint16_t sum = 0;
+  uint16_t t;
+  bool high = true;
+  for (uint8_t i = 0; i < 64; i++)
+    {
+      if (mask[i >> 3] & (1 << (i & 7)))
+        {
+          t = high ? pattern[i] << 8 : pattern[i];
+          sum += t;
+          if (sum < t)
+            sum++;
+          high = !high;
+        }
+    }
+  sum = ~sum;
+  enc28j60_regwrite regs[] = {
+    { EPMM0, mask[0] }, { EPMM1, mask[1] }, { EPMM2, mask[2] }, { EPMM3, mask[3] },
+    { EPMM4, mask[4] }, { EPMM5, mask[5] }, { EPMM6, mask[6] }, { EPMM7, mask[7] },
+    { EPMCSL, (uint8_t)(sum & 0xFF) },
+    { EPMCSH, (uint8_t)(sum >> 8) },
+    { EPMOL, (uint8_t)(offset & 0xFF) },
+    { EPMOH, (uint8_t)(offset >> 8) }
+  };
+  writeRegBatch(regs, sizeof(regs)/sizeof(enc28j60_regwrite));
+}
+
+void
+Enc28J60Network::setHashFilter(const uint8_t* table)
+{
+  ENC28J60_PROFILE(FILTER);
+  enc28j60_regwrite regs[] = {
+    { EHT0, table[0] }, { EHT1, table[1] }, { EHT2, table[2] }, { EHT3, table[3] },
+    { EHT4, table[4] }, { EHT5, table[5] }, { EHT6, table[6] }, { EHT7, table[7] }
+  };
+  writeRegBatch(regs, sizeof(regs)/sizeof(enc28j60_regwrite));
+}
+
+void
+Enc28J60Network::addHashFilter(const uint8_t* macaddr)
+{
+  ENC28J60_PROFILE(FILTER);
+  uint8_t bit = hashFilterBit(macaddr);
+  uint8_t reg = EHT0 + (bit >> 3);
+  writeReg(reg, readReg(reg) | (1 << (bit & 7)));
+}
+
+uint8_t
+Enc28J60Network::hashFilterBit(const uint8_t* macaddr)
+{
+  // CRC-32 (polynomial 0x04C11DB7) of the destination address, bits are
+  // shifted in lsb first. Bits 28:23 select one of the 64 hash table bits.
+  uint32_t crc = 0xFFFFFFFF;
+  for (uint8_t i = 0; i < 6; i++)
+    {
+      uint8_t b = macaddr[i];
+      for (uint8_t j = 0; j < 8; j++)
+        {
+          bool next = ((crc >> 31) ^ b) & 1;
+          crc <<= 1;
+          if (next)
+            crc ^= 0x04C11DB7;
+          b >>= 1;
+        }
+    }
+  return (crc >> 23) & 0x3F;
+}
+
 void
 Enc28J60Network::clkout(uint8_t clk)
 {
@@ -566,10 +1104,124 @@ Enc28J60Network::getrev(void)
 
 uint16_t
 Enc28J60Network::chksum(uint16_t sum, memhandle handle, memaddress pos, uint16_t len)
+{
+  ENC28J60_PROFILE(CHKSUM);
+  handle = extent(handle, pos);
+  if (nextExtent(handle) == NOBLOCK)
+    return extentChksum(sum, handle, pos, len);
+  // a chained block is summed extent by extent. The sum of an extent
+  // starting at an odd offset has its bytes swapped (see RFC 1071)
+  uint16_t done = 0;
+  for (; handle != NOBLOCK && done < len; handle = nextExtent(handle), pos = 0)
+    {
+      uint16_t n = blocks[handle].size - pos;
+      if (n > len - done)
+        n = len - done;
+      if (!n)
+        continue;
+      uint16_t t = extentChksum(0, handle, pos, n);
+      if (done & 1)
+        t = (t << 8) | (t >> 8);
+      sum += t;
+      if(sum < t) {
+        sum++;            /* carry */
+      }
+      done += n;
+    }
+  return sum;
+}
+
+uint16_t
+Enc28J60Network::extentChksum(uint16_t sum, memhandle handle, memaddress pos, uint16_t len)
+{
+#if UIP_HW_CHECKSUM
+  // a single byte is cheaper to read than to program the DMA for:
+  if (len > 1)
+    return hwchksum(sum, handle, pos, len);
+#endif
+  return swchksum(sum, handle, pos, len);
+}
+
+uint16_t
+Enc28J60Network::hwchksum(uint16_t sum, memhandle handle, memaddress pos, uint16_t len)
+{
+  memblock *packet = handle == UIP_RECEIVEBUFFERHANDLE ? &receivePkt : &blocks[handle];
+  if (len > packet->size - pos)
+    len = packet->size - pos;
+  if (len == 0)
+    return sum;
+
+  // the checksum calculation uses the one DMA engine:
+  waitDma();
+
+  // the checksum may come out wrong if a frame is received while it is
+  // calculated (see Rev. B7 Silicon Errata issue 15). Pause reception,
+  // a frame already on its way is completed first. Frames starting to
+  // arrive while reception is off are lost (and not counted by the chip),
+  // the pause lasts as long as the SPI operations below and the DMA take,
+  // a few dozen microseconds. Neither wait is unbounded, if one doesn't
+  // finish the checksum is calculated in software
+  uint16_t spins = ENC28J60_CHKSUM_SPINS;
+  counters.rxPauses++;
+  writeOp(ENC28J60_BIT_FIELD_CLR, ECON1, ECON1_RXEN);
+  if (readOp(ENC28J60_READ_CTRL_REG, ESTAT) & ESTAT_RXBUSY)
+    {
+      counters.rxPauseWaits++;
+      while ((readOp(ENC28J60_READ_CTRL_REG, ESTAT) & ESTAT_RXBUSY) && --spins);
+    }
+
+  if (spins)
+    {
+      memaddress start = blockAddress(handle,pos);
+      // calculate address of last byte
+      memaddress end = start + len - 1;
+      if (handle == UIP_RECEIVEBUFFERHANDLE) end = rxWrap(end);
+
+      /* 1. Program the EDMAST and EDMAND register pairs to point to the first
+       and last byte of the range to checksum. The DMA wraps around the
+       receivebuffer just as it does when copying. */
+      writeRegPair(EDMASTL, start);
+      writeRegPair(EDMANDL, end);
+
+      /* 2. Start the calculation by setting ECON1.CSUMEN and ECON1.DMAST */
+      writeOp(ENC28J60_BIT_FIELD_SET, ECON1, ECON1_CSUMEN | ECON1_DMAST);
+
+      // wait until the checksum engine is done (DMAST is cleared by hardware)
+      spins = ENC28J60_CHKSUM_SPINS;
+      ENC28J60_PROFILE_WAIT();
+      while ((readOp(ENC28J60_READ_CTRL_REG, ECON1) & ECON1_DMAST) && --spins);
+    }
+  // clearing DMAST aborts a calculation that didn't finish
+  writeOp(ENC28J60_BIT_FIELD_CLR, ECON1, ECON1_CSUMEN | ECON1_DMAST);
+  writeOp(ENC28J60_BIT_FIELD_SET, ECON1, ECON1_RXEN);
+  if (!spins)
+    {
+      counters.chksumTimeouts++;
+      return swchksum(sum, handle, pos, len);
+    }
+
+  /* 3. EDMACSH:EDMACSL hold the complemented 16-bit ones-complement sum
+   (in network byte order). Undo the complement and add it to sum. An odd
+   trailing byte is padded with zero just like the software path does. */
+  uint16_t t = ~((readReg(EDMACSH) << 8) | readReg(EDMACSL));
+  sum += t;
+  if(sum < t) {
+    sum++;            /* carry */
+  }
+
+  /* Return sum in host byte order. */
+  return sum;
+}
+
+uint16_t
+Enc28J60Network::swchksum(uint16_t sum, memhandle handle, memaddress pos, uint16_t len)
 {
   uint16_t t;
   len = setReadPtr(handle, pos, len)-1;
+  if (handle != UIP_RECEIVEBUFFERHANDLE)
+    dmaGuard(blocks[handle].begin + pos, len + 1, false);
   CSACTIVE;
+  counters.spiBytes += len + 2;
   // issue read command
   SPDR = ENC28J60_READ_BUF_MEM;
   waitspi();
@@ -606,6 +1258,10 @@ Enc28J60Network::chksum(uint16_t sum, memhandle handle, memaddress pos, uint16_t
 void
 Enc28J60Network::powerOff()
 {
+  // drain the transmit queue before shutting down
+  while (txQueueLen)
+    pollTransmit();
+  waitDma();
   writeOp(ENC28J60_BIT_FIELD_CLR, ECON1, ECON1_RXEN);
   delay(50);
   writeOp(ENC28J60_BIT_FIELD_SET, ECON2, ECON2_VRPS);
@@ -26,6 +26,7 @@
 #define Enc28J60Network_H_
 
 #include "mempool.h"
+#include "enc28j60_profile.h"
 
 #define ENC28J60_CONTROL_CS     SS
 #define SPI_MOSI        MOSI
@@ -35,11 +36,52 @@
 
 #define UIP_RECEIVEBUFFERHANDLE 0xff
 
+// unicast to our mac, ARP-broadcasts (via pattern match) and valid CRC only
+#define UIP_RECEIVEFILTER_DEFAULT (ERXFCON_UCEN|ERXFCON_CRCEN|ERXFCON_PMEN)
+
 #define UIP_SENDBUFFER_PADDING 7
 #define UIP_SENDBUFFER_OFFSET 1
 
+// bound of the waits in hwchksum() for the receiver and the checksum engine
+// (register reads, each takes a microsecond or more). A frame of maximum
+// size takes 1.2ms at 10MBit/s
+#define ENC28J60_CHKSUM_SPINS 2000
+
 //#define ENC28J60DEBUG
 
+// a single control register write as used by Enc28J60Network::writeRegBatch()
+struct enc28j60_regwrite
+{
+  uint8_t address;
+  uint8_t data;
+};
+
+// traffic and error counters since power up, see Enc28J60Network::stats()
+struct enc28j60_stats
+{
+  unsigned long rxFrames;
+  unsigned long rxBytes;
+  unsigned long rxCrcErrors;      // frames with bad CRC (only when ERXFCON_CRCEN is cleared)
+  unsigned long rxLengthErrors;   // length field didn't match the frame size
+  unsigned long rxDropped;        // other frames not received ok
+  unsigned long rxOverflows;      // receivebuffer full or packet counter at 255 (EIR.RXERIF)
+  unsigned long txFrames;
+  unsigned long txBytes;
+  unsigned long txErrors;         // EIR.TXERIF or transmitter hung
+  unsigned long txCollisions;     // sum of collisions (retries) before the frame went out
+  unsigned long txLateCollisions;
+  unsigned long txAborts;         // excessive collisions or defers
+  unsigned long txQueueFull;      // sendPacket() had to wait for a free slot
+  unsigned long txWaitMicros;     // time spent waiting in sendPacket() and for the transmitter
+  uint8_t txQueueMax;             // highest number of frames queued
+  unsigned long dmaWaits;         // accesses that had to wait for a running DMA
+  unsigned long rxPauses;         // checksums calculated with reception turned off, see hwchksum()
+  unsigned long rxPauseWaits;     // of these had to wait for a frame being received
+  unsigned long chksumTimeouts;   // receiver or checksum engine didn't finish, calculated in software
+  unsigned long spiOps;           // CS assertions
+  unsigned long spiBytes;
+};
+
 /*
  * Empfangen von ip-header, arp etc...
  * wenn tcp/udp -> tcp/udp-callback -> assign new packet to connection
@@ -51,13 +93,53 @@ class Enc28J60Network : public MemoryPool
 private:
   static uint16_t nextPacketPtr;
   static uint8_t bank;
+  static uint16_t rxStop;
+  static uint8_t rxFilter;
+  static uint8_t broadcastRefs;
+  static struct enc28j60_stats counters;
 
   static struct memblock receivePkt;
 
+  static memhandle txQueue[UIP_TX_QUEUE];
+  static uint8_t txQueueLen;
+  static bool txBusy;
+  static unsigned long txStarted;
+
+  static void startTransmit();
+  static void waitTransmit();
+
+  static bool dmaBusy;
+  static bool dmaFromRx;
+  static memaddress dmaSrc;
+  static memaddress dmaDest;
+  static memaddress dmaLen;
+  static bool rxReleasePending;
+  static uint16_t rxReleasePtr;
+
+  static void dmaCopy(memaddress dest, memaddress src, memaddress len);
+  static void dmaGuard(memaddress start, memaddress len, bool write);
+  static void dmaComplete();
+
+#if UIP_FULL_DUPLEX
+  static bool rxPaused;
+
+  static void rxFlowControl(uint16_t packetPtr);
+#endif
+
+#if UIP_INT_PIN >= 0
+  static volatile bool rxInterrupt;
+  static unsigned long rxPolled;
+
+  static void interrupt();
+#endif
+
   static uint8_t readOp(uint8_t op, uint8_t address);
   static void writeOp(uint8_t op, uint8_t address, uint8_t data);
+  static memaddress blockAddress(memhandle handle, memaddress position);
   static uint16_t setReadPtr(memhandle handle, memaddress position, uint16_t len);
   static void setERXRDPT();
+  static void writeERXRDPT(uint16_t ptr);
+  static uint16_t rxWrap(uint16_t address);
   static void readBuffer(uint16_t len, uint8_t* data);
   static void writeBuffer(uint16_t len, uint8_t* data);
   static uint8_t readByte(uint16_t addr);
@@ -66,11 +148,15 @@ private:
   static uint8_t readReg(uint8_t address);
   static void writeReg(uint8_t address, uint8_t data);
   static void writeRegPair(uint8_t address, uint16_t data);
+  static void writeRegBatch(const enc28j60_regwrite* regs, uint8_t len);
   static void phyWrite(uint8_t address, uint16_t data);
   static uint16_t phyRead(uint8_t address);
   static void clkout(uint8_t clk);
+  static uint16_t extentChksum(uint16_t sum, memhandle handle, memaddress pos, uint16_t len);
+  static uint16_t swchksum(uint16_t sum, memhandle handle, memaddress pos, uint16_t len);
+  static uint16_t hwchksum(uint16_t sum, memhandle handle, memaddress pos, uint16_t len);
 
-  friend void enc28J60_mempool_block_move_callback(memaddress,memaddress,memaddress);
+  friend void mempool_block_move_callback(memaddress,memaddress,memaddress);
 
 public:
 
@@ -79,14 +165,43 @@ public:
   void powerOff();
   bool linkStatus();
 
-  static void init(uint8_t* macaddr);
+  static void init(uint8_t* macaddr, uint16_t rxsize = RXSIZE_TXHEAVY);
   static memhandle receivePacket();
   static void freePacket();
   static memaddress blockSize(memhandle handle);
+  // queues the frame for transmission, the driver frees the block once it is sent
   static bool sendPacket(memhandle handle);
+  // completes the frame on the wire and starts the next one without waiting
+  static void pollTransmit();
+  // receive filter, combination of ERXFCON_* flags (see enc28j60.h)
+  static void setReceiveFilter(uint8_t erxfcon);
+  static uint8_t receiveFilter();
+  // accept all broadcasts while at least one caller needs them (counted)
+  static void enableBroadcast();
+  static void disableBroadcast();
+  // pattern match filter (ERXFCON_PMEN): mask selects bytes of the 64 byte
+  // window starting at offset, pattern holds their values
+  static void setPatternFilter(uint16_t offset, const uint8_t* pattern, const uint8_t* mask);
+  // hash table filter (ERXFCON_HTEN), table is EHT0-EHT7
+  static void setHashFilter(const uint8_t* table);
+  static void addHashFilter(const uint8_t* macaddr);
+  static uint8_t hashFilterBit(const uint8_t* macaddr);
+  static uint8_t txQueueDepth();
+  // counters since power up or the last resetStats()
+  static const struct enc28j60_stats& stats();
+  static void resetStats();
+  static uint8_t txQueueMaxDepth();
+  static unsigned long txWaitMicros();
+  // number of SPI operations (CS assertions)
+  static unsigned long spiOperations();
   static uint16_t readPacket(memhandle handle, memaddress position, uint8_t* buffer, uint16_t len);
   static uint16_t writePacket(memhandle handle, memaddress position, uint8_t* buffer, uint16_t len);
+  // starts a DMA copy and returns without waiting for it to complete
   static void copyPacket(memhandle dest, memaddress dest_pos, memhandle src, memaddress src_pos, uint16_t len);
+  // returns true when no DMA copy is running (completing a finished one)
+  static bool pollDma();
+  // blocks until a running DMA copy is completed
+  static void waitDma();
   static uint16_t chksum(uint16_t sum, memhandle handle, memaddress pos, uint16_t len);
 };
 
@@ -0,0 +1,61 @@
+/*
+ UIPNetwork.h - the network driver UIPEthernet runs on.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UIPNETWORK_H
+#define UIPNETWORK_H
+
+#include "uipethernet-conf.h"
+
+/*
+ * UIPEthernet calls its network driver through UIPNetwork, which is the
+ * class selected by UIP_NETWORK at compile time (Enc28J60Network unless
+ * the build says otherwise). As everything else in the stack a driver
+ * is a MemoryPool with static methods only, so there's no indirection
+ * left once compiled. A driver provides:
+ *
+ *  init(macaddr, rxsize)   reset and split the buffer memory into
+ *                          rxsize bytes for receiving, the rest for the
+ *                          MemoryPool (see RXSIZE_* in enc28j60.h)
+ *  receivePacket()         next received frame as UIP_RECEIVEBUFFERHANDLE,
+ *                          NOBLOCK if there is none
+ *  freePacket()            drops the received frame
+ *  sendPacket(handle)      queues a block for sending, the frame starts at
+ *                          UIP_SENDBUFFER_OFFSET and is followed by
+ *                          UIP_SENDBUFFER_PADDING bytes. The driver frees
+ *                          the block once it is sent
+ *  pollTransmit()          background work, called from every tick()
+ *  pollDma()
+ *  blockSize(handle)       block access for the MemoryPool blocks and the
+ *  readPacket(...)         received frame
+ *  writePacket(...)
+ *  copyPacket(...)
+ *  chksum(...)             internet checksum over part of a block
+ *  setReceiveFilter(f)     receive filter as ERXFCON_* flags
+ *  receiveFilter()
+ *  enableBroadcast()       counted, see Enc28J60Network
+ *  disableBroadcast()
+ *  setHashFilter(table)    multicast hash table and the bit a mac maps to
+ *  hashFilterBit(mac)
+ *
+ * and mempool_block_move_callback() to move memory for MemoryPool.
+ */
+
+#include UIP_NETWORK_HEADER
+
+typedef UIP_NETWORK UIPNetwork;
+
+#endif
@@ -198,6 +198,10 @@
 #define MACON3_HFRMLEN   0x04
 #define MACON3_FRMLNEN   0x02
 #define MACON3_FULDPX    0x01
+// ENC28J60 EFLOCON Register Bit Definitions
+#define EFLOCON_FULDPXS  0x04
+#define EFLOCON_FCEN1    0x02
+#define EFLOCON_FCEN0    0x01
 // ENC28J60 MICMD Register Bit Definitions
 #define MICMD_MIISCAN    0x02
 #define MICMD_MIIRD      0x01
@@ -249,6 +253,15 @@
 #define TXSTART_INIT     (RXSTOP_INIT+1)
 // stp TX buffer at end of mem
 #define TXSTOP_INIT      0x1FFF
+// size of the receive buffer, may be chosen at runtime (see UIPEthernet.begin()).
+// The rest of the 8K ram is used by the mempool for packets to be sent
+#define RXSIZE_TXHEAVY   0x0800 // 2K receive, 6K transmit (default, same as RXSTOP_INIT)
+#define RXSIZE_BALANCED  0x1000 // 4K receive, 4K transmit
+#define RXSIZE_RXHEAVY   0x1400 // 5K receive, 3K transmit
+// receive buffer must hold one full frame, mempool one frame plus the
+// sockets' packets
+#define RXSIZE_MIN       0x0600
+#define RXSIZE_MAX       0x1800
 //
 // max frame length which the conroller will accept:
 #define        MAX_FRAMELEN        1500        // (note: maximum ethernet frame length would be 1518)
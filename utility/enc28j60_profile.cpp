@@ -0,0 +1,135 @@
+/*
+ enc28j60_profile.cpp - SPI cost of Enc28J60Network by driver call.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "enc28j60_profile.h"
+
+#if UIP_SPI_PROFILE
+
+#include <string.h>
+#include "Enc28J60Network.h"
+
+#define PROFILE_NAME 8
+#define PROFILE_COLUMN 10
+
+struct enc28j60_profile_entry Enc28J60Profile::sites[ENC28J60_PROFILE_SITES];
+unsigned long Enc28J60Profile::bankSwitches;
+uint8_t Enc28J60Profile::current = ENC28J60_PROFILE_OTHER;
+unsigned long Enc28J60Profile::markOps;
+unsigned long Enc28J60Profile::markBytes;
+unsigned long Enc28J60Profile::markBanks;
+
+void
+Enc28J60Profile::account()
+{
+  struct enc28j60_profile_entry* entry = &sites[current];
+  entry->spiOps += Enc28J60Network::stats().spiOps - markOps;
+  entry->spiBytes += Enc28J60Network::stats().spiBytes - markBytes;
+  entry->bankSwitches += bankSwitches - markBanks;
+  markOps = Enc28J60Network::stats().spiOps;
+  markBytes = Enc28J60Network::stats().spiBytes;
+  markBanks = bankSwitches;
+}
+
+uint8_t
+Enc28J60Profile::enter(uint8_t site)
+{
+  account();
+  uint8_t previous = current;
+  current = site;
+  sites[site].calls++;
+  return previous;
+}
+
+void
+Enc28J60Profile::leave(uint8_t previous)
+{
+  account();
+  current = previous;
+}
+
+void
+Enc28J60Profile::wait(unsigned long micros)
+{
+  sites[current].waitMicros += micros;
+}
+
+void
+Enc28J60Profile::reset()
+{
+  account();
+  memset(sites, 0, sizeof(sites));
+}
+
+void
+Enc28J60Profile::column(Print& out, unsigned long value)
+{
+  uint8_t digits = 1;
+  for (unsigned long v = value; v >= 10; v /= 10)
+    digits++;
+  for (uint8_t i = digits; i < PROFILE_COLUMN; i++)
+    out.write(' ');
+  out.print(value);
+}
+
+void
+Enc28J60Profile::dump(Print& out)
+{
+  account();
+  out.println(F("site         calls        cs     bytes     banks   wait us"));
+  struct enc28j60_profile_entry total;
+  memset(&total, 0, sizeof(total));
+  for (uint8_t i = 0; i <= ENC28J60_PROFILE_SITES; i++)
+    {
+      size_t len;
+      struct enc28j60_profile_entry* entry = i < ENC28J60_PROFILE_SITES ? &sites[i] : &total;
+      switch (i)
+        {
+        case ENC28J60_PROFILE_OTHER: len = out.print(F("other")); break;
+        case ENC28J60_PROFILE_INIT: len = out.print(F("init")); break;
+        case ENC28J60_PROFILE_RECEIVE: len = out.print(F("receive")); break;
+        case ENC28J60_PROFILE_FREE: len = out.print(F("free")); break;
+        case ENC28J60_PROFILE_SEND: len = out.print(F("send")); break;
+        case ENC28J60_PROFILE_TRANSMIT: len = out.print(F("transmit")); break;
+        case ENC28J60_PROFILE_READ: len = out.print(F("read")); break;
+        case ENC28J60_PROFILE_WRITE: len = out.print(F("write")); break;
+        case ENC28J60_PROFILE_COPY: len = out.print(F("copy")); break;
+        case ENC28J60_PROFILE_DMA: len = out.print(F("dma")); break;
+        case ENC28J60_PROFILE_CHKSUM: len = out.print(F("chksum")); break;
+        case ENC28J60_PROFILE_COMPACT: len = out.print(F("compact")); break;
+        case ENC28J60_PROFILE_FILTER: len = out.print(F("filter")); break;
+        case ENC28J60_PROFILE_PHY: len = out.print(F("phy")); break;
+        default: len = out.print(F("total")); break;
+        }
+      for (; len < PROFILE_NAME; len++)
+        out.write(' ');
+      column(out, entry->calls);
+      column(out, entry->spiOps);
+      column(out, entry->spiBytes);
+      column(out, entry->bankSwitches);
+      column(out, entry->waitMicros);
+      out.println();
+      if (entry == &total)
+        break;
+      total.calls += entry->calls;
+      total.spiOps += entry->spiOps;
+      total.spiBytes += entry->spiBytes;
+      total.bankSwitches += entry->bankSwitches;
+      total.waitMicros += entry->waitMicros;
+    }
+}
+
+#endif
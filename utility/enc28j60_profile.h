@@ -0,0 +1,128 @@
+/*
+ enc28j60_profile.h - SPI cost of Enc28J60Network by driver call.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ENC28J60_PROFILE_H
+#define ENC28J60_PROFILE_H
+
+#include "uipethernet-conf.h"
+
+#if UIP_SPI_PROFILE
+
+#include <inttypes.h>
+#include "Arduino.h"
+#include "Print.h"
+
+// driver calls the SPI traffic is attributed to
+enum enc28j60_profile_site
+{
+  ENC28J60_PROFILE_OTHER,       // everything outside the calls below
+  ENC28J60_PROFILE_INIT,
+  ENC28J60_PROFILE_RECEIVE,     // receivePacket()
+  ENC28J60_PROFILE_FREE,        // freePacket()
+  ENC28J60_PROFILE_SEND,        // sendPacket()
+  ENC28J60_PROFILE_TRANSMIT,    // pollTransmit()
+  ENC28J60_PROFILE_READ,        // readPacket()
+  ENC28J60_PROFILE_WRITE,       // writePacket()
+  ENC28J60_PROFILE_COPY,        // copyPacket()
+  ENC28J60_PROFILE_DMA,         // pollDma()
+  ENC28J60_PROFILE_CHKSUM,
+  ENC28J60_PROFILE_COMPACT,     // MemoryPool moving blocks
+  ENC28J60_PROFILE_FILTER,      // receive filter setup
+  ENC28J60_PROFILE_PHY,         // PHY register access (linkStatus())
+  ENC28J60_PROFILE_SITES
+};
+
+struct enc28j60_profile_entry
+{
+  unsigned long calls;
+  unsigned long spiOps;         // CS assertions
+  unsigned long spiBytes;
+  unsigned long bankSwitches;   // writes to ECON1.BSEL
+  unsigned long waitMicros;     // busy-waiting for DMA, transmitter, PHY or reset
+};
+
+/*
+ * Attributes the SPI traffic counted in Enc28J60Network::stats() to the
+ * driver call that caused it. Each call listed above opens a scope
+ * (ENC28J60_PROFILE), nested calls are accounted to the innermost one:
+ * phyRead() during init() counts as PHY, a block moved while a frame is
+ * sent as COMPACT. Entering and leaving a scope costs a few subtractions,
+ * the SPI routines themselves are unchanged.
+ *
+ * dump() prints the table to any Print, reset() starts over. Only
+ * compiled in with UIP_SPI_PROFILE set (see uipethernet-conf.h), the
+ * macros are empty otherwise.
+ */
+class Enc28J60Profile
+{
+public:
+  static struct enc28j60_profile_entry sites[ENC28J60_PROFILE_SITES];
+
+  static void reset();
+  static void dump(Print& out);
+
+  // used by the macros below
+  static unsigned long bankSwitches;
+  static uint8_t enter(uint8_t site);
+  static void leave(uint8_t previous);
+  static void wait(unsigned long micros);
+
+private:
+  static uint8_t current;
+  static unsigned long markOps;
+  static unsigned long markBytes;
+  static unsigned long markBanks;
+
+  static void account();
+  static void column(Print& out, unsigned long value);
+};
+
+class Enc28J60ProfileScope
+{
+public:
+  Enc28J60ProfileScope(uint8_t site) : previous(Enc28J60Profile::enter(site)) {}
+  ~Enc28J60ProfileScope() { Enc28J60Profile::leave(previous); }
+
+private:
+  uint8_t previous;
+};
+
+class Enc28J60ProfileWait
+{
+public:
+  Enc28J60ProfileWait() : start(micros()) {}
+  ~Enc28J60ProfileWait() { Enc28J60Profile::wait(micros() - start); }
+
+private:
+  unsigned long start;
+};
+
+// accounts the rest of the enclosing block to the given site
+#define ENC28J60_PROFILE(site) Enc28J60ProfileScope enc28j60_profile_scope(ENC28J60_PROFILE_##site)
+// accounts the time until the end of the enclosing block as waiting
+#define ENC28J60_PROFILE_WAIT() Enc28J60ProfileWait enc28j60_profile_wait
+#define ENC28J60_PROFILE_BANK() Enc28J60Profile::bankSwitches++
+
+#else
+
+#define ENC28J60_PROFILE(site)
+#define ENC28J60_PROFILE_WAIT()
+#define ENC28J60_PROFILE_BANK()
+
+#endif
+
+#endif
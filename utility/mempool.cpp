@@ -21,148 +21,713 @@
 #include <string.h>
 
 #define POOLOFFSET 1
+// end of the free lists, handle 0 (POOLSTART) is a valid member
+#define NOLINK 0xff
 
 struct memblock MemoryPool::blocks[MEMPOOL_NUM_MEMBLOCKS+1];
+memaddress MemoryPool::poolSize;
+memhandle MemoryPool::freeSlots;
+memhandle MemoryPool::freeLists[MEMPOOL_CLASSES];
+uint16_t MemoryPool::freeClasses;
+memaddress MemoryPool::freeTotal;
+memhandle MemoryPool::compactCursor;
+uint8_t MemoryPool::blocksUsed;
+memaddress MemoryPool::ownerUsed[MEMPOOL_NUM_OWNERS];
+struct mempool_stats MemoryPool::poolCounters;
 
+/*
+ * Blocks are kept in a list ordered by address, starting with the empty
+ * block POOLSTART at the start of the pool, so the free space behind each
+ * block is the gap to the next one. Every block with free space behind it
+ * is in the free list of its class (floor(log2(free space))), both lists
+ * are doubly linked. Unused slots are stacked on freeSlots through
+ * nextblock and marked by prevblock == NOLINK.
+ *
+ * allocBlock() and freeBlock() don't walk any list: a request is served
+ * from the free list of its own class if its head fits, else from the
+ * smallest nonempty class above, which always fits. Only if neither does,
+ * the rest of its own class is searched and finally up to
+ * MEMPOOL_COMPACT_ON_ALLOC blocks are moved to collect a gap (or all of
+ * the pool is compacted if that is -1).
+ *
+ * Compacting all of the pool at once can take milliseconds, so
+ * compactStep() does it one block at a time in idle time (see
+ * UIPEthernetClass::tick()) whenever there would be room for a gap of
+ * MEMPOOL_COMPACT_GAP bytes but the free space is split up too much.
+ *
+ * Each block is accounted to its owner (a socket or the stack itself).
+ * Sockets are held to MEMPOOL_SOCKET_QUOTA and the quota of their
+ * protocol and must leave MEMPOOL_CONTROL_RESERVE bytes and a memblock
+ * to the stack, so it can still send when the sockets filled the pool.
+ * Bytes a block holds for frame headers and padding (its overhead) count
+ * against the pool only, the quotas are for data.
+ *
+ * allocChain() doesn't need a gap for all of the block: it may split it
+ * into up to MEMPOOL_MAX_EXTENTS extents linked through chain, the first
+ * one's handle standing for all of them. blockSize(), freeBlock() and
+ * resizeBlock() at position 0 work on the whole chain, the network
+ * drivers walk it with extent() and nextExtent() and make it one piece
+ * with linearize() before the frame is sent. growBlock() chains another
+ * extent to a block that has no room behind it to grow into.
+ *
+ * shareBlock() lets several queues hold the same block, it is freed with
+ * the last reference.
+ */
 void
-MemoryPool::init()
+MemoryPool::init(memaddress start, memaddress size)
 {
   memset(&blocks[0], 0, sizeof(blocks));
-  blocks[POOLSTART].begin = MEMPOOL_STARTADDRESS;
+  poolSize = size;
+  freeTotal = size;
+  compactCursor = POOLSTART;
+  blocksUsed = 0;
+  memset(ownerUsed, 0, sizeof(ownerUsed));
+  memset(&poolCounters, 0, sizeof(poolCounters));
+  blocks[POOLSTART].begin = start;
   blocks[POOLSTART].size = 0;
   blocks[POOLSTART].nextblock = NOBLOCK;
+  freeSlots = NOBLOCK;
+  for (memhandle i = MEMPOOL_NUM_MEMBLOCKS + POOLOFFSET - 1; i >= POOLOFFSET; i--)
+    {
+      blocks[i].prevblock = NOLINK;
+      blocks[i].nextblock = freeSlots;
+      freeSlots = i;
+    }
+  memset(freeLists, NOLINK, sizeof(freeLists));
+  freeClasses = 0;
+  linkFree(POOLSTART);
+}
+
+uint8_t
+MemoryPool::sizeClass(memaddress size)
+{
+  uint8_t c = 0;
+  while (size >>= 1)
+    c++;
+  return c;
+}
+
+memaddress
+MemoryPool::freeSize(memhandle handle)
+{
+  memblock* block = &blocks[handle];
+  memhandle next = block->nextblock;
+  return (next == NOBLOCK ? blocks[POOLSTART].begin + poolSize : blocks[next].begin) - block->begin - block->size;
+}
+
+// must be called after any change to the free space behind the block
+void
+MemoryPool::linkFree(memhandle handle)
+{
+  memaddress free = freeSize(handle);
+  if (!free)
+    return;
+  uint8_t c = sizeClass(free);
+  memblock* block = &blocks[handle];
+  block->prevfree = NOLINK;
+  block->nextfree = freeLists[c];
+  if (freeLists[c] != NOLINK)
+    blocks[freeLists[c]].prevfree = handle;
+  freeLists[c] = handle;
+  freeClasses |= 1 << c;
+}
+
+// must be called before any change to the free space behind the block
+void
+MemoryPool::unlinkFree(memhandle handle)
+{
+  memaddress free = freeSize(handle);
+  if (!free)
+    return;
+  memblock* block = &blocks[handle];
+  if (block->nextfree != NOLINK)
+    blocks[block->nextfree].prevfree = block->prevfree;
+  if (block->prevfree != NOLINK)
+    blocks[block->prevfree].nextfree = block->nextfree;
+  else
+    {
+      uint8_t c = sizeClass(free);
+      freeLists[c] = block->nextfree;
+      if (freeLists[c] == NOLINK)
+        freeClasses &= ~(1 << c);
+    }
+}
+
+memhandle
+MemoryPool::findFree(memaddress size)
+{
+  // every block has room for nothing
+  if (!size)
+    return POOLSTART;
+  uint8_t c = sizeClass(size);
+  memhandle handle = freeLists[c];
+  if (handle != NOLINK && freeSize(handle) >= size)
+    return handle;
+  // free space in a higher class is at least 2^(c+1) > size
+  uint16_t higher = freeClasses & ~((2u << c) - 1);
+  if (higher)
+    {
+      while (!(higher & (2u << c)))
+        c++;
+      return freeLists[c + 1];
+    }
+  for (; handle != NOLINK; handle = blocks[handle].nextfree)
+    if (freeSize(handle) >= size)
+      return handle;
+  return NOLINK;
+}
+
+// closes the gap in front of the block
+void
+MemoryPool::moveDown(memhandle handle)
+{
+  memblock* block = &blocks[handle];
+  memblock* prev = &blocks[block->prevblock];
+  memaddress dest = prev->begin + prev->size;
+  if (dest == block->begin)
+    return;
+  poolCounters.bytesMoved += block->size;
+  unlinkFree(block->prevblock);
+  unlinkFree(handle);
+#ifdef MEMPOOL_MEMBLOCK_MV
+  MEMPOOL_MEMBLOCK_MV(dest,block->begin,block->size);
+#endif
+  block->begin = dest;
+  linkFree(handle);
 }
 
+// moves all blocks to the start of the pool, returns the last block if
+// the free space behind it has room for size
 memhandle
-MemoryPool::allocBlock(memaddress size)
+MemoryPool::compact(memaddress size)
 {
-  memblock* best = NULL;
   memhandle cur = POOLSTART;
-  memblock* block = &blocks[POOLSTART];
-  memaddress bestsize = MEMPOOL_SIZE + 1;
+  memhandle next;
+  poolCounters.compactions++;
+  while ((next = blocks[cur].nextblock) != NOBLOCK)
+    {
+      moveDown(next);
+      cur = next;
+    }
+  compactCursor = POOLSTART;
+  return freeSize(cur) >= size ? cur : NOLINK;
+}
 
-  do
+/*
+ * as compactStep(), but moves at most MEMPOOL_COMPACT_ON_ALLOC blocks and
+ * stops as soon as the gap behind the block moved last has room for size.
+ * Returns that block, NOLINK if there is no such gap yet.
+ */
+memhandle
+MemoryPool::compactFor(memaddress size)
+{
+  memhandle cur = compactCursor;
+  memhandle next;
+  uint8_t moves = MEMPOOL_COMPACT_ON_ALLOC;
+  while (moves && (next = blocks[cur].nextblock) != NOBLOCK)
     {
-      memhandle next = block->nextblock;
-      memaddress freesize = ( next == NOBLOCK ? blocks[POOLSTART].begin + MEMPOOL_SIZE : blocks[next].begin) - block->begin - block->size;
-      if (freesize == size)
-        {
-          best = &blocks[cur];
-          goto found;
-        }
-      if (freesize > size && freesize < bestsize)
+      if (freeSize(cur))
         {
-          bestsize = freesize;
-          best = &blocks[cur];
+          moveDown(next);
+          compactCursor = next;
+          poolCounters.compactSteps++;
+          if (freeSize(next) >= size)
+            return next;
+          moves--;
         }
-      if (next == NOBLOCK)
-        {
-          if (best)
-            goto found;
-          else
-            goto collect;
-        }
-      block = &blocks[next];
       cur = next;
     }
-  while (true);
+  if (next == NOBLOCK)
+    compactCursor = POOLSTART;
+  return NOLINK;
+}
 
-  collect:
+/*
+ * moves the first block behind compactCursor that has a gap in front of
+ * it. The gaps add up behind the block moved last, so this stops as soon
+ * as the free space is in one piece of MEMPOOL_COMPACT_GAP bytes. Returns
+ * true if a block was moved.
+ */
+bool
+MemoryPool::compactStep()
+{
+#if MEMPOOL_COMPACT_GAP
+  if (freeTotal >= MEMPOOL_COMPACT_GAP && findFree(MEMPOOL_COMPACT_GAP) == NOLINK)
     {
-      cur = POOLSTART;
-      block = &blocks[POOLSTART];
+      memhandle cur = compactCursor;
       memhandle next;
-      while ((next = block->nextblock) != NOBLOCK)
+      while ((next = blocks[cur].nextblock) != NOBLOCK)
         {
-          memaddress dest = block->begin + block->size;
-          memblock* nextblock = &blocks[next];
-          memaddress* src = &nextblock->begin;
-          if (dest != *src)
+          if (freeSize(cur))
             {
-#ifdef MEMPOOL_MEMBLOCK_MV
-              MEMPOOL_MEMBLOCK_MV(dest,*src,nextblock->size);
-#endif
-              *src = dest;
+              moveDown(next);
+              compactCursor = next;
+              poolCounters.compactSteps++;
+              return true;
             }
-          block = nextblock;
+          cur = next;
         }
-      if (blocks[POOLSTART].begin + MEMPOOL_SIZE - block->begin - block->size >= size)
-        best = block;
-      else
-        goto notfound;
     }
+  compactCursor = POOLSTART;
+#endif
+  return false;
+}
 
-  found:
+bool
+MemoryPool::withinQuota(memaddress size, uint8_t owner, uint8_t overhead)
+{
+  if (owner == MEMPOOL_OWNER_CONTROL)
+    return true;
+  if (freeTotal < size + MEMPOOL_CONTROL_RESERVE || blocksUsed >= MEMPOOL_NUM_MEMBLOCKS - 1)
+    return false;
+  size -= overhead;
+#if MEMPOOL_SOCKET_QUOTA
+  if (ownerUsed[owner] + size > MEMPOOL_SOCKET_QUOTA)
+    return false;
+#endif
+  bool tcp = owner < MEMPOOL_OWNER_UDP(0);
+  memaddress quota = tcp ? MEMPOOL_TCP_QUOTA : MEMPOOL_UDP_QUOTA;
+  if (quota)
     {
-      block = &blocks[POOLOFFSET];
-      for (cur = POOLOFFSET; cur < MEMPOOL_NUM_MEMBLOCKS + POOLOFFSET; cur++)
-        {
-          if (block->size)
-            {
-              block++;
-              continue;
-            }
-          memaddress address = best->begin + best->size;
+      uint8_t i = tcp ? MEMPOOL_OWNER_TCP(0) : MEMPOOL_OWNER_UDP(0);
+      uint8_t end = tcp ? MEMPOOL_OWNER_UDP(0) : MEMPOOL_OWNER_CONTROL;
+      uint16_t used = size;
+      for (; i < end; i++)
+        used += ownerUsed[i];
+      if (used > quota)
+        return false;
+    }
+  return true;
+}
+
+// takes a slot for a block of size bytes right behind best
+memhandle
+MemoryPool::place(memhandle best, memaddress size, uint8_t owner, uint8_t overhead)
+{
+  memhandle cur = freeSlots;
+  memblock* prev = &blocks[best];
+  memblock* block = &blocks[cur];
+  memaddress address = prev->begin + prev->size;
 #ifdef MEMBLOCK_ALLOC
-          MEMBLOCK_ALLOC(address,size);
+  MEMBLOCK_ALLOC(address,size);
 #endif
-          block->begin = address;
-          block->size = size;
-          block->nextblock = best->nextblock;
-          best->nextblock = cur;
-          return cur;
-        }
+  freeSlots = block->nextblock;
+  freeTotal -= size;
+  ownerUsed[owner] += size - overhead;
+  if (poolSize - freeTotal > poolCounters.usedMax)
+    poolCounters.usedMax = poolSize - freeTotal;
+  if (++blocksUsed > poolCounters.blocksMax)
+    poolCounters.blocksMax = blocksUsed;
+  unlinkFree(best);
+  block->begin = address;
+  block->size = size;
+  block->owner = owner;
+  block->chain = NOBLOCK;
+  block->refs = 0;
+  block->overhead = overhead;
+  block->nextblock = prev->nextblock;
+  block->prevblock = best;
+  if (block->nextblock != NOBLOCK)
+    blocks[block->nextblock].prevblock = cur;
+  prev->nextblock = cur;
+  linkFree(cur);
+  return cur;
+}
+
+memhandle
+MemoryPool::allocBlock(memaddress size, uint8_t owner, uint8_t overhead)
+{
+  memhandle cur = freeSlots;
+  if (cur == NOBLOCK)
+    goto notfound;
+  if (!withinQuota(size, owner, overhead))
+    {
+      poolCounters.quotaDenied++;
+      goto notfound;
     }
+  {
+    memhandle best = findFree(size);
+    // compacting only helps if the free space adds up to size
+    if (best == NOLINK && freeTotal >= size)
+#if MEMPOOL_COMPACT_ON_ALLOC < 0
+      best = compact(size);
+#elif MEMPOOL_COMPACT_ON_ALLOC > 0
+      best = compactFor(size);
+#endif
+    if (best == NOLINK)
+      goto notfound;
+    poolCounters.allocs++;
+    return place(best, size, owner, overhead);
+  }
+
+  notfound:
+  poolCounters.allocFailures++;
+  if (cur == NOBLOCK)
+    poolCounters.noHandle++;
+  {
+    uint8_t bucket = sizeClass(size);
+    bucket = bucket < 6 ? 0 : bucket - 5;
+    poolCounters.failedBySize[bucket < MEMPOOL_SIZE_BUCKETS ? bucket : MEMPOOL_SIZE_BUCKETS - 1]++;
+  }
+  poolCounters.lastFailedSize = size;
+#ifdef MEMBLOCK_ALLOC_FAILED
+  MEMBLOCK_ALLOC_FAILED(size);
+#endif
+  return NOBLOCK;
+}
 
-  notfound: return NOBLOCK;
+/*
+ * as allocBlock(), but when no gap is large enough the block is put
+ * together from the largest gaps instead of compacting the pool. Only if
+ * that takes more than MEMPOOL_MAX_EXTENTS extents (or the memblocks run
+ * out) the pool is compacted after all.
+ */
+memhandle
+MemoryPool::allocChain(memaddress size, uint8_t owner, uint8_t overhead)
+{
+  if (findFree(size) != NOLINK || freeTotal < size || !withinQuota(size, owner, overhead))
+    return allocBlock(size, owner, overhead);
+  memhandle head = NOBLOCK;
+  memhandle* link = &head;
+  memaddress remain = size;
+  for (uint8_t n = 0; remain; n++)
+    {
+      if (n == MEMPOOL_MAX_EXTENTS || freeSlots == NOBLOCK
+          || (owner != MEMPOOL_OWNER_CONTROL && blocksUsed >= MEMPOOL_NUM_MEMBLOCKS - 1))
+        {
+          freeBlock(head);
+          return allocBlock(size, owner, overhead);
+        }
+      // the head of the highest nonempty class
+      uint8_t c = MEMPOOL_CLASSES - 1;
+      while (!(freeClasses & (1 << c)))
+        c--;
+      memhandle best = freeLists[c];
+      memaddress free = freeSize(best);
+      // the overhead is accounted to the first extent, it has to hold it
+      if (!n && free < overhead)
+        return allocBlock(size, owner, overhead);
+      *link = place(best, free < remain ? free : remain, owner, n ? 0 : overhead);
+      remain -= blocks[*link].size;
+      link = &blocks[*link].chain;
+    }
+  poolCounters.allocs++;
+  poolCounters.chained++;
+  return head;
 }
 
 void
 MemoryPool::freeBlock(memhandle handle)
 {
-  if (handle == NOBLOCK)
+  if (handle == NOBLOCK || handle >= MEMPOOL_NUM_MEMBLOCKS + POOLOFFSET)
     return;
-  memblock *b = &blocks[POOLSTART];
-
+  if (blocks[handle].prevblock == NOLINK)
+    return;
+  // the last reference releases the block
+  if (blocks[handle].refs)
+    {
+      blocks[handle].refs--;
+      return;
+    }
   do
     {
-      memhandle next = b->nextblock;
-      if (next == handle)
-        {
-          memblock *f = &blocks[next];
+      memhandle next = blocks[handle].chain;
+      release(handle);
+      handle = next;
+    }
+  while (handle != NOBLOCK);
+}
+
+void
+MemoryPool::release(memhandle handle)
+{
+  memblock* f = &blocks[handle];
 #ifdef MEMBLOCK_FREE
-          MEMBLOCK_FREE(f->begin,f->size);
+  MEMBLOCK_FREE(f->begin,f->size);
 #endif
-          b->nextblock = f->nextblock;
-          f->size = 0;
-          f->nextblock = NOBLOCK;
-          return;
-        }
-      if (next == NOBLOCK)
-        return;
-      b = &blocks[next];
-    }
-  while (true);
+  memhandle prev = f->prevblock;
+  if (compactCursor == handle)
+    compactCursor = prev;
+  freeTotal += f->size;
+  ownerUsed[f->owner] -= f->size - f->overhead;
+  blocksUsed--;
+  unlinkFree(prev);
+  unlinkFree(handle);
+  blocks[prev].nextblock = f->nextblock;
+  if (f->nextblock != NOBLOCK)
+    blocks[f->nextblock].prevblock = prev;
+  linkFree(prev);
+  f->size = 0;
+  f->prevblock = NOLINK;
+  f->nextblock = freeSlots;
+  freeSlots = handle;
 }
 
 void
 MemoryPool::resizeBlock(memhandle handle, memaddress position)
 {
   memblock * block = &blocks[handle];
+  // the free space in front of the block grows
+  unlinkFree(block->prevblock);
+  freeTotal += position;
+  ownerUsed[block->owner] -= position;
   block->begin += position;
   block->size -= position;
+  linkFree(block->prevblock);
 }
 
 void
 MemoryPool::resizeBlock(memhandle handle, memaddress position, memaddress size)
 {
+  // a chained block is cut at the end only (position 0): keep the
+  // extents holding size bytes and cut the last of them
+  memhandle next;
+  while ((next = blocks[handle].chain) != NOBLOCK && size > blocks[handle].size)
+    {
+      size -= blocks[handle].size;
+      handle = next;
+    }
+  if (next != NOBLOCK)
+    {
+      blocks[handle].chain = NOBLOCK;
+      freeBlock(next);
+    }
   memblock * block = &blocks[handle];
+  unlinkFree(block->prevblock);
+  unlinkFree(handle);
+  freeTotal += block->size - size;
+  ownerUsed[block->owner] -= block->size - size;
   block->begin += position;
   block->size = size;
+  linkFree(block->prevblock);
+  linkFree(handle);
 }
 
 memaddress
 MemoryPool::blockSize(memhandle handle)
 {
-  return blocks[handle].size;
+  memaddress size = 0;
+  for (; handle != NOBLOCK; handle = blocks[handle].chain)
+    size += blocks[handle].size;
+  return size;
+}
+
+// the extent of a (chained) block holding position, which becomes the
+// offset into that extent. Handles outside the pool are never chained
+memhandle
+MemoryPool::extent(memhandle handle, memaddress& position)
+{
+  if (handle >= MEMPOOL_NUM_MEMBLOCKS + POOLOFFSET)
+    return handle;
+  memblock* block;
+  while (position >= (block = &blocks[handle])->size && block->chain != NOBLOCK)
+    {
+      position -= block->size;
+      handle = block->chain;
+    }
+  return handle;
+}
+
+memhandle
+MemoryPool::nextExtent(memhandle handle)
+{
+  return handle < MEMPOOL_NUM_MEMBLOCKS + POOLOFFSET ? blocks[handle].chain : NOBLOCK;
+}
+
+/*
+ * makes a chained block one piece, either by growing the first extent
+ * into the free space behind it or in a new block, and returns its handle
+ * (the same one for blocks that aren't chained). On failure the chain is
+ * left alone and NOBLOCK returned.
+ */
+memhandle
+MemoryPool::linearize(memhandle handle)
+{
+  if (handle >= MEMPOOL_NUM_MEMBLOCKS + POOLOFFSET || blocks[handle].chain == NOBLOCK)
+    return handle;
+  memblock* head = &blocks[handle];
+  memaddress size = blockSize(handle);
+  memaddress rest = size - head->size;
+  memhandle linear = handle;
+  memaddress position = head->size;
+  if (freeSize(handle) >= rest)
+    {
+      unlinkFree(handle);
+      head->size = size;
+      freeTotal -= rest;
+      ownerUsed[head->owner] += rest;
+      linkFree(handle);
+    }
+  else
+    {
+      // the frame belongs to the stack now, sockets quotas don't apply
+      linear = allocBlock(size);
+      if (linear == NOBLOCK)
+        return NOBLOCK;
+      MEMPOOL_MEMBLOCK_MV(blocks[linear].begin,head->begin,head->size);
+    }
+  for (memhandle next = head->chain; next != NOBLOCK; next = blocks[next].chain)
+    {
+      MEMPOOL_MEMBLOCK_MV(blocks[linear].begin + position,blocks[next].begin,blocks[next].size);
+      position += blocks[next].size;
+    }
+  poolCounters.linearized++;
+  if (linear == handle)
+    {
+      memhandle tail = head->chain;
+      head->chain = NOBLOCK;
+      freeBlock(tail);
+    }
+  else
+    freeBlock(handle);
+  return linear;
+}
+
+/*
+ * grows a block to size bytes, keeping its contents: into the free space
+ * behind its last extent if there is enough, else by chaining another
+ * extent to it. A chain of MEMPOOL_MAX_EXTENTS extents is copied into a
+ * new block instead. Returns the handle of the grown block (the same one
+ * unless it was copied), on failure NOBLOCK and the block is left alone.
+ */
+memhandle
+MemoryPool::growBlock(memhandle handle, memaddress size)
+{
+  if (handle == NOBLOCK || handle >= MEMPOOL_NUM_MEMBLOCKS + POOLOFFSET)
+    return NOBLOCK;
+  memaddress current = 0;
+  memhandle last;
+  uint8_t extents = 0;
+  for (memhandle next = handle; next != NOBLOCK; next = blocks[next].chain)
+    {
+      current += blocks[next].size;
+      last = next;
+      extents++;
+    }
+  if (size <= current)
+    return handle;
+  memaddress more = size - current;
+  uint8_t owner = blocks[handle].owner;
+  if (!withinQuota(more, owner))
+    {
+      poolCounters.quotaDenied++;
+      return NOBLOCK;
+    }
+  if (freeSize(last) >= more)
+    {
+      memblock* block = &blocks[last];
+      unlinkFree(last);
+      block->size += more;
+      freeTotal -= more;
+      ownerUsed[owner] += more;
+      if (poolSize - freeTotal > poolCounters.usedMax)
+        poolCounters.usedMax = poolSize - freeTotal;
+      linkFree(last);
+      poolCounters.grown++;
+      poolCounters.grownInPlace++;
+      return handle;
+    }
+  if (extents < MEMPOOL_MAX_EXTENTS)
+    {
+      memhandle extent = allocBlock(more, owner);
+      if (extent == NOBLOCK)
+        return NOBLOCK;
+      blocks[last].chain = extent;
+      poolCounters.grown++;
+      return handle;
+    }
+  // the old extents are freed right after the copy, so they don't count
+  // against the quota of the block that replaces them
+  uint8_t overhead = blocks[handle].overhead;
+  ownerUsed[owner] -= current - overhead;
+  memhandle moved = allocBlock(size, owner, overhead);
+  ownerUsed[owner] += current - overhead;
+  if (moved == NOBLOCK)
+    return NOBLOCK;
+  memaddress position = 0;
+  for (memhandle next = handle; next != NOBLOCK; next = blocks[next].chain)
+    {
+      MEMPOOL_MEMBLOCK_MV(blocks[moved].begin + position,blocks[next].begin,blocks[next].size);
+      position += blocks[next].size;
+    }
+  freeBlock(handle);
+  poolCounters.grown++;
+  return moved;
+}
+
+/*
+ * takes another reference to a block, so it can be queued in several
+ * places (see UIPServer::write()). Each reference is dropped by
+ * freeBlock(), the last one frees the block. A shared block must not be
+ * written, resized or grown anymore, it stays accounted to its owner.
+ */
+memhandle
+MemoryPool::shareBlock(memhandle handle)
+{
+  if (handle == NOBLOCK || handle >= MEMPOOL_NUM_MEMBLOCKS + POOLOFFSET
+      || blocks[handle].prevblock == NOLINK || blocks[handle].refs == 0xff)
+    return NOBLOCK;
+  blocks[handle].refs++;
+  poolCounters.shared++;
+  return handle;
+}
+
+// true while references taken by shareBlock() are left, the block must
+// not be cut then
+bool
+MemoryPool::blockShared(memhandle handle)
+{
+  return blocks[handle].refs > 0;
+}
+
+memaddress
+MemoryPool::freeBytes()
+{
+  return freeTotal;
+}
+
+// the largest gap is in the highest nonempty class
+memaddress
+MemoryPool::largestFree()
+{
+  if (!freeClasses)
+    return 0;
+  uint8_t c = MEMPOOL_CLASSES - 1;
+  while (!(freeClasses & (1 << c)))
+    c--;
+  memaddress largest = 0;
+  for (memhandle handle = freeLists[c]; handle != NOLINK; handle = blocks[handle].nextfree)
+    {
+      memaddress free = freeSize(handle);
+      if (free > largest)
+        largest = free;
+    }
+  return largest;
+}
+
+uint8_t
+MemoryPool::liveBlocks()
+{
+  return blocksUsed;
+}
+
+memaddress
+MemoryPool::ownerBytes(uint8_t owner)
+{
+  return ownerUsed[owner];
+}
+
+const struct mempool_stats&
+MemoryPool::poolStats()
+{
+  return poolCounters;
+}
+
+void
+MemoryPool::resetPoolStats()
+{
+  memset(&poolCounters, 0, sizeof(poolCounters));
+  // the high-water marks start over from what is in use now
+  poolCounters.usedMax = poolSize - freeTotal;
+  poolCounters.blocksMax = blocksUsed;
 }
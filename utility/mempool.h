@@ -27,11 +27,48 @@
 
 #include "mempool_conf.h"
 
+// free space behind a block is kept in one list per power of two
+#define MEMPOOL_CLASSES 16
+// most pieces allocChain() splits a block into
+#define MEMPOOL_MAX_EXTENTS 4
+
 struct memblock
 {
   memaddress begin;
   memaddress size;
-  memhandle nextblock;
+  memhandle nextblock;    // blocks ordered by address
+  memhandle prevblock;
+  memhandle nextfree;     // blocks with free space of the same class behind them
+  memhandle prevfree;
+  uint8_t owner;          // MEMPOOL_OWNER_*
+  memhandle chain;        // next extent of a chained block, NOBLOCK after the last
+  uint8_t refs;           // references taken by shareBlock() not freed yet
+  uint8_t overhead;       // frame headers and padding, not counted against the owner's quota
+};
+
+// failed allocations are counted by requested size: below 64, 128, 256,
+// 512, 1024 bytes and above
+#define MEMPOOL_SIZE_BUCKETS 6
+
+// usage and failure counters since init(), see MemoryPool::poolStats()
+struct mempool_stats
+{
+  unsigned long allocs;
+  unsigned long allocFailures;    // allocBlock() returned NOBLOCK
+  unsigned long noHandle;         // of these because all memblocks were in use
+  unsigned long quotaDenied;      // or because the owner was over its quota
+  unsigned long failedBySize[MEMPOOL_SIZE_BUCKETS];
+  memaddress lastFailedSize;
+  memaddress usedMax;             // highest number of bytes allocated
+  uint8_t blocksMax;              // highest number of memblocks in use
+  unsigned long compactions;      // allocBlock() compacted the whole pool
+  unsigned long compactSteps;     // blocks moved one at a time by compactStep() and allocBlock()
+  unsigned long bytesMoved;       // by both
+  unsigned long chained;          // allocChain() found no gap and split the block
+  unsigned long linearized;       // chained blocks copied into one piece to be sent
+  unsigned long grown;            // growBlock() calls that succeeded
+  unsigned long grownInPlace;     // of these without taking another extent
+  unsigned long shared;           // references taken by shareBlock()
 };
 
 class MemoryPool
@@ -42,13 +79,53 @@ class MemoryPool
 
 protected:
   static struct memblock blocks[MEMPOOL_NUM_MEMBLOCKS+1];
+  static memaddress poolSize;
+
+private:
+  static memhandle freeSlots;
+  static memhandle freeLists[MEMPOOL_CLASSES];
+  static uint16_t freeClasses;
+  static memaddress freeTotal;
+  static memhandle compactCursor;
+  static uint8_t blocksUsed;
+  static memaddress ownerUsed[MEMPOOL_NUM_OWNERS];
+  static struct mempool_stats poolCounters;
+
+  static uint8_t sizeClass(memaddress size);
+  static memaddress freeSize(memhandle handle);
+  static void linkFree(memhandle handle);
+  static void unlinkFree(memhandle handle);
+  static memhandle findFree(memaddress size);
+  static void moveDown(memhandle handle);
+  static memhandle compact(memaddress size);
+  static memhandle compactFor(memaddress size);
+  static memhandle place(memhandle best, memaddress size, uint8_t owner, uint8_t overhead = 0);
+  static void release(memhandle handle);
 
 public:
-  static void init();
-  static memhandle allocBlock(memaddress);
+  static void init(memaddress start = MEMPOOL_STARTADDRESS, memaddress size = MEMPOOL_SIZE);
+  static memhandle allocBlock(memaddress size, uint8_t owner = MEMPOOL_OWNER_CONTROL, uint8_t overhead = 0);
+  static bool withinQuota(memaddress size, uint8_t owner, uint8_t overhead = 0);
   static void freeBlock(memhandle);
   static void resizeBlock(memhandle handle, memaddress position);
   static void resizeBlock(memhandle handle, memaddress position, memaddress size);
   static memaddress blockSize(memhandle);
+
+  static memhandle allocChain(memaddress size, uint8_t owner = MEMPOOL_OWNER_CONTROL, uint8_t overhead = 0);
+  static memhandle extent(memhandle handle, memaddress& position);
+  static memhandle nextExtent(memhandle handle);
+  static memhandle linearize(memhandle handle);
+  static memhandle growBlock(memhandle handle, memaddress size);
+  static memhandle shareBlock(memhandle handle);
+  static bool blockShared(memhandle handle);
+  static bool compactStep();
+
+  // counters since init() or the last resetPoolStats()
+  static const struct mempool_stats& poolStats();
+  static void resetPoolStats();
+  static memaddress freeBytes();
+  static memaddress largestFree();
+  static uint8_t liveBlocks();
+  static memaddress ownerBytes(uint8_t owner);
 };
 #endif
@@ -22,13 +22,48 @@ typedef uint8_t memhandle;
 #define NUM_UDP_MEMBLOCKS 0
 #endif
 
-#define MEMPOOL_NUM_MEMBLOCKS (NUM_TCP_MEMBLOCKS+NUM_UDP_MEMBLOCKS)
+#define NUM_TX_MEMBLOCKS UIP_TX_QUEUE
+
+#define MEMPOOL_NUM_MEMBLOCKS (NUM_TCP_MEMBLOCKS+NUM_UDP_MEMBLOCKS+NUM_TX_MEMBLOCKS)
+
+// allocations are accounted to an owner: each tcp and udp socket and the
+// stack itself for the frames it sends on its own (see UIP_SOCKET_QUOTA)
+#if UIP_SOCKET_NUMPACKETS and UIP_CONNS
+#define MEMPOOL_TCP_OWNERS UIP_CONNS
+#else
+#define MEMPOOL_TCP_OWNERS 0
+#endif
+
+#if UIP_UDP and UIP_UDP_CONNS
+#define MEMPOOL_UDP_OWNERS UIP_UDP_CONNS
+#else
+#define MEMPOOL_UDP_OWNERS 0
+#endif
+
+#define MEMPOOL_OWNER_TCP(n) (n)
+#define MEMPOOL_OWNER_UDP(n) (MEMPOOL_TCP_OWNERS+(n))
+#define MEMPOOL_OWNER_CONTROL (MEMPOOL_TCP_OWNERS+MEMPOOL_UDP_OWNERS)
+#define MEMPOOL_NUM_OWNERS (MEMPOOL_OWNER_CONTROL+1)
+
+#define MEMPOOL_SOCKET_QUOTA UIP_SOCKET_QUOTA
+#define MEMPOOL_TCP_QUOTA UIP_TCP_QUOTA
+#define MEMPOOL_UDP_QUOTA UIP_UDP_QUOTA
+#define MEMPOOL_CONTROL_RESERVE UIP_POOL_RESERVE
 
 #define MEMPOOL_STARTADDRESS TXSTART_INIT+1
 #define MEMPOOL_SIZE TXSTOP_INIT-TXSTART_INIT
 
-void enc28J60_mempool_block_move_callback(memaddress,memaddress,memaddress);
+// implemented by the network driver (see UIPNetwork.h)
+void mempool_block_move_callback(memaddress,memaddress,memaddress);
+
+// MemoryPool::compactStep() works towards a gap of this size
+#define MEMPOOL_COMPACT_GAP UIP_COMPACT_GAP
+// blocks allocBlock() may move to make room, -1 for all of them
+#define MEMPOOL_COMPACT_ON_ALLOC UIP_COMPACT_ON_ALLOC
+
+#define MEMPOOL_MEMBLOCK_MV(dest,src,size) mempool_block_move_callback(dest,src,size)
 
-#define MEMPOOL_MEMBLOCK_MV(dest,src,size) enc28J60_mempool_block_move_callback(dest,src,size)
+// builds may define MEMBLOCK_ALLOC(address,size), MEMBLOCK_FREE(address,size)
+// and MEMBLOCK_ALLOC_FAILED(size) to trace the pool
 
 #endif
@@ -115,14 +115,15 @@ typedef unsigned short uip_stats_t;
  *
  * \hideinitializer
  */
-#define UIP_CONF_RECEIVE_WINDOW 512
+#define UIP_CONF_RECEIVE_WINDOW 1024
 
 /**
- * CPU byte order.
+ * CPU byte order. uIPs own constant, the libc LITTLE_ENDIAN has the
+ * value uIP uses for big endian.
  *
  * \hideinitializer
  */
-#define UIP_CONF_BYTE_ORDER      LITTLE_ENDIAN
+#define UIP_CONF_BYTE_ORDER      UIP_LITTLE_ENDIAN
 
 /**
  * Logging on or off
@@ -155,6 +156,13 @@ typedef unsigned short uip_stats_t;
  * #define UIP_CONF_BROADCAST    1
  */
 
+/**
+ * UDP Multicast (receive and IGMPv2 membership) on or off
+ * (see uipethernet-conf.h)
+ * \hideinitializer
+ * #define UIP_CONF_MULTICAST    1
+ */
+
 
 /**
  * uIP statistics on or off
@@ -178,6 +186,11 @@ void uipudp_appcall(void);
 
 #define UIP_UDP_APPCALL uipudp_appcall
 
+struct uip_udp_conn;
+
+/* non-zero if conn takes the datagram in uip_buf (see UIP_MULTICAST) */
+int uipudp_accept(struct uip_udp_conn *conn);
+
 #define CC_REGISTER_ARG register
 
 #define UIP_ARCH_CHKSUM 1
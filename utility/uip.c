@@ -157,6 +157,9 @@ u16_t uip_len, uip_slen;
 				depending on the maximum packet
 				size. */
 
+u16_t uip_acklen;            /* The number of bytes acknowledged by
+				the incoming segment. */
+
 u8_t uip_flags;     /* The uip_flags variable is used for
 				communication between the TCP/IP stack
 				and the application program. */
@@ -192,6 +195,8 @@ static u16_t lastport;       /* Keeps track of the last port used for
 u8_t uip_acc32[4];
 static u8_t c, opt;
 static u16_t tmp16;
+static u8_t uip_rejected;   /* Set by uip_reject() for the segment
+			       being processed. */
 
 /* Structures and definitions. */
 #define TCP_FIN 0x01
@@ -453,8 +458,12 @@ uip_connect(uip_ipaddr_t *ripaddr, u16_t rport)
   conn->snd_nxt[3] = iss[3];
 
   conn->initialmss = conn->mss = UIP_TCP_MSS;
+  conn->snd_wnd = UIP_TCP_MSS;
+  conn->cwnd = UIP_TCP_INITIAL_CWND;
+  conn->ssthresh = 0xffff;
   
   conn->len = 1;   /* TCP length of the SYN is one. */
+  conn->maxlen = 0;
   conn->nrtx = 0;
   conn->timer = 1; /* Send the SYN next time around. */
   conn->rto = UIP_RTO;
@@ -682,6 +691,8 @@ void
 uip_process(u8_t flag)
 {
   register struct uip_conn *uip_connr = uip_conn;
+  /* Offset of new data behind the segments already in flight. */
+  u16_t seqoff = 0;
 
 #if UIP_UDP
   if(flag == UIP_UDP_SEND_CONN) {
@@ -695,7 +706,7 @@ uip_process(u8_t flag)
      particular connection. */
   if(flag == UIP_POLL_REQUEST) {
     if((uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED &&
-       !uip_outstanding(uip_connr)) {
+       uip_outstanding(uip_connr) < uip_window(uip_connr)) {
 	uip_flags = UIP_POLL;
 	UIP_APPCALL();
 	goto appsend;
@@ -755,6 +766,13 @@ uip_process(u8_t flag)
 	    goto tcp_send_nodata;
 	  }
 
+	  /* A segment was lost: go back to slow start from a single
+	     segment, with the threshold at half the data in flight
+	     (RFC 5681). */
+	  uip_connr->ssthresh = uip_connr->len / 2 > 2 * uip_connr->mss?
+	    uip_connr->len / 2: 2 * uip_connr->mss;
+	  uip_connr->cwnd = uip_connr->mss;
+
 	  /* Exponential backoff. */
 	  uip_connr->timer = UIP_RTO << (uip_connr->nrtx > 4?
 					 4:
@@ -798,9 +816,12 @@ uip_process(u8_t flag)
 	    
 	  }
 	}
-      } else if((uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED) {
+      }
+      if((uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED &&
+	 uip_outstanding(uip_connr) < uip_window(uip_connr)) {
 	/* If there was no need for a retransmission, we poll the
-           application for new data. */
+           application for new data as long as the window has room
+           for it. */
 	uip_flags = UIP_POLL;
 	UIP_APPCALL();
 	goto appsend;
@@ -915,6 +936,15 @@ uip_process(u8_t flag)
       goto udp_input;
     }
 #endif /* UIP_BROADCAST */
+
+#if UIP_MULTICAST
+    /* Multicast UDP packets only get here for groups we joined, the
+       membership check is done before uip_input() is called. */
+    if(BUF->proto == UIP_PROTO_UDP &&
+       uip_ipaddr_ismulticast(BUF->destipaddr)) {
+      goto udp_input;
+    }
+#endif /* UIP_MULTICAST */
     
     /* Check if the packet is destined for our IP address. */
 #if !UIP_CONF_IPV6
@@ -1115,7 +1145,11 @@ uip_process(u8_t flag)
         UDPBUF->srcport == uip_udp_conn->rport) &&
        (uip_ipaddr_cmp(uip_udp_conn->ripaddr, all_zeroes_addr) ||
 	uip_ipaddr_cmp(uip_udp_conn->ripaddr, all_ones_addr) ||
-	uip_ipaddr_cmp(BUF->srcipaddr, uip_udp_conn->ripaddr))) {
+	uip_ipaddr_cmp(BUF->srcipaddr, uip_udp_conn->ripaddr))
+#if UIP_MULTICAST
+       && uipudp_accept(uip_udp_conn)
+#endif /* UIP_MULTICAST */
+       ) {
       goto udp_found;
     }
   }
@@ -1315,6 +1349,10 @@ uip_process(u8_t flag)
   uip_connr->snd_nxt[2] = iss[2];
   uip_connr->snd_nxt[3] = iss[3];
   uip_connr->len = 1;
+  uip_connr->maxlen = 0;
+  uip_connr->snd_wnd = UIP_TCP_MSS;
+  uip_connr->cwnd = UIP_TCP_INITIAL_CWND;
+  uip_connr->ssthresh = 0xffff;
 
   /* rcv_nxt should be the seqno from the incoming packet + 1. */
   uip_connr->rcv_nxt[3] = BUF->seqno[3];
@@ -1382,6 +1420,7 @@ uip_process(u8_t flag)
  found:
   uip_conn = uip_connr;
   uip_flags = 0;
+  uip_rejected = 0;
   /* We do a very naive form of TCP reset processing; we just accept
      any RST and kill our connection. We should in fact check if the
      sequence number of this reset is wihtin our advertised window
@@ -1416,22 +1455,26 @@ uip_process(u8_t flag)
   }
 
   /* Next, check if the incoming segment acknowledges any outstanding
-     data. If so, we update the sequence number, reset the length of
-     the outstanding data, calculate RTT estimations, and reset the
-     retransmission timer. */
-  if((BUF->flags & TCP_ACK) && uip_outstanding(uip_connr)) {
-    uip_add32(uip_connr->snd_nxt, uip_connr->len);
-
-    if(BUF->ackno[0] == uip_acc32[0] &&
-       BUF->ackno[1] == uip_acc32[1] &&
-       BUF->ackno[2] == uip_acc32[2] &&
-       BUF->ackno[3] == uip_acc32[3]) {
+     data. If so, we update the sequence number, reduce the length of
+     the outstanding data, calculate RTT estimations, open the
+     congestion window and reset the retransmission timer. With
+     several segments in flight the acknowledgment may cover only the
+     oldest of them, so anything between none and all of the data
+     sent counts. After a retransmission that may be more than is in
+     flight. */
+  if((BUF->flags & TCP_ACK) &&
+     (uip_outstanding(uip_connr) || uip_connr->maxlen)) {
+    uip_acklen = (((u16_t)BUF->ackno[2] << 8) | BUF->ackno[3]) -
+      (((u16_t)uip_connr->snd_nxt[2] << 8) | uip_connr->snd_nxt[3]);
+
+    if(uip_acklen > 0 &&
+       (uip_acklen <= uip_connr->len || uip_acklen <= uip_connr->maxlen)) {
       /* Update sequence number. */
+      uip_add32(uip_connr->snd_nxt, uip_acklen);
       uip_connr->snd_nxt[0] = uip_acc32[0];
       uip_connr->snd_nxt[1] = uip_acc32[1];
       uip_connr->snd_nxt[2] = uip_acc32[2];
       uip_connr->snd_nxt[3] = uip_acc32[3];
-	
 
       /* Do RTT estimation, unless we have done retransmissions. */
       if(uip_connr->nrtx == 0) {
@@ -1448,13 +1491,34 @@ uip_process(u8_t flag)
 	uip_connr->rto = (uip_connr->sa >> 3) + uip_connr->sv;
 
       }
+      /* New data got through, the backoff ends. Only here and only
+	 after the RTT sample (Karn): queueing more data while older
+	 segments are unacknowledged must not reset it. */
+      uip_connr->nrtx = 0;
+      /* Open the congestion window by a segment per acknowledgment
+	 in slow start and by about a segment per window after. */
+      if(uip_connr->cwnd < uip_connr->ssthresh) {
+	tmp16 = uip_connr->mss;
+      } else {
+	tmp16 = (unsigned long)uip_connr->mss * uip_connr->mss /
+	  uip_connr->cwnd;
+	if(tmp16 == 0) {
+	  tmp16 = 1;
+	}
+      }
+      if(uip_connr->cwnd < 0xffff - tmp16) {
+	uip_connr->cwnd += tmp16;
+      }
       /* Set the acknowledged flag. */
       uip_flags = UIP_ACKDATA;
       /* Reset the retransmission timer. */
       uip_connr->timer = uip_connr->rto;
 
-      /* Reset length of outstanding data. */
-      uip_connr->len = 0;
+      /* Reduce length of outstanding data. */
+      uip_connr->len = uip_connr->len > uip_acklen?
+	uip_connr->len - uip_acklen: 0;
+      uip_connr->maxlen = uip_connr->maxlen > uip_acklen?
+	uip_connr->maxlen - uip_acklen: 0;
     }
     
   }
@@ -1561,12 +1625,19 @@ uip_process(u8_t flag)
       if(uip_outstanding(uip_connr)) {
 	goto drop;
       }
-      uip_add_rcv_nxt(1 + uip_len);
+      uip_add_rcv_nxt(uip_len);
       uip_flags |= UIP_CLOSE;
       if(uip_len > 0) {
 	uip_flags |= UIP_NEWDATA;
       }
       UIP_APPCALL();
+      /* If the application refused the data, the FIN is not
+	 acknowledged either and the connection stays open until the
+	 remote host sends both again. */
+      if(uip_rejected) {
+	goto tcp_send_ack;
+      }
+      uip_add_rcv_nxt(1);
       uip_connr->len = 1;
       uip_connr->tcpstateflags = UIP_LAST_ACK;
       uip_connr->nrtx = 0;
@@ -1619,6 +1690,18 @@ uip_process(u8_t flag)
        "persistent timer" and uses the retransmission mechanim.
     */
     tmp16 = ((u16_t)BUF->wnd[0] << 8) + (u16_t)BUF->wnd[1];
+    /* Data that crossed a zero window on its way was most likely
+       dropped. Once the window opens again it is sent again right
+       away instead of after the retransmission timeout. */
+    if(uip_connr->snd_wnd == 0 && tmp16 > 0 &&
+       uip_outstanding(uip_connr) && !(uip_flags & UIP_ACKDATA)) {
+      UIP_STAT(++uip_stat.tcp.rexmit);
+      uip_flags |= UIP_REXMIT;
+      uip_connr->timer = uip_connr->rto;
+    }
+    /* The whole window limits how much may be in flight (see
+       uip_window()). */
+    uip_connr->snd_wnd = tmp16;
     if(tmp16 > uip_connr->initialmss ||
        tmp16 == 0) {
       tmp16 = uip_connr->initialmss;
@@ -1641,7 +1724,7 @@ uip_process(u8_t flag)
        put into the uip_appdata and the length of the data should be
        put into uip_len. If the application don't have any data to
        send, uip_len must be set to 0. */
-    if(uip_flags & (UIP_NEWDATA | UIP_ACKDATA)) {
+    if(uip_flags & (UIP_NEWDATA | UIP_ACKDATA | UIP_REXMIT)) {
       uip_slen = 0;
       UIP_APPCALL();
 
@@ -1663,47 +1746,50 @@ uip_process(u8_t flag)
 	goto tcp_send_nodata;
       }
 
+      if(uip_flags & UIP_REXMIT) {
+	goto apprexmit;
+      }
+
       /* If uip_slen > 0, the application has data to be sent. */
       if(uip_slen > 0) {
 
-	/* If the connection has acknowledged data, the contents of
-	   the ->len variable should be discarded. */
-	if((uip_flags & UIP_ACKDATA) != 0) {
-	  uip_connr->len = 0;
+	/* The application cannot send more than what is allowed by
+	   the mss (the minumum of the MSS and the available
+	   window). */
+	if(uip_slen > uip_connr->mss) {
+	  uip_slen = uip_connr->mss;
 	}
 
-	/* If the ->len variable is non-zero the connection has
-	   already data in transit and cannot send anymore right
-	   now. */
-	if(uip_connr->len == 0) {
-
-	  /* The application cannot send more than what is allowed by
-	     the mss (the minumum of the MSS and the available
-	     window). */
-	  if(uip_slen > uip_connr->mss) {
-	    uip_slen = uip_connr->mss;
-	  }
-
-	  /* Remember how much data we send out now so that we know
-	     when everything has been acknowledged. */
-	  uip_connr->len = uip_slen;
+	/* New data goes out behind the data already in transit, as
+	   far as the window allows. Remember how much is in flight so
+	   that we know when everything has been acknowledged. */
+	if(uip_connr->len > 0 &&
+	   uip_connr->len + uip_slen > uip_window(uip_connr)) {
+	  uip_slen = 0;
 	} else {
-
-	  /* If the application already had unacknowledged data, we
-	     make sure that the application does not send (i.e.,
-	     retransmit) out more than it previously sent out. */
-	  uip_slen = uip_connr->len;
+	  seqoff = uip_connr->len;
+	  uip_connr->len += uip_slen;
+	  if(uip_connr->maxlen < uip_connr->len) {
+	    uip_connr->maxlen = uip_connr->len;
+	  }
 	}
       }
-      uip_connr->nrtx = 0;
     apprexmit:
       uip_appdata = uip_sappdata;
       
       /* If the application has data to be sent, or if the incoming
          packet had new data in it, we must send out a packet. */
       if(uip_slen > 0 && uip_connr->len > 0) {
+	/* A retransmission resends the oldest segment, which may not
+	   be more than what is in flight. Whatever followed it is sent
+	   again as the window opens (go-back-N): if the oldest segment
+	   was lost, most likely those behind it were as well. */
+	if(uip_slen > uip_connr->len - seqoff) {
+	  uip_slen = uip_connr->len - seqoff;
+	}
+	uip_connr->len = seqoff + uip_slen;
 	/* Add the length of the IP and TCP headers. */
-	uip_len = uip_connr->len + UIP_TCPIP_HLEN;
+	uip_len = uip_slen + UIP_TCPIP_HLEN;
 	/* We always set the ACK flag in response packets. */
 	BUF->flags = TCP_ACK | TCP_PSH;
 	/* Send the packet. */
@@ -1804,10 +1890,11 @@ uip_process(u8_t flag)
   BUF->ackno[2] = uip_connr->rcv_nxt[2];
   BUF->ackno[3] = uip_connr->rcv_nxt[3];
   
-  BUF->seqno[0] = uip_connr->snd_nxt[0];
-  BUF->seqno[1] = uip_connr->snd_nxt[1];
-  BUF->seqno[2] = uip_connr->snd_nxt[2];
-  BUF->seqno[3] = uip_connr->snd_nxt[3];
+  uip_add32(uip_connr->snd_nxt, seqoff);
+  BUF->seqno[0] = uip_acc32[0];
+  BUF->seqno[1] = uip_acc32[1];
+  BUF->seqno[2] = uip_acc32[2];
+  BUF->seqno[3] = uip_acc32[3];
 
   BUF->proto = UIP_PROTO_TCP;
   
@@ -1878,6 +1965,22 @@ uip_process(u8_t flag)
   return;
 }
 /*---------------------------------------------------------------------------*/
+void
+uip_reject(void)
+{
+  /* The data was acknowledged before the application was called, take
+     that back. */
+  u16_t n = uip_len;
+  u8_t i, b;
+
+  for(i = 4; i > 0 && n > 0; --i) {
+    b = uip_conn->rcv_nxt[i - 1];
+    uip_conn->rcv_nxt[i - 1] = b - n;
+    n = (n >> 8) + (b < (n & 0xff));
+  }
+  uip_rejected = 1;
+}
+/*---------------------------------------------------------------------------*/
 u16_t
 htons(u16_t val)
 {
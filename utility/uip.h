@@ -510,6 +510,21 @@ struct uip_conn *uip_connect(uip_ipaddr_t *ripaddr, u16_t port);
  */
 #define uip_outstanding(conn) ((conn)->len)
 
+/**
+ * \internal
+ *
+ * The number of bytes a connection may have unacknowledged: the
+ * smaller of its congestion window and the window the remote host
+ * advertised. A zero window allows a single segment to probe it.
+ *
+ * \param conn A pointer to the uip_conn structure for the connection.
+ *
+ * \hideinitializer
+ */
+#define uip_window(conn) ((conn)->snd_wnd == 0? (conn)->initialmss: \
+                          (conn)->cwnd < (conn)->snd_wnd? \
+                          (conn)->cwnd: (conn)->snd_wnd)
+
 /**
  * Send data on the current connection.
  *
@@ -590,6 +605,16 @@ void uip_send(const void *data, int len);
  */
 #define uip_stop()          (uip_conn->tcpstateflags |= UIP_STOPPED)
 
+/**
+ * Refuse the data of the incoming segment.
+ *
+ * The application calls this function when it is called with new data
+ * (uip_newdata()) but has no room to store it. The data is not
+ * acknowledged, and neither is a FIN that came with it, so the remote
+ * host sends both again.
+ */
+void uip_reject(void);
+
 /**
  * Find out if the current connection has been previously stopped with
  * uip_stop().
@@ -647,6 +672,15 @@ void uip_send(const void *data, int len);
  */
 #define uip_acked()   (uip_flags & UIP_ACKDATA)
 
+/**
+ * The number of bytes the remote host acknowledged.
+ *
+ * Valid while uip_acked() is set. With several segments in flight an
+ * acknowledgment may cover only the oldest of them, or only a part of
+ * a segment, and the application releases that much of its data.
+ */
+extern u16_t uip_acklen;
+
 /**
  * Has the connection just been connected?
  *
@@ -944,6 +978,16 @@ struct uip_udp_conn *uip_udp_new(uip_ipaddr_t *ripaddr, u16_t rport);
                            ((((u16_t *)addr1)[1] & ((u16_t *)mask)[1]) == \
                             (((u16_t *)addr2)[1] & ((u16_t *)mask)[1])))
 
+/**
+ * Check if an IP address is a multicast (class D, 224.0.0.0/4) address.
+ *
+ * \param addr The IP address (of type uip_ipaddr_t).
+ *
+ * \hideinitializer
+ */
+#define uip_ipaddr_ismulticast(addr) \
+                          ((((u16_t *)addr)[0] & HTONS(0xf000)) == HTONS(0xe000))
+
 
 /**
  * Mask out the network part of an IP address.
@@ -1159,9 +1203,16 @@ struct uip_conn {
   
   u8_t rcv_nxt[4];    /**< The sequence number that we expect to
 			 receive next. */
-  u8_t snd_nxt[4];    /**< The sequence number that was last sent by
-                         us. */
-  u16_t len;          /**< Length of the data that was previously sent. */
+  u8_t snd_nxt[4];    /**< The oldest sequence number not yet
+                         acknowledged. */
+  u16_t len;          /**< Length of the data in flight, starting at
+			 snd_nxt. */
+  u16_t maxlen;       /**< Length of the data sent so far, starting at
+			 snd_nxt. More than len after a retransmission
+			 went back to the oldest segment. */
+  u16_t snd_wnd;      /**< The window advertised by the remote host. */
+  u16_t cwnd;         /**< Congestion window. */
+  u16_t ssthresh;     /**< Slow start threshold. */
   u16_t mss;          /**< Current maximum segment size for the
 			 connection. */
   u16_t initialmss;   /**< Initial maximum segment size for the
@@ -1507,6 +1558,7 @@ struct uip_udpip_hdr {
 
 
 #define UIP_PROTO_ICMP  1
+#define UIP_PROTO_IGMP  2
 #define UIP_PROTO_TCP   6
 #define UIP_PROTO_UDP   17
 #define UIP_PROTO_ICMP6 58
@@ -0,0 +1,107 @@
+/*
+ uip_pcap.cpp - records the frames UIPEthernet sends and receives in pcap format.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+#include "uip_pcap.h"
+
+#if UIP_PCAP
+
+#include "UIPNetwork.h"
+
+#define PCAP_MAGIC 0xa1b2c3d4
+#define PCAP_LINKTYPE_ETHERNET 1
+
+Print* UIPPcap::output;
+uint16_t UIPPcap::snapLength;
+unsigned long UIPPcap::lastMicros;
+unsigned long UIPPcap::elapsedSeconds;
+unsigned long UIPPcap::elapsedMicros;
+unsigned long UIPPcap::frames;
+
+void
+UIPPcap::begin(Print& out, uint16_t snaplen)
+{
+  output = &out;
+  snapLength = snaplen;
+  lastMicros = micros();
+  elapsedSeconds = 0;
+  elapsedMicros = 0;
+  frames = 0;
+  // pcap file header, version 2.4, timestamps in UTC
+  write32(PCAP_MAGIC);
+  write16(2);
+  write16(4);
+  write32(0);
+  write32(0);
+  write32(snaplen);
+  write32(PCAP_LINKTYPE_ETHERNET);
+}
+
+void
+UIPPcap::end()
+{
+  output = NULL;
+}
+
+void
+UIPPcap::capture(memhandle handle, memaddress pos, uint16_t len)
+{
+  if (!output)
+    return;
+  // time since begin(), micros() alone wraps after 71 minutes
+  unsigned long now = micros();
+  elapsedMicros += now - lastMicros;
+  lastMicros = now;
+  elapsedSeconds += elapsedMicros / 1000000;
+  elapsedMicros %= 1000000;
+
+  uint16_t caplen = len < snapLength ? len : snapLength;
+  write32(elapsedSeconds);
+  write32(elapsedMicros);
+  write32(caplen);
+  write32(len);
+  uint8_t buf[32];
+  while (caplen)
+    {
+      uint16_t n = caplen < sizeof(buf) ? caplen : sizeof(buf);
+      // the record length is written already, pad if the block is shorter
+      if (UIPNetwork::readPacket(handle, pos, buf, n) < n)
+        memset(buf, 0, n);
+      output->write(buf, n);
+      pos += n;
+      caplen -= n;
+    }
+  frames++;
+}
+
+// pcap is written in the byte order of the writer, this is little endian
+// as on AVR, ARM and x86
+void
+UIPPcap::write16(uint16_t value)
+{
+  uint8_t buf[2] = { (uint8_t)value, (uint8_t)(value >> 8) };
+  output->write(buf, 2);
+}
+
+void
+UIPPcap::write32(uint32_t value)
+{
+  uint8_t buf[4] = { (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24) };
+  output->write(buf, 4);
+}
+
+#endif
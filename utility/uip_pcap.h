@@ -0,0 +1,59 @@
+/*
+ uip_pcap.h - records the frames UIPEthernet sends and receives in pcap format.
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UIP_PCAP_H
+#define UIP_PCAP_H
+
+#include "Print.h"
+#include "mempool.h"
+
+#define UIP_PCAP_SNAPLEN 1518
+
+/*
+ * Writes a libpcap stream (the format of tcpdump -w and wireshark) to any
+ * Print: Serial, a File on SD or a file on a host. begin() writes the file
+ * header, after that every frame passing through UIPEthernetClass::tick()
+ * and network_send() is written with a micros() timestamp. Writing blocks
+ * the stack, so at 115200 baud keep snaplen small (54 covers the ethernet,
+ * ip and tcp headers) or the device will miss frames.
+ *
+ * Only compiled in with UIP_PCAP set (see uipethernet-conf.h).
+ */
+class UIPPcap
+{
+public:
+  static void begin(Print& out, uint16_t snaplen = UIP_PCAP_SNAPLEN);
+  static void end();
+  static bool capturing() { return output != NULL; }
+
+  // records len bytes starting at pos of the block as one frame
+  static void capture(memhandle handle, memaddress pos, uint16_t len);
+
+  static unsigned long frames;
+
+private:
+  static Print* output;
+  static uint16_t snapLength;
+  static unsigned long lastMicros;
+  static unsigned long elapsedSeconds;
+  static unsigned long elapsedMicros;
+
+  static void write16(uint16_t value);
+  static void write32(uint32_t value);
+};
+
+#endif
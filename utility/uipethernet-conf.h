@@ -5,12 +5,26 @@
 #define UIP_SOCKET_NUMPACKETS    5
 #define UIP_CONF_MAX_CONNECTIONS 4
 
+/* UIPServer::write() with at least this many bytes and more than one
+ * client connected writes the data to the ENC28J60 once and queues it on
+ * every client instead of writing it once per client. Shorter writes are
+ * appended to each clients own buffer, so byte-wise print()s still go out
+ * as one segment. set to 0 to always write per client */
+#define UIP_SERVER_SHARE_MIN     128
+
 /* for UDP
  * set UIP_CONF_UDP to 0 to disable UDP (saves aprox. 5kb flash) */
 #define UIP_CONF_UDP             1
 #define UIP_CONF_BROADCAST       1
+/* set UIP_CONF_MULTICAST to 0 to disable UIPUDP::beginMulticast and IGMP */
+#define UIP_CONF_MULTICAST       1
 #define UIP_CONF_UDP_CONNS       4
 
+/* bytes of payload UIPUDP::beginPacket allocates unless given the expected
+ * size of the datagram. write() grows the packet as needed (up to 1500
+ * bytes) and endPacket() trims it, so pool usage follows what is sent */
+#define UIP_UDP_PACKETSIZE       64
+
 /* number of attempts on write before returning number of bytes sent so far
  * set to -1 to block until connection is closed by timeout */
 #define UIP_ATTEMPTS_ON_WRITE    -1
@@ -26,4 +40,85 @@
  * set to -1 to disable fast polling and rely on periodic only (saves 100 bytes flash) */
 #define UIP_CLIENT_TIMER         10
 
+/* Arduino pin the INT output of the ENC28J60 is connected to. If set the
+ * receive path is only polled after INT signaled a packet (plus once per
+ * UIP_PERIODIC_TIMER), so idle calls to maintain() cause no SPI traffic.
+ * The pin must support attachInterrupt(). set to -1 to poll on every tick */
+#ifndef UIP_INT_PIN
+#define UIP_INT_PIN              -1
+#endif
+
+/* run PHY and MAC in full-duplex mode and send pause frames when the
+ * receivebuffer is about to overflow. The ENC28J60 doesn't support
+ * autonegotiation, so the switchport must be configured for full-duplex too.
+ * set to 0 for half-duplex */
+#ifndef UIP_FULL_DUPLEX
+#define UIP_FULL_DUPLEX          0
+#endif
+
+/* number of frames that may be queued for transmission. sendPacket only
+ * blocks when the queue is full */
+#define UIP_TX_QUEUE             2
+
+/* while no gap of this many bytes is free in the MemoryPool though the
+ * blocks would leave room for it, tick() moves one block at a time when
+ * nothing was received, so allocations up to this size rarely have to
+ * compact the whole pool first. The default fits a full ethernet frame
+ * set to 0 to compact only when an allocation fails */
+#define UIP_COMPACT_GAP          1526
+
+/* when no gap fits an allocation though the free space would, allocBlock()
+ * moves up to this many blocks to collect one before it fails. set to 0 to
+ * fail right away, -1 to compact the whole pool (which can take
+ * milliseconds, with the stack waiting) */
+#define UIP_COMPACT_ON_ALLOC     4
+
+/* limits on the buffer memory (the MemoryPool) in bytes, so one busy
+ * socket can't starve the others:
+ * UIP_SOCKET_QUOTA  that a single tcp or udp socket may hold (received data
+ *                   not read yet, data written but not acknowledged yet).
+ *                   The room tcp and udp keep for the headers of the
+ *                   frames they send doesn't count
+ * UIP_TCP_QUOTA     all tcp sockets together
+ * UIP_UDP_QUOTA     all udp sockets together
+ * UIP_POOL_RESERVE  kept free (along with one memblock) for the frames the
+ *                   stack sends: tcp segments, acks, arp, igmp. The default
+ *                   fits the frame of a full sized tcp segment: UIP_TCP_MSS,
+ *                   the ethernet, ip and tcp headers (14+20+20) and 8 bytes
+ *                   the driver adds (UIP_SENDBUFFER_OFFSET and _PADDING)
+ * set a quota to 0 for no limit */
+#define UIP_SOCKET_QUOTA         3072
+#define UIP_TCP_QUOTA            0
+#define UIP_UDP_QUOTA            4096
+#define UIP_POOL_RESERVE         (UIP_TCP_MSS+UIP_LLH_LEN+40+8)
+
+/* calculate the checksum of tcp/udp payload stored in the ENC28J60 using
+ * the chips DMA checksum engine instead of reading the payload via SPI.
+ * Reception is paused while the engine runs, it may miscalculate when a
+ * frame arrives meanwhile (silicon errata). Frames that start to arrive
+ * during the pause (some dozen microseconds per checksum) are lost, see
+ * rxPauses in Enc28J60Network::stats(). set to 0 to use the software
+ * implementation */
+#define UIP_HW_CHECKSUM          1
+
+/* record all frames sent and received in pcap format, see utility/uip_pcap.h
+ * set to 1 to enable (costs about 1kb flash) */
+#ifndef UIP_PCAP
+#define UIP_PCAP                 0
+#endif
+
+/* attribute the SPI traffic and busy-waiting of Enc28J60Network to the
+ * driver calls causing it, see utility/enc28j60_profile.h
+ * set to 1 to enable (costs about 300 bytes ram and 1kb flash) */
+#ifndef UIP_SPI_PROFILE
+#define UIP_SPI_PROFILE          0
+#endif
+
+/* network driver the stack runs on (see utility/UIPNetwork.h). Builds
+ * other than the Arduino IDE may define both to use another driver */
+#ifndef UIP_NETWORK
+#define UIP_NETWORK              Enc28J60Network
+#define UIP_NETWORK_HEADER       "Enc28J60Network.h"
+#endif
+
 #endif
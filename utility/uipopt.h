@@ -323,6 +323,21 @@
 #define UIP_RECEIVE_WINDOW UIP_CONF_RECEIVE_WINDOW
 #endif
 
+/**
+ * The congestion window a connection starts out with, in bytes.
+ *
+ * Bounds the data sent before the first acknowledgment arrives. It
+ * grows from there in slow start and shrinks back to one segment
+ * when a segment has to be retransmitted.
+ *
+ * \hideinitializer
+ */
+#ifndef UIP_CONF_TCP_INITIAL_CWND
+#define UIP_TCP_INITIAL_CWND (2 * UIP_TCP_MSS)
+#else
+#define UIP_TCP_INITIAL_CWND UIP_CONF_TCP_INITIAL_CWND
+#endif
+
 /**
  * How long a connection should stay in the TIME_WAIT state.
  *
@@ -429,6 +444,22 @@
 #define UIP_BROADCAST 0
 #endif /* UIP_CONF_BROADCAST */
 
+/**
+ * Multicast support.
+ *
+ * This flag configures reception of IP multicast datagrams. This is
+ * useful only together with UDP. Group membership is handled outside
+ * of uIP.
+ *
+ * \hideinitializer
+ *
+ */
+#if UIP_UDP && UIP_CONF_MULTICAST
+#define UIP_MULTICAST UIP_CONF_MULTICAST
+#else /* UIP_CONF_MULTICAST */
+#define UIP_MULTICAST 0
+#endif /* UIP_CONF_MULTICAST */
+
 /**
  * Print out a uIP log message.
  *